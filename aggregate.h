@@ -0,0 +1,333 @@
+//
+// Streaming windowed aggregation for P5 ("-a <spec>"). For the numeric
+// sources (P2 integers, P3 floats) the logger keeps per-source windows and
+// writes one summary record per window instead of every raw value.
+//
+// Windows are built from panes of 'slide' length: a tumbling window is one
+// pane, a sliding window of W/S panes is the merge of the last W/S panes.
+// Every pane holds mergeable statistics (count, min, max, sum, mean and M2
+// for the variance, and a log-bucket quantile sketch with ~2% relative error),
+// so a window summary never revisits raw values. Values are buffered per
+// source and folded into the pane a batch at a time. NaN and infinities stay
+// out of the statistics: they are counted and logged as raw records.
+//
+// Spec syntax: "<window_ms>[/<slide_ms>][,raw=<N>]"
+//   "1000"           1 s tumbling windows
+//   "10000/1000"     10 s windows sliding every 1 s
+//   "1000,raw=100"   also keep every 100th raw value
+//
+
+#ifndef PROCESSES_AGGREGATE_H
+#define PROCESSES_AGGREGATE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "record.h"
+
+#define AGG_BATCH 64               // Values folded into a pane per batch
+#define AGG_MAX_PANES 64           // Max window/slide ratio
+#define AGG_SKETCH_BUCKETS 1920    // Log buckets per sign, covers ~1e-14 .. 1e19 (every int64)
+#define AGG_SKETCH_OFFSET 820
+#define AGG_SKETCH_GAMMA 1.0408163265306123 // (1 + 0.02) / (1 - 0.02)
+#define AGG_MAX_SOURCE 4           // Source IDs are 2..4
+#define AGG_SOURCE_OFFSET 100      // WAL source ID of summaries: 100 + source
+
+typedef struct {
+    unsigned long long count;
+    double min, max, sum;
+    double mean, m2;               // Running mean and sum of squared deviations
+    unsigned long long zeros;
+    unsigned long long overflow_pos; // Beyond the last bucket (large doubles), quantile unbounded
+    unsigned long long overflow_neg;
+    uint32_t positive[AGG_SKETCH_BUCKETS];
+    uint32_t negative[AGG_SKETCH_BUCKETS];
+} agg_stats_t;
+
+typedef struct {
+    agg_stats_t panes[AGG_MAX_PANES]; // Ring indexed by pane number % panes_per_window
+    long long current_pane;           // Absolute pane number (ts / slide), -1 = none yet
+    double batch[AGG_BATCH];
+    int batch_len;
+    unsigned long long window_seq;    // Sequence number of emitted summaries
+    unsigned long long raw_seen;
+} agg_source_t;
+
+typedef struct {
+    unsigned long long window_ns;
+    unsigned long long slide_ns;
+    int panes_per_window;
+    unsigned int raw_every;           // 0 = drop raw values, N = keep every Nth
+    double log_gamma;
+    agg_source_t *sources[AGG_MAX_SOURCE + 1];
+
+    // --- Statistics ---
+    unsigned long long values_in;
+    unsigned long long nonfinite;     // NaN/inf values kept out of the statistics
+    unsigned long long summaries_out;
+    unsigned long long raw_out;
+} aggregator_t;
+
+// Summary sink, implemented by the logger: receives the stamp, the WAL
+// source ID and the summary text (without the stamp prefix)
+typedef void (*agg_emit_fn)(int wal_source, record_stamp_t stamp, const char *text);
+
+void agg_stats_reset(agg_stats_t *st) {
+    memset(st, 0, sizeof(*st));
+    st->min = INFINITY;
+    st->max = -INFINITY;
+}
+
+// --- Parse the spec and allocate per-source state, returns -1 on a bad spec ---
+int aggregator_init(aggregator_t *agg, const char *spec) {
+    memset(agg, 0, sizeof(*agg));
+    char *end = NULL;
+    long window_ms = strtol(spec, &end, 10);
+    long slide_ms = window_ms;
+    if (end == spec || window_ms <= 0) return -1;
+    if (*end == '/') {
+        const char *slide_str = end + 1;
+        slide_ms = strtol(slide_str, &end, 10);
+        if (end == slide_str || slide_ms <= 0 || window_ms % slide_ms != 0) return -1;
+    }
+    if (strncmp(end, ",raw=", 5) == 0) {
+        const char *raw_str = end + 5;
+        long raw = strtol(raw_str, &end, 10);
+        if (end == raw_str || raw < 0) return -1;
+        agg->raw_every = (unsigned int)raw;
+    }
+    if (*end != '\0') return -1;
+    if (window_ms / slide_ms > AGG_MAX_PANES) return -1;
+
+    agg->window_ns = (unsigned long long)window_ms * 1000000ULL;
+    agg->slide_ns = (unsigned long long)slide_ms * 1000000ULL;
+    agg->panes_per_window = (int)(window_ms / slide_ms);
+    agg->log_gamma = log(AGG_SKETCH_GAMMA);
+    for (int source = 2; source <= 3; source++) {
+        agg_source_t *src = calloc(1, sizeof(agg_source_t));
+        if (!src) return -1;
+        for (int p = 0; p < AGG_MAX_PANES; p++) agg_stats_reset(&src->panes[p]);
+        src->current_pane = -1;
+        agg->sources[source] = src;
+    }
+    return 0;
+}
+
+void aggregator_free(aggregator_t *agg) {
+    for (int source = 0; source <= AGG_MAX_SOURCE; source++) {
+        free(agg->sources[source]);
+        agg->sources[source] = NULL;
+    }
+}
+
+int aggregator_handles(const aggregator_t *agg, int source) {
+    return source >= 0 && source <= AGG_MAX_SOURCE && agg->sources[source] != NULL;
+}
+
+// --- Fold a batch of values into a pane ---
+// The min/max/sum and deviation passes are plain reductions the compiler
+// vectorises; the batch is then merged with Chan's parallel variance formula.
+void agg_stats_add_batch(agg_stats_t *st, const double *values, int n, double log_gamma) {
+    if (n <= 0) return;
+    double bmin = values[0], bmax = values[0], bsum = 0.0;
+#pragma omp simd reduction(min:bmin) reduction(max:bmax) reduction(+:bsum)
+    for (int i = 0; i < n; i++) {
+        bmin = values[i] < bmin ? values[i] : bmin;
+        bmax = values[i] > bmax ? values[i] : bmax;
+        bsum += values[i];
+    }
+    double bmean = bsum / n;
+    double bm2 = 0.0;
+#pragma omp simd reduction(+:bm2)
+    for (int i = 0; i < n; i++) {
+        double d = values[i] - bmean;
+        bm2 += d * d;
+    }
+
+    if (st->count == 0) {
+        st->mean = bmean;
+        st->m2 = bm2;
+    } else {
+        double total = (double)(st->count + (unsigned long long)n);
+        double delta = bmean - st->mean;
+        st->mean += delta * n / total;
+        st->m2 += bm2 + delta * delta * (double)st->count * n / total;
+    }
+    st->count += (unsigned long long)n;
+    st->sum += bsum;
+    if (bmin < st->min) st->min = bmin;
+    if (bmax > st->max) st->max = bmax;
+
+    for (int i = 0; i < n; i++) {
+        double v = values[i];
+        double magnitude = fabs(v);
+        if (magnitude < 1e-14 || isnan(v)) {
+            st->zeros++;
+            continue;
+        }
+        int index = (int)ceil(log(magnitude) / log_gamma) + AGG_SKETCH_OFFSET;
+        if (index < 0) index = 0;
+        if (index >= AGG_SKETCH_BUCKETS) {
+            // Not clamped into the top bucket: its quantiles are reported as unbounded
+            if (v > 0) st->overflow_pos++; else st->overflow_neg++;
+            continue;
+        }
+        if (v > 0) st->positive[index]++; else st->negative[index]++;
+    }
+}
+
+void agg_stats_merge(agg_stats_t *dst, const agg_stats_t *src) {
+    if (src->count == 0) return;
+    if (dst->count == 0) {
+        *dst = *src;
+        return;
+    }
+    double total = (double)(dst->count + src->count);
+    double delta = src->mean - dst->mean;
+    dst->mean += delta * (double)src->count / total;
+    dst->m2 += src->m2 + delta * delta * (double)dst->count * (double)src->count / total;
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+    dst->zeros += src->zeros;
+    dst->overflow_pos += src->overflow_pos;
+    dst->overflow_neg += src->overflow_neg;
+    for (int i = 0; i < AGG_SKETCH_BUCKETS; i++) {
+        dst->positive[i] += src->positive[i];
+        dst->negative[i] += src->negative[i];
+    }
+}
+
+// Bucket midpoints can fall outside the observed range, keep estimates inside it
+double agg_clamp(const agg_stats_t *st, double v) {
+    if (v < st->min) return st->min;
+    if (v > st->max) return st->max;
+    return v;
+}
+
+// --- Estimate quantile q (0..1) from the sketch ---
+// A quantile among the values beyond the sketch's range is -inf/inf (unbounded).
+double agg_stats_quantile(const agg_stats_t *st, double q, double log_gamma) {
+    if (st->count == 0) return 0.0;
+    unsigned long long rank = (unsigned long long)(q * (double)(st->count - 1));
+    unsigned long long seen = st->overflow_neg;
+    if (seen > rank) return -INFINITY;
+    for (int i = AGG_SKETCH_BUCKETS - 1; i >= 0; i--) { // Most negative first
+        seen += st->negative[i];
+        if (seen > rank) return agg_clamp(st, -2.0 * exp((i - AGG_SKETCH_OFFSET) * log_gamma) / (AGG_SKETCH_GAMMA + 1.0));
+    }
+    seen += st->zeros;
+    if (seen > rank) return 0.0;
+    for (int i = 0; i < AGG_SKETCH_BUCKETS; i++) {
+        seen += st->positive[i];
+        if (seen > rank) return agg_clamp(st, 2.0 * exp((i - AGG_SKETCH_OFFSET) * log_gamma) / (AGG_SKETCH_GAMMA + 1.0));
+    }
+    return INFINITY;
+}
+
+void agg_flush_batch(aggregator_t *agg, agg_source_t *src) {
+    if (src->batch_len == 0 || src->current_pane < 0) return;
+    agg_stats_t *pane = &src->panes[src->current_pane % agg->panes_per_window];
+    agg_stats_add_batch(pane, src->batch, src->batch_len, agg->log_gamma);
+    src->batch_len = 0;
+}
+
+// --- Emit the summary of the window that ends with pane 'last_pane' ---
+void agg_emit_window(aggregator_t *agg, int source, agg_source_t *src, long long last_pane, agg_emit_fn emit) {
+    agg_stats_t window;
+    agg_stats_reset(&window);
+    for (int p = 0; p < agg->panes_per_window; p++) {
+        long long pane = last_pane - p;
+        if (pane < 0) break;
+        agg_stats_merge(&window, &src->panes[pane % agg->panes_per_window]);
+    }
+    if (window.count == 0) return;
+
+    unsigned long long end_ns = (unsigned long long)(last_pane + 1) * agg->slide_ns;
+    unsigned long long start_ns = end_ns > agg->window_ns ? end_ns - agg->window_ns : 0;
+    double variance = window.count > 1 ? window.m2 / (double)(window.count - 1) : 0.0;
+    char text[MAX_MSG_SIZE];
+    snprintf(text, sizeof(text),
+             "agg%d: window=[%llu,%llu) count=%llu min=%.17g max=%.17g sum=%.17g mean=%.17g var=%.17g "
+             "p50=%.6g p90=%.6g p99=%.6g",
+             source, start_ns, end_ns, window.count, window.min, window.max, window.sum, window.mean, variance,
+             agg_stats_quantile(&window, 0.50, agg->log_gamma),
+             agg_stats_quantile(&window, 0.90, agg->log_gamma),
+             agg_stats_quantile(&window, 0.99, agg->log_gamma));
+    record_stamp_t stamp = {end_ns, ++src->window_seq};
+    emit(AGG_SOURCE_OFFSET + source, stamp, text);
+    agg->summaries_out++;
+}
+
+// --- Close panes up to (not including) 'new_pane', emitting their windows ---
+void agg_advance(aggregator_t *agg, int source, agg_source_t *src, long long new_pane, agg_emit_fn emit) {
+    if (src->current_pane < 0) {
+        src->current_pane = new_pane;
+        return;
+    }
+    agg_flush_batch(agg, src);
+    // After panes_per_window empty panes every later window is empty too
+    long long limit = src->current_pane + agg->panes_per_window;
+    for (long long pane = src->current_pane; pane < new_pane && pane < limit; pane++) {
+        agg_emit_window(agg, source, src, pane, emit);
+        agg_stats_reset(&src->panes[(pane + 1) % agg->panes_per_window]);
+    }
+    if (new_pane >= limit) {
+        for (int p = 0; p < agg->panes_per_window; p++) agg_stats_reset(&src->panes[p]);
+    }
+    src->current_pane = new_pane;
+}
+
+// --- Add one value; returns 1 if the raw record should also be logged ---
+int aggregator_add(aggregator_t *agg, int source, unsigned long long ts_ns, double value, agg_emit_fn emit) {
+    agg_source_t *src = agg->sources[source];
+    if (!isfinite(value)) {
+        // One NaN would poison min/max/mean of every window it is merged into
+        agg->nonfinite++;
+        return 1;
+    }
+    long long pane = (long long)(ts_ns / agg->slide_ns);
+    if (pane > src->current_pane) agg_advance(agg, source, src, pane, emit);
+    // A late record (pane already closed) is counted in the current pane
+    src->batch[src->batch_len++] = value;
+    if (src->batch_len == AGG_BATCH) agg_flush_batch(agg, src);
+    agg->values_in++;
+
+    int keep_raw = agg->raw_every > 0 && src->raw_seen % agg->raw_every == 0;
+    src->raw_seen++;
+    if (keep_raw) agg->raw_out++;
+    return keep_raw;
+}
+
+// --- Close every window that ended before 'now_ns' (no record can still arrive) ---
+void aggregator_tick(aggregator_t *agg, unsigned long long now_ns, agg_emit_fn emit) {
+    long long pane = (long long)(now_ns / agg->slide_ns);
+    for (int source = 0; source <= AGG_MAX_SOURCE; source++) {
+        agg_source_t *src = agg->sources[source];
+        if (src && src->current_pane >= 0 && pane > src->current_pane) agg_advance(agg, source, src, pane, emit);
+    }
+}
+
+// --- Emit the windows that are still open (shutdown) ---
+void aggregator_finish(aggregator_t *agg, agg_emit_fn emit) {
+    for (int source = 0; source <= AGG_MAX_SOURCE; source++) {
+        agg_source_t *src = agg->sources[source];
+        if (!src || src->current_pane < 0) continue;
+        agg_flush_batch(agg, src);
+        agg_emit_window(agg, source, src, src->current_pane, emit);
+        src->current_pane = -1;
+    }
+}
+
+void aggregator_report(const aggregator_t *agg, FILE *out) {
+    fprintf(out, "Aggregation: window %llu ms, slide %llu ms, %llu values -> %llu summaries + %llu raw records",
+            agg->window_ns / 1000000ULL, agg->slide_ns / 1000000ULL,
+            agg->values_in, agg->summaries_out, agg->raw_out);
+    if (agg->nonfinite > 0) fprintf(out, ", %llu NaN/inf values logged raw only", agg->nonfinite);
+    fprintf(out, "\n");
+}
+
+#endif //PROCESSES_AGGREGATE_H
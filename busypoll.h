@@ -0,0 +1,97 @@
+//
+// Adaptive busy polling for P5 (-b). By default the logger blocks in
+// pselect() whenever its channels are empty, so at moderate rates every
+// record pays a sleep/wakeup cycle. In polling mode it keeps checking its
+// descriptors and rings without blocking while records keep coming. Empty
+// passes back off with the CPU's pause instruction: 1, 2, 4 ... up to
+// BUSY_POLL_MAX_PAUSES per pass. Once nothing has arrived for the idle
+// period, the logger blocks again until the next wakeup. The time spent
+// spinning and sleeping is counted, so the CPU cost shows in the report.
+//
+
+#ifndef PROCESSES_BUSYPOLL_H
+#define PROCESSES_BUSYPOLL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "record.h"
+
+#define BUSY_POLL_MAX_PAUSES 32 // A few microseconds per pass at most, bounds the pickup delay
+
+typedef struct {
+    unsigned long long idle_ns;          // Spin this long after the last record, 0 = always block
+    unsigned long long last_progress_ns;
+    int pauses;                          // Backoff of the next empty pass
+
+    // --- Statistics ---
+    unsigned long long spin_ns;          // Polling that found nothing, pauses included
+    unsigned long long sleep_ns;         // Blocked in pselect()
+    unsigned long long passes;           // Non-blocking polls
+    unsigned long long empty_passes;
+    unsigned long long sleeps;           // Blocking waits
+} busy_poll_t;
+
+// --- One pause: tells the core (and its SMT sibling) that this is a spin loop ---
+void busy_poll_cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// --- Configure from the idle period in microseconds, returns -1 if invalid ---
+int busy_poll_init(busy_poll_t *bp, const char *idle_us) {
+    char *end = NULL;
+    long value = strtol(idle_us, &end, 10);
+    if (end == idle_us || *end != '\0' || value < 0) return -1;
+    memset(bp, 0, sizeof(*bp));
+    bp->idle_ns = (unsigned long long)value * 1000ULL;
+    bp->last_progress_ns = monotonic_ns();
+    return 0;
+}
+
+// --- Before waiting: 1 = poll with a zero timeout, 0 = block ---
+int busy_poll_should_spin(const busy_poll_t *bp, unsigned long long now_ns) {
+    return bp->idle_ns > 0 && now_ns - bp->last_progress_ns < bp->idle_ns;
+}
+
+// --- Account one wait ('spun' = zero-timeout poll) that took 'wait_ns' ---
+void busy_poll_waited(busy_poll_t *bp, int spun, unsigned long long wait_ns) {
+    if (spun) {
+        bp->passes++;
+        bp->spin_ns += wait_ns;
+    } else {
+        bp->sleeps++;
+        bp->sleep_ns += wait_ns;
+    }
+}
+
+// --- After a pass: 'progress' = records were read ---
+// An empty polling pass backs off before the next one.
+void busy_poll_after_pass(busy_poll_t *bp, int spun, int progress) {
+    if (progress) {
+        bp->last_progress_ns = monotonic_ns();
+        bp->pauses = 0;
+        return;
+    }
+    if (!spun) return;
+    bp->empty_passes++;
+    if (bp->pauses == 0) bp->pauses = 1;
+    unsigned long long start = monotonic_ns();
+    for (int i = 0; i < bp->pauses; i++) busy_poll_cpu_relax();
+    bp->spin_ns += monotonic_ns() - start;
+    if (bp->pauses < BUSY_POLL_MAX_PAUSES) bp->pauses *= 2;
+}
+
+void busy_poll_report(const busy_poll_t *bp, FILE *out) {
+    double waited = (double)(bp->spin_ns + bp->sleep_ns);
+    fprintf(out, "\nProcess 5: Busy-poll (idle %.3f ms): spun %.3f ms in %llu polls (%llu empty), "
+                 "slept %.3f ms in %llu waits, %.1f%% of the wait time spinning\n",
+            (double)bp->idle_ns / 1e6, (double)bp->spin_ns / 1e6, bp->passes, bp->empty_passes,
+            (double)bp->sleep_ns / 1e6, bp->sleeps, waited > 0 ? 100.0 * (double)bp->spin_ns / waited : 0.0);
+}
+
+#endif //PROCESSES_BUSYPOLL_H
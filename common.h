@@ -29,7 +29,10 @@ void display_menu() {
     fprintf(stderr, "4. Stop Process 2\n");
     fprintf(stderr, "5. Stop Process 3\n");
     fprintf(stderr, "6. Stop Process 4\n");
-    fprintf(stderr, "7. Exit Program\n\n");
+    fprintf(stderr, "7. Exit Program\n");
+    fprintf(stderr, "8. Reconfigure Running Workers\n");
+    fprintf(stderr, "9. Show Status (restarts, recovery times)\n");
+    fprintf(stderr, "10. Upgrade Loggers Without Downtime\n\n");
     fprintf(stderr, "Enter option: ");
     fflush(stderr);
 }
@@ -40,6 +43,37 @@ void display_menu() {
 #define SOCKET_PATH "/tmp/proc4_socket"
 #define MAX_MSG_SIZE 256 // Max size for message queue and buffers
 #define MQ_MAX_MSGS 10    // Max messages in queue
+#define MAX_LOGGER_SHARDS 8 // Upper bound for P5 shards (shard indexes, logreplay -n)
+#define LOGGER_PRODUCERS 3  // P2, P3, P4: P1 starts no more shards than there are producers
+#define MAX_PATH_LEN 108    // Matches sizeof(sockaddr_un.sun_path)
+
+// --- Logger shard helpers ---
+// Shard 0 keeps the historical IPC names so a single-shard setup is unchanged;
+// shard N appends "_N" to the FIFO path, MQ name and socket path.
+void shard_ipc_name(const char *base, int shard, char *out, size_t size) {
+    if (shard <= 0) {
+        snprintf(out, size, "%s", base);
+    } else {
+        snprintf(out, size, "%s_%d", base, shard);
+    }
+}
+
+// With one shard the segment is the log file itself, otherwise "<log>.shardN".
+void shard_log_name(const char *log_filename, int shard, int shard_count, char *out, size_t size) {
+    if (shard_count <= 1) {
+        snprintf(out, size, "%s", log_filename);
+    } else {
+        snprintf(out, size, "%s.shard%d", log_filename, shard);
+    }
+}
+
+// Routes a producer to a shard round-robin by source ID (P2 -> 0, P3 -> 1,
+// P4 -> 2, wrapping), so a given producer always lands on the same shard (and
+// segment) and the producers spread evenly.
+int route_shard(int source_id, int shard_count) {
+    if (shard_count <= 1) return 0;
+    return (source_id - 2) % shard_count;
+}
 
 // --- ANSI Color Codes ---
 #define COL_RESET   "\x1B[0m"
@@ -0,0 +1,117 @@
+//
+// Shared-memory control block used by P1 to reconfigure running workers.
+// P1 creates and owns the block; P2, P3 and P4 map it read-only and poll its
+// version on every loop iteration, which costs one atomic load when nothing
+// changed. Writers follow the seqlock protocol: the version is odd while an
+// update is in progress, so readers retry instead of seeing a torn config.
+//
+
+#ifndef PROCESSES_CONTROL_H
+#define PROCESSES_CONTROL_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "pacer.h"
+#include "filter.h"
+#include "sendbatch.h"
+
+#define CONTROL_SHM_NAME "/proc_control"
+#define CONTROL_WORKER_SLOTS 3 // P2, P3, P4
+
+typedef struct {
+    unsigned long generation; // Bumped every time this worker's config changes
+    char rate_spec[64];       // Token-bucket spec, see pacer.h
+    char text_color[4];       // ANSI color codes, e.g. "31"
+    char bg_color[4];
+    char filter_spec[FILTER_SPEC_MAX]; // Producer-side filter/sampling, see filter.h ("" = send everything)
+    char batch_spec[SEND_BATCH_SPEC_MAX]; // Adaptive send batching, see sendbatch.h ("" = off)
+} worker_config_t;
+
+typedef struct {
+    atomic_uint version; // Seqlock sequence, odd while P1 is writing
+    worker_config_t workers[CONTROL_WORKER_SLOTS];
+} control_block_t;
+
+int control_slot(int process_num) {
+    return process_num - 2;
+}
+
+// --- Map the control block, P1 creates it (read-write), workers map it read-only ---
+control_block_t *control_map(int create) {
+    int fd = shm_open(CONTROL_SHM_NAME, create ? (O_CREAT | O_RDWR) : O_RDONLY, 0666);
+    if (fd == -1) return NULL;
+    if (create && ftruncate(fd, sizeof(control_block_t)) == -1) {
+        close(fd);
+        return NULL;
+    }
+    void *addr = mmap(NULL, sizeof(control_block_t), create ? (PROT_READ | PROT_WRITE) : PROT_READ,
+                      MAP_SHARED, fd, 0);
+    close(fd);
+    return addr == MAP_FAILED ? NULL : (control_block_t *)addr;
+}
+
+void control_unmap(control_block_t *cb) {
+    if (cb) munmap(cb, sizeof(control_block_t));
+}
+
+// --- Publish a new config for one worker (P1 only) ---
+void control_publish(control_block_t *cb, int process_num, const worker_config_t *config) {
+    worker_config_t *slot = &cb->workers[control_slot(process_num)];
+    unsigned int v = atomic_load_explicit(&cb->version, memory_order_relaxed);
+    atomic_store_explicit(&cb->version, v + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    unsigned long generation = slot->generation + 1;
+    memcpy(slot, config, sizeof(*slot));
+    slot->generation = generation;
+    atomic_store_explicit(&cb->version, v + 2, memory_order_release);
+}
+
+// --- Cheap poll: returns 1 and a consistent copy when the block changed ---
+// '*seen_version' is the version the caller last looked at.
+int control_poll(const control_block_t *cb, int process_num, unsigned int *seen_version,
+                 worker_config_t *out) {
+    if (!cb) return 0;
+    control_block_t *block = (control_block_t *)cb;
+    unsigned int v1 = atomic_load_explicit(&block->version, memory_order_acquire);
+    if (v1 == *seen_version) return 0;
+    unsigned int v2;
+    do {
+        while ((v1 = atomic_load_explicit(&block->version, memory_order_acquire)) & 1u) {
+            // Writer in progress, retry
+        }
+        memcpy(out, &cb->workers[control_slot(process_num)], sizeof(*out));
+        atomic_thread_fence(memory_order_acquire);
+        v2 = atomic_load_explicit(&block->version, memory_order_relaxed);
+    } while (v1 != v2);
+    *seen_version = v1;
+    return 1;
+}
+
+// --- Apply a polled config to a worker's pacer, filter, send batch and console colors ---
+// Colors are stored as full escape sequences, like the workers' argv handling.
+void control_apply_worker_config(const worker_config_t *config, pacer_t *pacer, worker_filter_t *filter,
+                                 send_batch_t *batch,
+                                 char *text_color_code, size_t text_size,
+                                 char *bg_color_code, size_t bg_size, int process_num) {
+    if (config->rate_spec[0] != '\0' && pacer_configure(pacer, config->rate_spec) == -1) {
+        fprintf(stderr, "\nProcess %d: Ignoring invalid live rate spec '%s'.\n", process_num, config->rate_spec);
+    }
+    if (strcmp(config->filter_spec, filter->spec) != 0 && filter_configure(filter, config->filter_spec) == -1) {
+        fprintf(stderr, "\nProcess %d: Ignoring invalid live filter spec '%s'.\n", process_num, config->filter_spec);
+    }
+    if (strcmp(config->batch_spec, batch->spec) != 0 && send_batch_configure(batch, config->batch_spec) == -1) {
+        fprintf(stderr, "\nProcess %d: Ignoring invalid live batch spec '%s'.\n", process_num, config->batch_spec);
+    }
+    if (config->text_color[0] != '\0') snprintf(text_color_code, text_size, "\x1B[%sm", config->text_color);
+    if (config->bg_color[0] != '\0') snprintf(bg_color_code, bg_size, "\x1B[%sm", config->bg_color);
+    printf("\nProcess %d: Applied live config #%lu (rate %s, colors %s/%s, filter %s, batch %s).\n", process_num,
+           config->generation, config->rate_spec, config->text_color, config->bg_color,
+           filter->spec[0] != '\0' ? filter->spec : "off", batch->spec[0] != '\0' ? batch->spec : "off");
+}
+
+#endif //PROCESSES_CONTROL_H
@@ -0,0 +1,75 @@
+//
+// CRC32C (Castagnoli) used to checksum WAL records. On x86-64 CPUs with
+// SSE4.2 the crc32 instruction processes 8 bytes per step; everywhere else a
+// byte-wise lookup table is used. The hardware path is picked once at runtime.
+//
+
+#ifndef PROCESSES_CRC32C_H
+#define PROCESSES_CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define CRC32C_HAVE_SSE42 1
+#endif
+
+uint32_t crc32c_table[256];
+int crc32c_initialised = 0;
+int crc32c_use_hw = 0;
+
+void crc32c_init() {
+    if (crc32c_initialised) return;
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1u) ? (crc >> 1) ^ 0x82F63B78u : crc >> 1;
+        }
+        crc32c_table[i] = crc;
+    }
+#ifdef CRC32C_HAVE_SSE42
+    __builtin_cpu_init();
+    crc32c_use_hw = __builtin_cpu_supports("sse4.2") != 0;
+#endif
+    crc32c_initialised = 1;
+}
+
+uint32_t crc32c_sw(uint32_t crc, const unsigned char *data, size_t len) {
+    while (len--) {
+        crc = crc32c_table[(crc ^ *data++) & 0xFFu] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef CRC32C_HAVE_SSE42
+__attribute__((target("sse4.2")))
+uint32_t crc32c_hw(uint32_t crc, const unsigned char *data, size_t len) {
+    uint64_t crc64 = crc;
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)crc64;
+    while (len--) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+#endif
+
+// --- CRC32C of a buffer, 'crc' chains partial updates (start with 0) ---
+uint32_t crc32c_update(uint32_t crc, const void *data, size_t len) {
+    if (!crc32c_initialised) crc32c_init();
+    crc = ~crc;
+#ifdef CRC32C_HAVE_SSE42
+    if (crc32c_use_hw) return ~crc32c_hw(crc, (const unsigned char *)data, len);
+#endif
+    return ~crc32c_sw(crc, (const unsigned char *)data, len);
+}
+
+#endif //PROCESSES_CRC32C_H
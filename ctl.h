@@ -0,0 +1,255 @@
+//
+// Control API of P1. A command is one line of words, e.g. "start 2" or
+// "rate all 2000msg/s", and gets exactly one reply line of JSON:
+//   {"ok":true,"cmd":"start","pid":1234,"us":71.4}
+//   {"ok":false,"cmd":"start","error":"Process 2 is already running","us":0.3}
+// The same commands come from the control socket (-c), from a batch script
+// (-x) and from the interactive menu, which turns its choices into them.
+// The socket is a non-blocking Unix stream socket served from P1's select()
+// loop, so a command costs one read, the action and one write.
+//
+
+#ifndef PROCESSES_CTL_H
+#define PROCESSES_CTL_H
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "common.h"
+#include "record.h" // monotonic_ns()
+
+#define CTL_SOCKET_DEFAULT "/tmp/proc1_control"
+#define CTL_MAX_CLIENTS 8
+#define CTL_LINE_MAX 256
+#define CTL_MAX_ARGS 8
+#define CTL_FIELDS_MAX 3072
+#define CTL_REPLY_MAX 4096
+
+typedef struct {
+    char cmd[16];
+    int ok;
+    char error[160];
+    char fields[CTL_FIELDS_MAX]; // ",\"key\":value" pairs added by the command
+    size_t fields_len;
+    unsigned long long start_ns;
+} ctl_reply_t;
+
+typedef struct {
+    int fd; // -1 = free slot
+    char line[CTL_LINE_MAX];
+    size_t len;
+} ctl_client_t;
+
+// Runs one command line (modifiable) and fills the reply
+typedef void (*ctl_handler_fn)(char *line, ctl_reply_t *reply);
+
+// --- Start a reply, the command name is the first word of the line ---
+void ctl_reply_begin(ctl_reply_t *reply, const char *cmd) {
+    snprintf(reply->cmd, sizeof(reply->cmd), "%s", cmd);
+    reply->ok = 1;
+    reply->error[0] = '\0';
+    reply->fields[0] = '\0';
+    reply->fields_len = 0;
+    reply->start_ns = monotonic_ns();
+}
+
+// --- Append raw JSON, e.g. ctl_reply_add(reply, ",\"pid\":%d", pid) ---
+void ctl_reply_add(ctl_reply_t *reply, const char *fmt, ...) {
+    if (reply->fields_len >= sizeof(reply->fields) - 1) return;
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(reply->fields + reply->fields_len, sizeof(reply->fields) - reply->fields_len, fmt, args);
+    va_end(args);
+    if (n > 0) reply->fields_len += (size_t)n;
+    if (reply->fields_len > sizeof(reply->fields) - 1) reply->fields_len = sizeof(reply->fields) - 1;
+}
+
+// --- Append a JSON string value, escaped (user input such as rate specs ends up here) ---
+void ctl_reply_add_string(ctl_reply_t *reply, const char *key, const char *value) {
+    char escaped[2 * CTL_LINE_MAX];
+    size_t out = 0;
+    for (const char *p = value; *p && out < sizeof(escaped) - 7; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c == '"' || c == '\\') {
+            escaped[out++] = '\\';
+            escaped[out++] = (char)c;
+        } else if (c < 0x20) {
+            out += (size_t)snprintf(escaped + out, sizeof(escaped) - out, "\\u%04x", c);
+        } else {
+            escaped[out++] = (char)c;
+        }
+    }
+    escaped[out] = '\0';
+    ctl_reply_add(reply, ",\"%s\":\"%s\"", key, escaped);
+}
+
+// --- Fail the command; the first error is the one reported ---
+void ctl_reply_error(ctl_reply_t *reply, const char *fmt, ...) {
+    if (!reply->ok) return;
+    reply->ok = 0;
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(reply->error, sizeof(reply->error), fmt, args);
+    va_end(args);
+}
+
+// --- The reply line, newline included; returns its length ---
+size_t ctl_reply_format(ctl_reply_t *reply, char *out, size_t size) {
+    double us = (double)(monotonic_ns() - reply->start_ns) / 1e3;
+    if (!reply->ok) {
+        // Goes through the escaping of string values, after the command's own fields
+        ctl_reply_add_string(reply, "error", reply->error);
+    }
+    int n = snprintf(out, size, "{\"ok\":%s,\"cmd\":\"%s\"%s,\"us\":%.1f}\n",
+                     reply->ok ? "true" : "false", reply->cmd, reply->fields, us);
+    if (n < 0) return 0;
+    if ((size_t)n >= size) {
+        // Cut short: still one line
+        out[size - 2] = '\n';
+        return size - 1;
+    }
+    return (size_t)n;
+}
+
+// --- Split a command line into words; '#' starts a comment. Returns the count ---
+int ctl_split(char *line, char *argv[], int max) {
+    char *comment = strchr(line, '#');
+    if (comment) *comment = '\0';
+    int argc = 0;
+    char *p = line;
+    while (argc < max) {
+        while (*p && isspace((unsigned char)*p)) p++;
+        if (*p == '\0') break;
+        argv[argc++] = p;
+        while (*p && !isspace((unsigned char)*p)) p++;
+        if (*p) *p++ = '\0';
+    }
+    return argc;
+}
+
+// --- Run one line through 'handler' and format the reply ---
+size_t ctl_execute(ctl_handler_fn handler, char *line, char *out, size_t size) {
+    ctl_reply_t reply;
+    ctl_reply_begin(&reply, "");
+    handler(line, &reply);
+    return ctl_reply_format(&reply, out, size);
+}
+
+// --- Listen on the control socket, returns the fd or -1 ---
+// The socket is created 0600: any command, "shutdown" included, is only
+// accepted from P1's own user.
+int ctl_listen(const char *path, ctl_client_t clients[CTL_MAX_CLIENTS]) {
+    for (int i = 0; i < CTL_MAX_CLIENTS; i++) clients[i].fd = -1;
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) return -1;
+    unlink(path); // A previous P1 that was killed
+    mode_t old_umask = umask(077); // No window in which the socket is connectable by others
+    int bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_umask);
+    if (bound == -1 || listen(fd, CTL_MAX_CLIENTS) == -1 ||
+        fcntl(fd, F_SETFL, O_NONBLOCK) == -1 || fcntl(fd, F_SETFD, FD_CLOEXEC) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// --- Add the listening socket and the clients to a select() set, returns the new max fd ---
+int ctl_add_fds(int listen_fd, const ctl_client_t clients[CTL_MAX_CLIENTS], fd_set *set, int max_fd) {
+    if (listen_fd == -1) return max_fd;
+    FD_SET(listen_fd, set);
+    if (listen_fd > max_fd) max_fd = listen_fd;
+    for (int i = 0; i < CTL_MAX_CLIENTS; i++) {
+        if (clients[i].fd == -1) continue;
+        FD_SET(clients[i].fd, set);
+        if (clients[i].fd > max_fd) max_fd = clients[i].fd;
+    }
+    return max_fd;
+}
+
+void ctl_drop_client(ctl_client_t *client) {
+    close(client->fd);
+    client->fd = -1;
+    client->len = 0;
+}
+
+// --- Accept new clients and run every complete command line they sent ---
+void ctl_service(int listen_fd, ctl_client_t clients[CTL_MAX_CLIENTS], const fd_set *ready, ctl_handler_fn handler) {
+    if (listen_fd == -1) return;
+    if (FD_ISSET(listen_fd, ready)) {
+        int fd;
+        while ((fd = accept(listen_fd, NULL, NULL)) != -1) {
+            int slot = -1;
+            for (int i = 0; i < CTL_MAX_CLIENTS && slot == -1; i++) {
+                if (clients[i].fd == -1) slot = i;
+            }
+            if (slot == -1 || fcntl(fd, F_SETFL, O_NONBLOCK) == -1 || fcntl(fd, F_SETFD, FD_CLOEXEC) == -1) {
+                static const char busy[] = "{\"ok\":false,\"cmd\":\"\",\"error\":\"too many control clients\"}\n";
+                if (write(fd, busy, sizeof(busy) - 1) == -1) { /* Closing anyway */ }
+                close(fd);
+                continue;
+            }
+            clients[slot].fd = fd;
+            clients[slot].len = 0;
+        }
+    }
+
+    char reply[CTL_REPLY_MAX];
+    for (int i = 0; i < CTL_MAX_CLIENTS; i++) {
+        ctl_client_t *client = &clients[i];
+        if (client->fd == -1 || !FD_ISSET(client->fd, ready)) continue;
+        ssize_t n = read(client->fd, client->line + client->len, sizeof(client->line) - 1 - client->len);
+        if (n == 0 || (n == -1 && errno != EAGAIN && errno != EINTR)) {
+            ctl_drop_client(client);
+            continue;
+        }
+        if (n < 0) continue;
+        client->len += (size_t)n;
+
+        // Every complete line is one command, in order
+        size_t pos = 0;
+        char *newline;
+        while (client->fd != -1 && (newline = memchr(client->line + pos, '\n', client->len - pos)) != NULL) {
+            *newline = '\0';
+            size_t reply_len = ctl_execute(handler, client->line + pos, reply, sizeof(reply));
+            // Replies are small; a client that does not read them is dropped
+            if (write(client->fd, reply, reply_len) != (ssize_t)reply_len) ctl_drop_client(client);
+            pos = (size_t)(newline - client->line) + 1;
+        }
+        if (client->fd == -1) continue;
+        memmove(client->line, client->line + pos, client->len - pos);
+        client->len -= pos;
+        if (client->len == sizeof(client->line) - 1) {
+            static const char too_long[] = "{\"ok\":false,\"cmd\":\"\",\"error\":\"command line too long\"}\n";
+            if (write(client->fd, too_long, sizeof(too_long) - 1) == -1) { /* Dropped anyway */ }
+            ctl_drop_client(client);
+        }
+    }
+}
+
+void ctl_close(int listen_fd, ctl_client_t clients[CTL_MAX_CLIENTS], const char *path) {
+    if (listen_fd == -1) return;
+    for (int i = 0; i < CTL_MAX_CLIENTS; i++) {
+        if (clients[i].fd != -1) ctl_drop_client(&clients[i]);
+    }
+    close(listen_fd);
+    unlink(path);
+}
+
+#endif //PROCESSES_CTL_H
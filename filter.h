@@ -0,0 +1,221 @@
+//
+// Producer-side filtering and sampling. P1 gives each worker a compact spec
+// through the control block (see control.h). The worker evaluates it on every
+// parsed value, before stamping, pacing and sending. Dropped values never
+// cross the channel to P5 or use the pacer's budget. Terms are
+// comma-separated and all of them have to pass:
+//   >X  <X         numeric value above / below X (P2, P3)
+//   A..B           numeric value in [A, B]
+//   ^text  ~text   string starts with / contains text (P4)
+//   every=N        keep the 1st, (N+1)th ... value that passed the predicates
+//   sample=K/N     keep a random K of every N values that passed
+// "sample" keeps the uniform K-of-N subset a reservoir would. Its positions
+// are drawn when each window of N opens, so no value is held back until the
+// window closes. An empty spec or "off" sends everything.
+//
+
+#ifndef PROCESSES_FILTER_H
+#define PROCESSES_FILTER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "common.h"
+#include "record.h"
+#include "worker.h"
+
+#define FILTER_SPEC_MAX 64
+#define FILTER_TEXT_MAX 32
+#define FILTER_WINDOW_MAX 4096 // Largest N of sample=K/N
+
+typedef struct {
+    char spec[FILTER_SPEC_MAX]; // As configured, "" = send everything
+    int source;
+    int value_type;             // value_type_t of the worker's records
+
+    // --- Predicates ---
+    int has_low, has_high;
+    int low_inclusive, high_inclusive;
+    double low, high;
+    char prefix[FILTER_TEXT_MAX];   // "" = any
+    char contains[FILTER_TEXT_MAX]; // "" = any
+
+    // --- Sampling ---
+    unsigned long every;             // 0 = off
+    unsigned int sample_k, sample_n; // 0 = off
+    unsigned long long passed;       // Values that passed the predicates (every=)
+    unsigned int window_pos;         // Position in the current sample window
+    unsigned char window_keep[FILTER_WINDOW_MAX / 8];
+    unsigned long long rng;
+
+    // --- Statistics (kept across reconfigurations) ---
+    unsigned long long seen;
+    unsigned long long dropped_predicate;
+    unsigned long long dropped_sample;
+} worker_filter_t;
+
+// --- Send everything, for the records of worker 'source' ---
+void filter_init(worker_filter_t *f, int source) {
+    memset(f, 0, sizeof(*f));
+    f->source = source;
+    f->value_type = worker_value_type(source);
+    f->rng = (monotonic_ns() ^ ((unsigned long long)getpid() << 32)) | 1ULL;
+}
+
+unsigned long long filter_random(worker_filter_t *f) {
+    // xorshift64*: cheap, and good enough to pick sample positions
+    f->rng ^= f->rng >> 12;
+    f->rng ^= f->rng << 25;
+    f->rng ^= f->rng >> 27;
+    return f->rng * 0x2545F4914F6CDD1DULL;
+}
+
+int filter_parse_double(const char *text, double *out) {
+    char *end = NULL;
+    *out = strtod(text, &end);
+    return end != text && *end == '\0' ? 0 : -1;
+}
+
+// --- Parse one term into 'f', returns -1 if invalid for its value type ---
+int filter_parse_term(worker_filter_t *f, const char *term) {
+    int numeric = f->value_type != VALUE_STRING;
+    const char *dots = strstr(term, "..");
+    if (strncmp(term, "every=", 6) == 0 || strncmp(term, "sample=", 7) == 0) {
+        if (f->every != 0 || f->sample_n != 0) return -1; // One sampling term
+        char *end = NULL;
+        if (term[0] == 'e') {
+            long n = strtol(term + 6, &end, 10);
+            if (end == term + 6 || *end != '\0' || n < 1) return -1;
+            f->every = (unsigned long)n;
+            return 0;
+        }
+        long k = strtol(term + 7, &end, 10);
+        if (end == term + 7 || *end != '/') return -1;
+        const char *n_text = end + 1;
+        long n = strtol(n_text, &end, 10);
+        if (end == n_text || *end != '\0' || k < 1 || n < k || n > FILTER_WINDOW_MAX) return -1;
+        f->sample_k = (unsigned int)k;
+        f->sample_n = (unsigned int)n;
+        return 0;
+    }
+    if ((term[0] == '^' || term[0] == '~') && !numeric) {
+        char *pattern = term[0] == '^' ? f->prefix : f->contains;
+        if (term[1] == '\0' || strlen(term + 1) >= FILTER_TEXT_MAX) return -1;
+        snprintf(pattern, FILTER_TEXT_MAX, "%s", term + 1);
+        return 0;
+    }
+    if ((term[0] == '>' || term[0] == '<') && numeric) {
+        double bound;
+        if (filter_parse_double(term + 1, &bound) == -1) return -1;
+        if (term[0] == '>') {
+            f->has_low = 1;
+            f->low = bound;
+            f->low_inclusive = 0;
+        } else {
+            f->has_high = 1;
+            f->high = bound;
+            f->high_inclusive = 0;
+        }
+        return 0;
+    }
+    if (dots && numeric) {
+        char low_text[FILTER_SPEC_MAX];
+        size_t low_len = (size_t)(dots - term);
+        if (low_len >= sizeof(low_text)) return -1;
+        memcpy(low_text, term, low_len);
+        low_text[low_len] = '\0';
+        double low, high;
+        if (filter_parse_double(low_text, &low) == -1 || filter_parse_double(dots + 2, &high) == -1 || low > high) {
+            return -1;
+        }
+        f->has_low = f->has_high = 1;
+        f->low_inclusive = f->high_inclusive = 1;
+        f->low = low;
+        f->high = high;
+        return 0;
+    }
+    return -1;
+}
+
+// --- Replace the spec; on error -1 and 'f' is unchanged ---
+// Sampling starts over with the new spec, the statistics carry on.
+int filter_configure(worker_filter_t *f, const char *spec) {
+    worker_filter_t next;
+    filter_init(&next, f->source);
+    next.rng = f->rng;
+    if (spec[0] != '\0' && strcmp(spec, "off") != 0) {
+        if (strlen(spec) >= sizeof(next.spec)) return -1;
+        char terms[FILTER_SPEC_MAX];
+        snprintf(terms, sizeof(terms), "%s", spec);
+        for (char *save = NULL, *term = strtok_r(terms, ",", &save); term; term = strtok_r(NULL, ",", &save)) {
+            if (filter_parse_term(&next, term) == -1) return -1;
+        }
+        snprintf(next.spec, sizeof(next.spec), "%s", spec);
+    }
+    next.seen = f->seen;
+    next.dropped_predicate = f->dropped_predicate;
+    next.dropped_sample = f->dropped_sample;
+    *f = next;
+    return 0;
+}
+
+// --- Validate a spec for worker 'source' without applying it (P1) ---
+int filter_check(const char *spec, int source) {
+    worker_filter_t f;
+    filter_init(&f, source);
+    return filter_configure(&f, spec);
+}
+
+int filter_match(const worker_filter_t *f, const log_record_t *rec) {
+    if (f->value_type == VALUE_STRING) {
+        if (f->prefix[0] != '\0' && strncmp(rec->text, f->prefix, strlen(f->prefix)) != 0) return 0;
+        if (f->contains[0] != '\0' && strstr(rec->text, f->contains) == NULL) return 0;
+        return 1;
+    }
+    double value = rec->type == VALUE_INT ? (double)rec->value.i : rec->value.d;
+    if (f->has_low && (f->low_inclusive ? !(value >= f->low) : !(value > f->low))) return 0;
+    if (f->has_high && (f->high_inclusive ? !(value <= f->high) : !(value < f->high))) return 0;
+    return 1;
+}
+
+// --- Draw the K positions of the next sample window (Floyd's algorithm) ---
+void filter_open_window(worker_filter_t *f) {
+    memset(f->window_keep, 0, (f->sample_n + 7) / 8);
+    for (unsigned int j = f->sample_n - f->sample_k; j < f->sample_n; j++) {
+        unsigned int t = (unsigned int)(filter_random(f) % (j + 1));
+        unsigned int pick = f->window_keep[t / 8] & (1u << (t % 8)) ? j : t;
+        f->window_keep[pick / 8] |= (unsigned char)(1u << (pick % 8));
+    }
+}
+
+// --- 1 = send this parsed value, 0 = drop it ---
+int filter_accept(worker_filter_t *f, const log_record_t *rec) {
+    f->seen++;
+    if (f->spec[0] == '\0') return 1;
+    if (!filter_match(f, rec)) {
+        f->dropped_predicate++;
+        return 0;
+    }
+    int keep = 1;
+    if (f->every != 0) {
+        keep = f->passed % f->every == 0;
+    } else if (f->sample_n != 0) {
+        if (f->window_pos == 0) filter_open_window(f);
+        keep = (f->window_keep[f->window_pos / 8] >> (f->window_pos % 8)) & 1;
+        if (++f->window_pos == f->sample_n) f->window_pos = 0;
+    }
+    f->passed++;
+    if (!keep) f->dropped_sample++;
+    return keep;
+}
+
+void filter_report(const worker_filter_t *f, FILE *out, int process_num) {
+    unsigned long long dropped = f->dropped_predicate + f->dropped_sample;
+    if (f->spec[0] == '\0' && dropped == 0) return;
+    fprintf(out, "\nProcess %d: Filter '%s': %llu values, %llu dropped by predicate, %llu by sampling, %llu sent (%.1f%%)\n",
+            process_num, f->spec[0] != '\0' ? f->spec : "off", f->seen, f->dropped_predicate, f->dropped_sample, f->seen - dropped,
+            f->seen ? 100.0 * (double)(f->seen - dropped) / (double)f->seen : 0.0);
+}
+
+#endif //PROCESSES_FILTER_H
@@ -0,0 +1,262 @@
+//
+// Hitless logger upgrade. A running P5 listens on a handoff socket; a new
+// instance started with -u connects to it and receives every live channel
+// descriptor (FIFO read end, listening and connected sockets, MQ
+// descriptor) over SCM_RIGHTS, together with the channel state that is not
+// in the kernel: partial stream records and, for shm rings, only the name.
+// The old instance stops reading while the new one adopts them. Once the new
+// one acknowledges, the old one writes out its reorder buffer, reports "done"
+// and exits; the new one appends after it and keeps reading where the old one
+// stopped. If the new one fails to adopt a channel it gives everything back
+// untouched (nothing closed for the producers, nothing unlinked) and the old
+// one carries on. Producers stay connected throughout, the kernel buffers
+// hold what they send during the switch.
+//
+// Protocol (SOCK_SEQPACKET, one message each):
+//   new -> old  HANDOFF_REQUEST
+//   old -> new  handoff_state_t + descriptors
+//   new -> old  HANDOFF_ACK once every channel is adopted, else HANDOFF_NACK
+//               (or EOF); the old instance keeps its channels unless ACKed
+//   old -> new  HANDOFF_DONE once its last record is in the log
+//
+
+#ifndef PROCESSES_HANDOFF_H
+#define PROCESSES_HANDOFF_H
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "common.h"
+#include "transport.h"
+
+#define HANDOFF_SOCKET_BASE "/tmp/proc5_handoff"
+#define HANDOFF_MAGIC 0x50354846u // "P5HF"
+#define HANDOFF_MAX_CHANNELS 3
+#define HANDOFF_MAX_FDS (2 * HANDOFF_MAX_CHANNELS)
+#define HANDOFF_REQUEST 'R'
+#define HANDOFF_ACK 'A'
+#define HANDOFF_NACK 'N'
+#define HANDOFF_DONE 'D'
+#define HANDOFF_ACK_TIMEOUT_MS 5000 // Old instance: longest wait for the successor's answer
+
+typedef struct {
+    int kind;
+    int source;
+    int accepting;
+    int fd_index;        // Index into the passed descriptors, -1 = none
+    int listen_fd_index;
+    int mq_index;
+    char name[MAX_PATH_LEN];
+    unsigned int carry_len;
+    char carry[2 * MAX_MSG_SIZE];
+    int resyncing;
+} handoff_channel_t;
+
+typedef struct {
+    unsigned int magic;
+    int channel_count;
+    handoff_channel_t channels[HANDOFF_MAX_CHANNELS];
+} handoff_state_t;
+
+void handoff_socket_name(int shard, char *out, size_t size) {
+    shard_ipc_name(HANDOFF_SOCKET_BASE, shard, out, size);
+}
+
+void handoff_address(const char *name, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    snprintf(addr->sun_path, sizeof(addr->sun_path), "%s", name);
+}
+
+// --- Running P5: listen for a successor, returns the fd or -1 ---
+int handoff_listen(const char *name) {
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (fd == -1) return -1;
+    handoff_address(name, &addr);
+    unlink(name); // A previous instance handed over or crashed
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, 1) == -1 ||
+        transport_set_non_blocking(fd) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// --- Running P5: hand every channel to the successor on 'conn' ---
+// The channels stay ours and must not be read until handoff_await_ack().
+int handoff_send_channels(int conn, transport_t *channels, int count) {
+    handoff_state_t state;
+    int fds[HANDOFF_MAX_FDS];
+    int fd_count = 0;
+    memset(&state, 0, sizeof(state));
+    state.magic = HANDOFF_MAGIC;
+    state.channel_count = count;
+    for (int i = 0; i < count && i < HANDOFF_MAX_CHANNELS; i++) {
+        const transport_t *t = &channels[i];
+        handoff_channel_t *c = &state.channels[i];
+        c->kind = t->kind;
+        c->source = t->source;
+        c->accepting = t->accepting;
+        c->fd_index = c->listen_fd_index = c->mq_index = -1;
+        snprintf(c->name, sizeof(c->name), "%s", t->name);
+        c->carry_len = (unsigned int)t->carry_len;
+        memcpy(c->carry, t->carry, t->carry_len);
+        c->resyncing = t->resyncing;
+        if (t->fd != -1) { c->fd_index = fd_count; fds[fd_count++] = t->fd; }
+        if (t->listen_fd != -1) { c->listen_fd_index = fd_count; fds[fd_count++] = t->listen_fd; }
+        if (t->mq != (mqd_t)-1) { c->mq_index = fd_count; fds[fd_count++] = (int)t->mq; } // An fd on Linux
+    }
+
+    struct iovec iov = {&state, sizeof(state)};
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (fd_count > 0) {
+        msg.msg_control = control.buf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * (size_t)fd_count);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * (size_t)fd_count);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * (size_t)fd_count);
+    }
+    return sendmsg(conn, &msg, 0) == (ssize_t)sizeof(state) ? 0 : -1;
+}
+
+// --- Running P5: wait for the successor to adopt the channels ---
+// On HANDOFF_ACK the channels are detached (nothing closed for the producers,
+// nothing unlinked) and 0 is returned. On a NACK, EOF or timeout they stay
+// ours and -1 is returned: the successor gave its copies back.
+int handoff_await_ack(int conn, transport_t *channels, int count) {
+    struct timeval timeout = {HANDOFF_ACK_TIMEOUT_MS / 1000, (HANDOFF_ACK_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    char reply = 0;
+    ssize_t n;
+    do {
+        n = read(conn, &reply, 1);
+    } while (n == -1 && errno == EINTR);
+    if (n != 1 || reply != HANDOFF_ACK) {
+        errno = n == -1 ? errno : ECANCELED;
+        return -1;
+    }
+    for (int i = 0; i < count; i++) transport_detach(&channels[i]);
+    return 0;
+}
+
+// --- New P5: give back channels that could not all be adopted ---
+// Only the received copies are closed; the channels are reset as client ends,
+// so a later transport_close() unlinks none of the old instance's names.
+void handoff_abandon(int conn, transport_t *channels, int count, const int *fds, int fd_count) {
+    int err = errno;
+    for (int i = 0; i < count; i++) {
+        transport_t *t = &channels[i];
+        char name[MAX_PATH_LEN];
+        snprintf(name, sizeof(name), "%s", t->name);
+        if (t->ring) munmap(t->ring, sizeof(transport_shm_ring_t));
+        transport_reset(t, t->kind, t->source, name, 0);
+    }
+    for (int i = 0; i < fd_count; i++) close(fds[i]);
+    char nack = HANDOFF_NACK;
+    if (write(conn, &nack, 1) != 1) perror("\nProcess 5: Failed to decline the handoff\n"); // EOF does the same
+    close(conn);
+    errno = err;
+}
+
+// --- New P5: take over the channels of the running instance ---
+// Returns the connection to wait for HANDOFF_DONE on, -1 if there is no
+// running instance or the handoff failed (errno set). On failure 'channels'
+// hold no descriptors and the running instance keeps serving them.
+int handoff_receive_channels(const char *name, transport_t *channels, int count) {
+    struct sockaddr_un addr;
+    int conn = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (conn == -1) return -1;
+    handoff_address(name, &addr);
+    char request = HANDOFF_REQUEST;
+    if (connect(conn, (struct sockaddr *)&addr, sizeof(addr)) == -1 || write(conn, &request, 1) != 1) {
+        close(conn);
+        return -1;
+    }
+
+    handoff_state_t state;
+    struct iovec iov = {&state, sizeof(state)};
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    ssize_t n = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+
+    int fds[HANDOFF_MAX_FDS];
+    int fd_count = 0;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+        fd_count = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        if (fd_count > HANDOFF_MAX_FDS) fd_count = HANDOFF_MAX_FDS;
+        memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * (size_t)fd_count);
+    }
+    if (n != (ssize_t)sizeof(state) || state.magic != HANDOFF_MAGIC || state.channel_count != count ||
+        (msg.msg_flags & MSG_CTRUNC)) {
+        for (int i = 0; i < fd_count; i++) close(fds[i]);
+        close(conn);
+        errno = EPROTO;
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        handoff_channel_t *c = &state.channels[i];
+        transport_t *t = &channels[i];
+        transport_reset(t, (transport_kind_t)c->kind, c->source, c->name, 1);
+        t->accepting = c->accepting;
+        if (c->fd_index >= 0 && c->fd_index < fd_count) t->fd = fds[c->fd_index];
+        if (c->listen_fd_index >= 0 && c->listen_fd_index < fd_count) t->listen_fd = fds[c->listen_fd_index];
+        if (c->mq_index >= 0 && c->mq_index < fd_count) t->mq = (mqd_t)fds[c->mq_index];
+        if (c->carry_len <= sizeof(t->carry)) {
+            memcpy(t->carry, c->carry, c->carry_len);
+            t->carry_len = c->carry_len;
+        }
+        t->resyncing = c->resyncing;
+        if (t->kind == TRANSPORT_SHM) {
+            t->ring = transport_map_ring(t->name, 0); // Picks up at the tail the old reader left
+            if (t->ring == NULL) {
+                handoff_abandon(conn, channels, i + 1, fds, fd_count);
+                return -1;
+            }
+        }
+    }
+    char ack = HANDOFF_ACK;
+    if (write(conn, &ack, 1) != 1) {
+        handoff_abandon(conn, channels, count, fds, fd_count);
+        return -1;
+    }
+    return conn;
+}
+
+// --- New P5: wait until the old instance has written its last record ---
+// Returns 1 if it reported done, 0 if it went away without (log may be torn).
+int handoff_wait_done(int conn) {
+    char reply = 0;
+    ssize_t n;
+    do {
+        n = read(conn, &reply, 1);
+    } while (n == -1 && errno == EINTR);
+    close(conn);
+    return n == 1 && reply == HANDOFF_DONE;
+}
+
+#endif //PROCESSES_HANDOFF_H
@@ -0,0 +1,244 @@
+//
+// Record sink of the logger (P5): decoded records go through the reorder
+// buffer, the optional windowed aggregation and into the text log or WAL, or
+// into a routed output sink of their own (-o, see sink.h). Sampled records
+// complete their trace span when they are written (see trace.h).
+// Shared by process5 (records arrive over IPC channels) and the in-process
+// pipeline (records arrive over in-memory queues), so both log identically.
+//
+
+#ifndef PROCESSES_LOGGER_H
+#define PROCESSES_LOGGER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "common.h"
+#include "record.h"
+#include "reorder.h"
+#include "wal.h"
+#include "aggregate.h"
+#include "sink.h"
+#include "trace.h"
+
+FILE *log_fp = NULL;
+int log_format_wal = 0; // 0 = text lines, 1 = checksummed WAL (-f wal)
+int logger_echo = 1;    // Echo every record to the console (P5 under the menu)
+int logger_skip_recovery = 0; // The log was handed over by an instance that closed it cleanly
+int logger_sink_shard = -1;   // >= 0: the log is a shard segment, sinks get ".shardN" too
+
+// Windowed aggregation of the numeric sources (-a <spec>, see aggregate.h)
+int aggregation_enabled = 0;
+aggregator_t aggregator;
+
+// Reorder buffer (records are logged in producer timestamp order)
+reorder_buffer_t reorder;
+long reorder_window_ms = REORDER_DEFAULT_WINDOW_MS;
+long reorder_max_records = REORDER_DEFAULT_MAX_RECORDS;
+unsigned long long records_received = 0;
+
+// --- Handle one of the logger options (-w, -n, -f, -a, -o) ---
+// Returns 1 if 'opt' was a logger option, 0 otherwise; exits on a bad value.
+int logger_parse_option(int opt, const char *arg) {
+    switch (opt) {
+        case 'a': // Windowed aggregation of P2/P3 values, e.g. "1000" or "10000/1000,raw=100"
+            if (aggregator_init(&aggregator, arg) == -1) {
+                fprintf(stderr, "\nInvalid aggregation spec '%s' (e.g. 1000, 10000/1000, 1000,raw=100).\n", arg);
+                exit(EXIT_FAILURE);
+            }
+            aggregation_enabled = 1;
+            return 1;
+        case 'f': // Log format: "text" (default) or "wal"
+            if (strcmp(arg, "wal") == 0) {
+                log_format_wal = 1;
+            } else if (strcmp(arg, "text") != 0) {
+                fprintf(stderr, "\nUnknown log format '%s' (use text or wal).\n", arg);
+                exit(EXIT_FAILURE);
+            }
+            return 1;
+        case 'o': // Routing table to separate output sinks, e.g. "4~ERROR=errors.log;2+3=numbers.wal,wal"
+            if (sinks_parse(arg) == -1) {
+                fprintf(stderr, "\nInvalid route spec '%s' (e.g. 4~ERROR=errors.log;2+3>100=big.wal,wal,rotate=64M,keep=5).\n", arg);
+                exit(EXIT_FAILURE);
+            }
+            return 1;
+        case 'w': // Reorder window in milliseconds (0 = no waiting)
+            reorder_window_ms = strtol(arg, NULL, 10);
+            return 1;
+        case 'n': // Max records held in the reorder buffer
+            reorder_max_records = strtol(arg, NULL, 10);
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// --- Append a window summary produced by the aggregator ---
+void write_summary_record(int wal_source, record_stamp_t stamp, const char *text) {
+    if (!log_fp) return;
+    if (!log_format_wal) {
+        fprintf(log_fp, RECORD_STAMP_FMT "%s\n", stamp.ts_ns, stamp.seq, text);
+    } else if (wal_append(log_fp, wal_source, stamp, VALUE_LINE, text, strlen(text)) == -1) {
+        perror("\nProcess 5: Failed to append WAL record\n");
+    }
+}
+
+// --- Append one record to the log in the configured format ---
+// Values are rendered to text here, once, and only for the text log: the WAL
+// keeps them in binary.
+void write_log_record(const reorder_entry_t *entry) {
+    if (!log_fp) return;
+    const log_record_t *rec = &entry->record;
+
+    if (aggregation_enabled && aggregator_handles(&aggregator, rec->source)) {
+        // Numeric sources are summarised, the raw value is kept only when sampled
+        int numeric = 1;
+        double value = 0.0;
+        if (rec->type == VALUE_INT) {
+            value = (double)rec->value.i;
+        } else if (rec->type == VALUE_DOUBLE) {
+            value = rec->value.d;
+        } else {
+            char *value_end = NULL;
+            value = strtod(rec->text, &value_end);
+            numeric = value_end != rec->text;
+        }
+        if (numeric && !aggregator_add(&aggregator, rec->source, rec->stamp.ts_ns, value, write_summary_record)) {
+            return;
+        }
+    }
+
+    // Routed records go to their own sink and writer thread
+    if (sink_count > 0) {
+        int sink = sink_route(rec);
+        if (sink >= 0) {
+            sink_write_record(sink, rec);
+            return;
+        }
+    }
+
+    if (!log_format_wal) {
+        char line[MAX_MSG_SIZE + 64];
+        int len = render_record_line(rec, line, sizeof(line) - 1);
+        if (len < 0) return;
+        if ((size_t)len > sizeof(line) - 2) len = (int)sizeof(line) - 2;
+        line[len++] = '\n';
+        fwrite(line, 1, (size_t)len, log_fp);
+        return;
+    }
+    if (wal_append_record(log_fp, rec) == -1) {
+        perror("\nProcess 5: Failed to append WAL record\n");
+    }
+}
+
+// --- Release buffered records to the log ---
+// Releases every record whose reorder window has expired, or all of them when
+// 'force_all' is set (shutdown).
+void flush_reorder(int force_all) {
+    unsigned long long now = monotonic_ns();
+    reorder_entry_t entry;
+    int written = 0;
+    while (reorder.count > 0 && (force_all || reorder_ready(&reorder, now))) {
+        reorder_pop(&reorder, now, &entry);
+        write_log_record(&entry);
+        if (entry.record.traced) trace_record(&entry.record, monotonic_ns());
+        written++;
+    }
+    if (aggregation_enabled) {
+        // Windows older than the reorder window can no longer receive records
+        if (force_all) aggregator_finish(&aggregator, write_summary_record);
+        else aggregator_tick(&aggregator, now - reorder.window_ns, write_summary_record);
+        written++; // Summaries may have been appended
+    }
+    // WAL output is fully buffered: commit everything released in this pass with one write
+    if (written > 0 && log_format_wal && log_fp) fflush(log_fp);
+    if (sinks_dirty) sinks_commit();
+}
+
+// --- Hand one decoded record to the reorder buffer ---
+void ingest_record(const log_record_t *rec) {
+    records_received++;
+    unsigned long long now = monotonic_ns();
+    if (logger_echo) {
+        char line[MAX_MSG_SIZE + 64];
+        render_record_line(rec, line, sizeof(line));
+        printf("\nProcess 5: Received from P%d: %s\n", rec->source, line);
+        display_menu(); // Log to console too
+        fflush(stdout);
+    }
+    if (reorder_full(&reorder)) {
+        // Count bound reached, release the oldest record early
+        reorder_entry_t entry;
+        reorder.forced++;
+        reorder_pop(&reorder, now, &entry);
+        write_log_record(&entry);
+        if (entry.record.traced) trace_record(&entry.record, monotonic_ns());
+    }
+    reorder_push(&reorder, rec, now);
+}
+
+// --- Allocate the reorder buffer, recover a WAL and open the log for appending ---
+// Returns -1 (after printing why) on failure.
+int logger_start(const char *log_filename) {
+    if (reorder_window_ms < 0 || reorder_max_records < 1) {
+        fprintf(stderr, "\nInvalid settings (reorder window >= 0 ms, max records >= 1).\n");
+        return -1;
+    }
+    if (reorder_init(&reorder, (int)reorder_max_records, (unsigned long long)reorder_window_ms * 1000000ULL) == -1) {
+        perror("\nProcess 5: Failed to allocate reorder buffer\n");
+        return -1;
+    }
+
+    // WAL: validate what is on disk and cut off a torn tail before appending
+    if (log_format_wal && !logger_skip_recovery) {
+        wal_recovery_t recovery;
+        if (wal_recover(log_filename, &recovery) == -1) {
+            perror("\nProcess 5: WAL recovery failed (existing file is not a WAL?)\n");
+            return -1;
+        }
+        wal_report_recovery(&recovery, stdout);
+        fflush(stdout);
+    }
+
+    // Open log file in append mode
+    log_fp = fopen(log_filename, log_format_wal ? "ab" : "a");
+    if (!log_fp) {
+        perror("\nProcess 5: Failed to open log file\n");
+        return -1;
+    }
+    if (log_format_wal) {
+        if (setvbuf(log_fp, NULL, _IOFBF, 1 << 16) != 0) {
+            perror("\nProcess 5: Failed to set WAL buffering\n");
+        }
+    } else if (setvbuf(log_fp, NULL, _IOLBF, 0) != 0) {
+        perror("\nProcess 5: Failed to set line buffering\n");
+        // Not fatal, the log is still written (just buffered differently)
+    }
+    if (sink_count > 0 && sinks_start(logger_sink_shard, log_format_wal, logger_skip_recovery) == -1) return -1;
+    return 0;
+}
+
+// --- Write out everything still held, print the reports and close the log ---
+void logger_finish() {
+    if (reorder.slots) {
+        // Emit whatever is still held, then report the latency cost of reordering
+        flush_reorder(1);
+        reorder_report(&reorder, stdout);
+        reorder_free(&reorder);
+    }
+    if (aggregation_enabled) {
+        aggregator_report(&aggregator, stdout);
+        aggregator_free(&aggregator);
+        aggregation_enabled = 0;
+    }
+    sinks_finish(stdout); // Writers finish what they hold first
+
+    if (log_fp) {
+        fflush(log_fp); // Ensure all data is written
+        fclose(log_fp);
+        log_fp = NULL;
+    }
+}
+
+#endif //PROCESSES_LOGGER_H
@@ -0,0 +1,159 @@
+#define _POSIX_C_SOURCE 200809L // For getline
+#include "common.h"
+#include "record.h"
+
+// logmerge: streaming k-way merge of P5 shard segments into one log ordered by
+// the producer stamp (timestamp, then sequence number). Only one pending line
+// per segment is kept in memory and a binary min-heap picks the next line to
+// emit, so the output is globally ordered only if every segment is itself
+// sorted by stamp. A shard can serve several producers; P5's reorder buffer
+// sorts their records, but only within its window (-w) and buffer size (-n).
+// A stamp that goes backwards inside a segment breaks that precondition: it is
+// reported and logmerge exits with status 1 (the merged output is still written).
+
+typedef struct {
+    FILE *fp;
+    const char *name;
+    char *line;          // Current pending line (owned, from getline)
+    size_t line_cap;
+    record_stamp_t stamp; // Stamp of the pending line
+    int index;           // Segment position on the command line (tie-breaker)
+    int stamped;         // A stamp was seen, 'stamp' is valid
+    unsigned long long line_no;
+    unsigned long long backwards; // Lines whose stamp is older than the one before
+} segment_t;
+
+segment_t *segments = NULL;
+int *heap = NULL; // Indices into segments[]
+int heap_size = 0;
+
+// --- Heap ordering: (ts, seq, segment index) ---
+int segment_less(int a, int b) {
+    int cmp = compare_record_stamp(&segments[a].stamp, &segments[b].stamp);
+    if (cmp != 0) return cmp < 0;
+    return segments[a].index < segments[b].index;
+}
+
+void heap_sift_down(int pos) {
+    while (1) {
+        int left = 2 * pos + 1, right = left + 1, smallest = pos;
+        if (left < heap_size && segment_less(heap[left], heap[smallest])) smallest = left;
+        if (right < heap_size && segment_less(heap[right], heap[smallest])) smallest = right;
+        if (smallest == pos) return;
+        int tmp = heap[pos]; heap[pos] = heap[smallest]; heap[smallest] = tmp;
+        pos = smallest;
+    }
+}
+
+void heap_sift_up(int pos) {
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+        if (!segment_less(heap[pos], heap[parent])) return;
+        int tmp = heap[pos]; heap[pos] = heap[parent]; heap[parent] = tmp;
+        pos = parent;
+    }
+}
+
+// --- Read the next line of a segment, returns 0 on EOF ---
+// Unstamped lines (written before stamping existed) inherit the previous
+// stamp of their segment so they stay next to their neighbours.
+int segment_advance(segment_t *seg) {
+    ssize_t len = getline(&seg->line, &seg->line_cap, seg->fp);
+    if (len == -1) {
+        if (ferror(seg->fp)) {
+            fprintf(stderr, "logmerge: read error on %s: %s\n", seg->name, strerror(errno));
+        }
+        return 0;
+    }
+    seg->line_no++;
+    record_stamp_t stamp;
+    if (parse_record_stamp(seg->line, &stamp, NULL)) {
+        if (seg->stamped && compare_record_stamp(&stamp, &seg->stamp) < 0) {
+            if (seg->backwards++ == 0) {
+                fprintf(stderr, "logmerge: %s is not sorted by stamp (line %llu goes back in time), "
+                                "the merge is out of order there.\n", seg->name, seg->line_no);
+            }
+        }
+        seg->stamp = stamp;
+        seg->stamped = 1;
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <output_file|-> <segment> [segment...]\n", argv[0]);
+        fprintf(stderr, "Example: %s merged.log activity.log.shard0 activity.log.shard1\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    FILE *out = stdout;
+    if (strcmp(argv[1], "-") != 0) {
+        out = fopen(argv[1], "w");
+        if (!out) {
+            perror("logmerge: Failed to open output file");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    int segment_count = argc - 2;
+    segments = calloc((size_t)segment_count, sizeof(segment_t));
+    heap = calloc((size_t)segment_count, sizeof(int));
+    if (!segments || !heap) {
+        perror("logmerge: Failed to allocate merge state");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < segment_count; i++) {
+        segment_t *seg = &segments[i];
+        seg->name = argv[i + 2];
+        seg->index = i;
+        seg->fp = fopen(seg->name, "r");
+        if (!seg->fp) {
+            fprintf(stderr, "logmerge: Skipping %s: %s\n", seg->name, strerror(errno));
+            continue;
+        }
+        // Large stdio buffers keep the merge streaming at disk bandwidth
+        setvbuf(seg->fp, NULL, _IOFBF, 1 << 20);
+        if (segment_advance(seg)) {
+            heap[heap_size++] = i;
+            heap_sift_up(heap_size - 1);
+        }
+    }
+    setvbuf(out, NULL, _IOFBF, 1 << 20);
+
+    unsigned long long merged = 0;
+    while (heap_size > 0) {
+        segment_t *seg = &segments[heap[0]];
+        fputs(seg->line, out);
+        size_t len = strlen(seg->line);
+        if (len == 0 || seg->line[len - 1] != '\n') fputc('\n', out); // Torn last line of a segment
+        merged++;
+
+        if (segment_advance(seg)) {
+            heap_sift_down(0);
+        } else {
+            heap[0] = heap[--heap_size];
+            heap_sift_down(0);
+        }
+    }
+
+    fprintf(stderr, "logmerge: Merged %llu records from %d segments.\n", merged, segment_count);
+    int unsorted = 0;
+    for (int i = 0; i < segment_count; i++) {
+        if (segments[i].backwards == 0) continue;
+        fprintf(stderr, "logmerge: %s: %llu lines out of stamp order (raise P5's reorder window -w / -n).\n",
+                argv[i + 2], segments[i].backwards);
+        unsorted = 1;
+    }
+
+    fflush(out);
+    if (out != stdout) fclose(out);
+    for (int i = 0; i < segment_count; i++) {
+        if (segments[i].fp) fclose(segments[i].fp);
+        free(segments[i].line);
+    }
+    free(segments);
+    free(heap);
+    return unsorted;
+}
@@ -0,0 +1,259 @@
+#define _POSIX_C_SOURCE 200809L // For getline, clock_nanosleep, sigaction
+#include "common.h"
+#include <signal.h>
+#include "record.h"
+#include "wal.h"
+#include "worker.h"
+#include "transport.h"
+
+// logreplay: feed a log written by P5 (text or WAL) back into the channels
+// of a running logger, as if P2, P3 and P4 were sending it again. Records
+// keep their source and value and get a fresh stamp; the gaps between the
+// original stamps are replayed at the original pace, N times faster, or
+// dropped ("max"). Sends that block show the target's backpressure and are
+// reported with the achieved throughput.
+//
+// Socket endpoints take one producer at a time, so replay into a logger whose
+// workers are stopped (or run P5 alone).
+
+#define REPLAY_BATCH 32               // Records per send once the replay is behind
+#define REPLAY_STALL_NS 1000000ULL    // A send blocked this long counts as a stall
+
+volatile sig_atomic_t terminate_flag = 0;
+
+typedef struct {
+    int used;                   // Source seen in the log, channel connected
+    transport_t channel;
+    log_record_t batch[REPLAY_BATCH];
+    int pending;
+    unsigned long long send_seq;
+
+    // --- Statistics ---
+    unsigned long long sent;
+    unsigned long long stalls;      // Sends blocked >= REPLAY_STALL_NS
+    unsigned long long blocked_ns;  // Time spent inside sends
+    unsigned long long max_send_ns;
+} replay_channel_t;
+
+replay_channel_t replay_channels[TRANSPORT_MAX_SOURCE + 1];
+transport_kind_t channel_kinds[TRANSPORT_MAX_SOURCE + 1];
+int shard_count = 1;
+
+// Input: a text log read line by line, or a mapped WAL
+FILE *log_in = NULL;
+char *line = NULL;
+size_t line_cap = 0;
+unsigned char *wal_base = NULL;
+size_t wal_size = 0;
+size_t wal_offset = WAL_MAGIC_LEN;
+unsigned long long skipped = 0; // Summaries, unstamped and unparsable lines
+
+void sigterm_handler(int signum) {
+    (void)signum; // Explicitly mark signum as unused
+    terminate_flag = 1;
+}
+
+// --- Next replayable record of the input, returns 0 at the end ---
+// Only values of P2, P3 and P4 are replayed; window summaries are what the
+// target's own aggregator produces.
+int replay_next(log_record_t *rec) {
+    while (1) {
+        if (wal_base) {
+            wal_header_t hdr;
+            const char *payload;
+            int rc = wal_next(wal_base, wal_size, &wal_offset, &hdr, &payload);
+            if (rc != 1) {
+                if (rc == -1) fprintf(stderr, "logreplay: Torn or corrupt WAL record at offset %zu, stopping there.\n", wal_offset);
+                return 0;
+            }
+            wal_to_record(&hdr, payload, rec);
+            if (rec->source >= 2 && rec->source <= TRANSPORT_MAX_SOURCE && rec->type != VALUE_LINE) return 1;
+        } else {
+            ssize_t len = getline(&line, &line_cap, log_in);
+            if (len == -1) return 0;
+            line[strcspn(line, "\n")] = '\0';
+            const char *rest;
+            int source = 0, consumed = 0;
+            if (parse_record_stamp(line, &rec->stamp, &rest) &&
+                sscanf(rest, "%d: %n", &source, &consumed) == 1 && consumed > 0 &&
+                source >= 2 && source <= TRANSPORT_MAX_SOURCE &&
+                worker_parse_value(source, rest + consumed, rec) == 1) {
+                return 1;
+            }
+        }
+        skipped++;
+    }
+}
+
+// --- Send the records a channel has collected ---
+int replay_flush(replay_channel_t *rc) {
+    if (rc->pending == 0) return 0;
+    unsigned long long start = monotonic_ns();
+    if (transport_send_batch(&rc->channel, rc->batch, rc->pending, NULL) == -1) return -1;
+    unsigned long long took = monotonic_ns() - start;
+    rc->blocked_ns += took;
+    if (took >= REPLAY_STALL_NS) rc->stalls++;
+    if (took > rc->max_send_ns) rc->max_send_ns = took;
+    rc->sent += (unsigned long long)rc->pending;
+    rc->pending = 0;
+    return 0;
+}
+
+int replay_flush_all() {
+    for (int source = 2; source <= TRANSPORT_MAX_SOURCE; source++) {
+        if (replay_channels[source].used && replay_flush(&replay_channels[source]) == -1) return -1;
+    }
+    return 0;
+}
+
+// --- Connect to the endpoint of 'source' the first time the log uses it ---
+int replay_connect(int source) {
+    replay_channel_t *rc = &replay_channels[source];
+    char name[MAX_PATH_LEN];
+    transport_endpoint_name(channel_kinds[source], source, route_shard(source, shard_count), name, sizeof(name));
+    if (transport_connect(&rc->channel, channel_kinds[source], source, name, &terminate_flag) == -1) {
+        fprintf(stderr, "logreplay: Failed to connect to %s %s: %s\n",
+                transport_kind_names[channel_kinds[source]], name, strerror(errno));
+        return -1;
+    }
+    rc->used = 1;
+    return 0;
+}
+
+// --- Wait for an absolute CLOCK_MONOTONIC deadline ---
+void replay_sleep_until(unsigned long long deadline) {
+    struct timespec ts = {(time_t)(deadline / 1000000000ULL), (long)(deadline % 1000000000ULL)};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR && !terminate_flag);
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    double speed = 1.0; // 0 = as fast as the target accepts
+    transport_parse_map(NULL, channel_kinds); // Historical pairing unless -t says otherwise
+    while ((opt = getopt(argc, argv, "x:t:n:")) != -1) {
+        switch (opt) {
+            case 'x': // Speed: 1 = original pace, 10 = ten times faster, max = no gaps
+                speed = strcmp(optarg, "max") == 0 ? 0.0 : strtod(optarg, NULL);
+                if (speed <= 0.0 && strcmp(optarg, "max") != 0) {
+                    fprintf(stderr, "logreplay: Invalid speed '%s' (e.g. 1, 2.5, max).\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 't': // Channel kind per producer, as given to process5
+                if (transport_parse_map(optarg, channel_kinds) == -1) {
+                    fprintf(stderr, "logreplay: Invalid transport spec '%s' (e.g. 2=mq,3=shm,4=seqpacket).\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'n': // Logger shards of the target, records go where P1 routes each worker
+                shard_count = atoi(optarg);
+                if (shard_count < 1 || shard_count > MAX_LOGGER_SHARDS) {
+                    fprintf(stderr, "logreplay: Invalid shard count '%s' (1-%d).\n", optarg, MAX_LOGGER_SHARDS);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            default:
+                fprintf(stderr, "logreplay: Unknown option.\n");
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (argc - optind != 1) {
+        fprintf(stderr, "Usage: %s [-x speed|max] [-t transport_spec] [-n logger_shards] <log_file|wal_file|->\n", argv[0]);
+        fprintf(stderr, "Example: %s -x 10 -t 3=shm activity.log\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    // --- Open the input: a WAL is recognised by its magic ---
+    const char *path = argv[optind];
+    log_in = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!log_in) {
+        perror("logreplay: Failed to open log");
+        exit(EXIT_FAILURE);
+    }
+    setvbuf(log_in, NULL, _IOFBF, 1 << 20); // Before the first read
+    struct stat st;
+    char magic[WAL_MAGIC_LEN];
+    if (log_in != stdin && fstat(fileno(log_in), &st) == 0 && (size_t)st.st_size >= WAL_MAGIC_LEN &&
+        fread(magic, 1, WAL_MAGIC_LEN, log_in) == WAL_MAGIC_LEN && memcmp(magic, WAL_MAGIC, WAL_MAGIC_LEN) == 0) {
+        wal_size = (size_t)st.st_size;
+        wal_base = mmap(NULL, wal_size, PROT_READ, MAP_PRIVATE, fileno(log_in), 0);
+        if (wal_base == MAP_FAILED) {
+            perror("logreplay: mmap failed");
+            exit(EXIT_FAILURE);
+        }
+        posix_madvise(wal_base, wal_size, POSIX_MADV_SEQUENTIAL);
+    } else if (log_in != stdin) {
+        rewind(log_in);
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = sigterm_handler;
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+    signal(SIGPIPE, SIG_IGN); // A logger that goes away shows up as EPIPE
+
+    // --- Replay: record i is due at start + (ts_i - ts_0) / speed ---
+    log_record_t rec;
+    unsigned long long first_ts = 0, start = 0, end = 0, max_lag_ns = 0, replayed = 0;
+    int failed = 0; // 1 = could not connect, 2 = a send failed
+    while (!terminate_flag && replay_next(&rec)) {
+        if (!replay_channels[rec.source].used && replay_connect(rec.source) == -1) {
+            failed = 1;
+            break;
+        }
+        unsigned long long now = monotonic_ns();
+        if (start == 0) {
+            start = now;
+            first_ts = rec.stamp.ts_ns;
+        }
+        if (speed > 0.0) {
+            unsigned long long offset = rec.stamp.ts_ns > first_ts ? rec.stamp.ts_ns - first_ts : 0;
+            unsigned long long due = start + (unsigned long long)((double)offset / speed);
+            if (due > now) {
+                // Not due yet: what is collected goes out now, then wait
+                if (replay_flush_all() == -1) {
+                    failed = 2;
+                    break;
+                }
+                replay_sleep_until(due);
+            } else if (now - due > max_lag_ns) {
+                max_lag_ns = now - due;
+            }
+        }
+
+        replay_channel_t *rc = &replay_channels[rec.source];
+        worker_stamp(&rec, &rc->send_seq); // Fresh stamp: the target orders by its own clock
+        rc->batch[rc->pending++] = rec;
+        replayed++;
+        if (rc->pending == REPLAY_BATCH && replay_flush(rc) == -1) {
+            failed = 2;
+            break;
+        }
+    }
+    if (!failed && replay_flush_all() == -1) failed = 2;
+    if (failed == 2) perror("logreplay: Send failed, stopping the replay");
+    end = monotonic_ns();
+
+    // --- Report ---
+    double elapsed = start ? (double)(end - start) / 1e9 : 0.0;
+    unsigned long long sent = 0;
+    for (int source = 2; source <= TRANSPORT_MAX_SOURCE; source++) {
+        replay_channel_t *rc = &replay_channels[source];
+        if (!rc->used) continue;
+        sent += rc->sent;
+        fprintf(stderr, "logreplay: P%d sent %llu records, %llu stalls (max send %.3f ms, %.3f ms blocked in total)",
+                source, rc->sent, rc->stalls, (double)rc->max_send_ns / 1e6, (double)rc->blocked_ns / 1e6);
+        transport_report(&rc->channel, stderr, source);
+        transport_close(&rc->channel);
+    }
+    fprintf(stderr, "logreplay: %llu of %llu records sent in %.3f s (%.0f records/s)",
+            sent, replayed, elapsed, elapsed > 0 ? (double)sent / elapsed : 0.0);
+    if (speed > 0.0) fprintf(stderr, " at %gx, fell behind the schedule by up to %.3f ms", speed, (double)max_lag_ns / 1e6);
+    fprintf(stderr, ", %llu lines skipped.\n", skipped);
+
+    if (wal_base) munmap(wal_base, wal_size);
+    if (log_in != stdin) fclose(log_in);
+    free(line);
+    return failed ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,94 @@
+//
+// Number formatting for the logger's text output and the offline readers.
+// Integers are rendered two digits at a time from a lookup table. Doubles are
+// rendered with the shortest digit string that reads back to the same double
+// (round-trip exact), instead of "%lf" which rounds to six decimals.
+//
+
+#ifndef PROCESSES_NUMFMT_H
+#define PROCESSES_NUMFMT_H
+
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+const char fmt_digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// --- Unsigned integer to decimal, returns length (no terminator written) ---
+int fmt_u64_raw(char *out, uint64_t value) {
+    char tmp[20];
+    int pos = 20;
+    while (value >= 100) {
+        unsigned int pair = (unsigned int)(value % 100) * 2;
+        value /= 100;
+        tmp[--pos] = fmt_digit_pairs[pair + 1];
+        tmp[--pos] = fmt_digit_pairs[pair];
+    }
+    if (value >= 10) {
+        unsigned int pair = (unsigned int)value * 2;
+        tmp[--pos] = fmt_digit_pairs[pair + 1];
+        tmp[--pos] = fmt_digit_pairs[pair];
+    } else {
+        tmp[--pos] = (char)('0' + value);
+    }
+    memcpy(out, tmp + pos, (size_t)(20 - pos));
+    return 20 - pos;
+}
+
+// --- Signed integer to decimal, NUL-terminated, 'out' needs 21 bytes ---
+int fmt_i64(char *out, int64_t value) {
+    int len = 0;
+    uint64_t magnitude = (uint64_t)value;
+    if (value < 0) {
+        out[len++] = '-';
+        magnitude = 0 - magnitude;
+    }
+    len += fmt_u64_raw(out + len, magnitude);
+    out[len] = '\0';
+    return len;
+}
+
+// --- Shortest round-trip decimal for a double, NUL-terminated, 'out' needs 32 bytes ---
+// Integral values below 2^53 go through the integer table ("42.0"). Otherwise
+// the digit count is searched upwards and the first that reads back is kept.
+// A normal double whose shortest form has at most 15 significant digits is
+// reproduced exactly by "%.15g", so the search starts at DBL_DIG and tries at
+// most three candidates. Subnormals carry fewer digits ("5e-324") and start at
+// one. An integral result without exponent gets ".0" like the table path.
+int fmt_double(char *out, double value) {
+    if (isnan(value)) return snprintf(out, 32, "nan");
+    if (isinf(value)) return snprintf(out, 32, value < 0 ? "-inf" : "inf");
+    if (value == 0.0) return snprintf(out, 32, signbit(value) ? "-0.0" : "0.0");
+
+    if (value == floor(value) && fabs(value) < 9007199254740992.0) {
+        int len = fmt_i64(out, (int64_t)value);
+        memcpy(out + len, ".0", 3);
+        return len + 2;
+    }
+
+    int len = 0;
+    for (int precision = fabs(value) < DBL_MIN ? 1 : DBL_DIG; precision <= 17; precision++) {
+        len = snprintf(out, 32, "%.*g", precision, value);
+        if (precision == 17 || strtod(out, NULL) == value) break;
+    }
+    if (strpbrk(out, ".e") == NULL) {
+        memcpy(out + len, ".0", 3);
+        len += 2;
+    }
+    return len;
+}
+
+#endif //PROCESSES_NUMFMT_H
@@ -0,0 +1,79 @@
+#define _POSIX_C_SOURCE 200809L
+#include "common.h"
+#include "ctl.h"
+
+// p1ctl: send commands to the control socket of a running P1 (-c) and print
+// its JSON replies, one line each. The command is taken from the arguments
+// ("p1ctl start 2"), or one per line from stdin when there are none. Exits
+// with 1 if any command failed, 2 if P1 could not be reached.
+
+int main(int argc, char *argv[]) {
+    const char *path = CTL_SOCKET_DEFAULT;
+    int opt;
+    while ((opt = getopt(argc, argv, "c:")) != -1) {
+        if (opt == 'c') path = optarg;
+        else {
+            fprintf(stderr, "Usage: %s [-c control_socket] [command [args...]]\n", argv[0]);
+            fprintf(stderr, "Example: %s rate all 2000msg/s\n", argv[0]);
+            exit(2);
+        }
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        fprintf(stderr, "p1ctl: Cannot connect to %s: %s\n", path, strerror(errno));
+        exit(2);
+    }
+    FILE *replies = fdopen(fd, "r");
+    if (!replies) {
+        perror("p1ctl: fdopen failed");
+        exit(2);
+    }
+
+    // One command at a time: its reply comes back before the next is sent
+    char line[CTL_LINE_MAX], reply[CTL_REPLY_MAX];
+    int failed = 0;
+    int from_args = optind < argc;
+    while (1) {
+        size_t len = 0;
+        if (from_args) {
+            for (int i = optind; i < argc && len < sizeof(line) - 1; i++) {
+                len += (size_t)snprintf(line + len, sizeof(line) - len, "%s%s", i > optind ? " " : "", argv[i]);
+            }
+            if (len > sizeof(line) - 2) { // Never send a truncated command
+                fprintf(stderr, "p1ctl: Command longer than %d bytes.\n", CTL_LINE_MAX - 2);
+                return 1;
+            }
+        } else {
+            if (!fgets(line, sizeof(line) - 1, stdin)) break;
+            len = strcspn(line, "\n");
+            int c = line[len] == '\n' ? '\n' : getchar();
+            if (c != '\n' && c != EOF) {
+                // Its tail would otherwise be sent as a command of its own
+                while ((c = getchar()) != '\n' && c != EOF);
+                fprintf(stderr, "p1ctl: Line longer than %d bytes skipped.\n", CTL_LINE_MAX - 2);
+                failed = 1;
+                continue;
+            }
+            char copy[CTL_LINE_MAX], *words[1];
+            memcpy(copy, line, len);
+            copy[len] = '\0';
+            if (ctl_split(copy, words, 1) == 0) continue; // Blank or comment
+        }
+        line[len++] = '\n';
+        if (write(fd, line, len) != (ssize_t)len || !fgets(reply, sizeof(reply), replies)) {
+            fprintf(stderr, "p1ctl: Connection to %s lost.\n", path);
+            exit(2);
+        }
+        fputs(reply, stdout);
+        fflush(stdout);
+        if (strncmp(reply, "{\"ok\":false", 11) == 0) failed = 1;
+        if (from_args) break;
+    }
+    fclose(replies);
+    return failed;
+}
@@ -0,0 +1,160 @@
+//
+// Token-bucket pacer for the workers (P2, P3, P4). It replaces the fixed
+// per-message nanosleep: the bucket refills at 'rate' tokens per second up to
+// 'burst' tokens, and a send spends one token (message mode) or one token
+// per byte (byte mode). Waits use absolute CLOCK_MONOTONIC deadlines so the
+// rate does not drift, and very short waits are spun instead of slept.
+//
+// Rate spec syntax (passed by P1 next to the pause time):
+//   "<n>ms"          one message every n milliseconds (fractions allowed, e.g. "0.25ms")
+//   "<n>msg/s"       n messages per second
+//   "<n>[K|M|G]B/s"  n bytes per second (binary multiples)
+// optionally followed by ",burst=<n>" (messages or bytes, default 1 message
+// or one maximum-size message worth of bytes).
+//
+
+#ifndef PROCESSES_PACER_H
+#define PROCESSES_PACER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include "common.h"
+#include "record.h"
+
+#define PACER_SPIN_THRESHOLD_NS 50000ULL // Spin instead of sleeping below 50us
+
+typedef struct {
+    double rate;        // Tokens per second
+    double burst;       // Bucket capacity in tokens
+    int bytes_mode;     // 1 = tokens are bytes, 0 = tokens are messages
+    double tokens;      // Current fill level (may go negative after a large send)
+    unsigned long long last_refill_ns;
+
+    // --- Statistics ---
+    unsigned long long acquired;
+    unsigned long long waits;
+    unsigned long long spins;
+    unsigned long long total_wait_ns;
+} pacer_t;
+
+// --- Configure the pacer from a rate spec, returns -1 on a malformed spec ---
+int pacer_configure(pacer_t *pacer, const char *spec) {
+    char *end = NULL;
+    double value = strtod(spec, &end);
+    if (end == spec || value <= 0.0) return -1;
+
+    double rate;
+    double burst;
+    int bytes_mode = 0;
+    double multiplier = 1.0;
+    if (*end == 'K') { multiplier = 1024.0; end++; }
+    else if (*end == 'M') { multiplier = 1024.0 * 1024.0; end++; }
+    else if (*end == 'G') { multiplier = 1024.0 * 1024.0 * 1024.0; end++; }
+
+    if (strncmp(end, "B/s", 3) == 0) {
+        bytes_mode = 1;
+        rate = value * multiplier;
+        burst = MAX_MSG_SIZE;
+        end += 3;
+    } else if (multiplier != 1.0) {
+        return -1; // K/M/G only make sense for byte rates
+    } else if (strncmp(end, "msg/s", 5) == 0) {
+        rate = value;
+        burst = 1.0;
+        end += 5;
+    } else if (strncmp(end, "ms", 2) == 0) {
+        rate = 1000.0 / value;
+        burst = 1.0;
+        end += 2;
+    } else {
+        return -1;
+    }
+
+    if (strncmp(end, ",burst=", 7) == 0) {
+        char *burst_end = NULL;
+        burst = strtod(end + 7, &burst_end);
+        if (burst_end == end + 7 || burst < 1.0) return -1;
+        end = burst_end;
+    }
+    if (*end != '\0') return -1;
+
+    pacer->rate = rate;
+    pacer->burst = burst;
+    pacer->bytes_mode = bytes_mode;
+    if (pacer->tokens > burst) pacer->tokens = burst;
+    return 0;
+}
+
+// --- Initialise a full bucket from a spec, returns -1 on a malformed spec ---
+int pacer_init(pacer_t *pacer, const char *spec) {
+    memset(pacer, 0, sizeof(*pacer));
+    if (pacer_configure(pacer, spec) == -1) return -1;
+    pacer->tokens = pacer->burst;
+    pacer->last_refill_ns = monotonic_ns();
+    return 0;
+}
+
+void pacer_refill(pacer_t *pacer, unsigned long long now_ns) {
+    if (now_ns > pacer->last_refill_ns) {
+        pacer->tokens += (double)(now_ns - pacer->last_refill_ns) * pacer->rate / 1e9;
+        if (pacer->tokens > pacer->burst) pacer->tokens = pacer->burst;
+    }
+    pacer->last_refill_ns = now_ns;
+}
+
+// --- How long a send of 'bytes' would wait now, without spending tokens ---
+unsigned long long pacer_wait_ns(pacer_t *pacer, size_t bytes) {
+    double cost = pacer->bytes_mode ? (double)bytes : 1.0;
+    double needed = cost < pacer->burst ? cost : pacer->burst;
+    pacer_refill(pacer, monotonic_ns());
+    if (pacer->tokens >= needed) return 0;
+    return (unsigned long long)((needed - pacer->tokens) / pacer->rate * 1e9) + 1;
+}
+
+// --- Wait until a send of 'bytes' is allowed, then spend the tokens ---
+// Returns -1 if '*stop' became set while waiting (the caller may still send).
+int pacer_acquire(pacer_t *pacer, size_t bytes, volatile sig_atomic_t *stop) {
+    double cost = pacer->bytes_mode ? (double)bytes : 1.0;
+    // A send bigger than the bucket only needs a full bucket, the debt is
+    // paid back by the following sends
+    double needed = cost < pacer->burst ? cost : pacer->burst;
+
+    unsigned long long now = monotonic_ns();
+    pacer_refill(pacer, now);
+    if (pacer->tokens < needed) {
+        unsigned long long wait_ns = (unsigned long long)((needed - pacer->tokens) / pacer->rate * 1e9) + 1;
+        unsigned long long deadline = now + wait_ns;
+        pacer->waits++;
+        if (wait_ns < PACER_SPIN_THRESHOLD_NS) {
+            pacer->spins++;
+            while (monotonic_ns() < deadline) {
+                if (stop && *stop) return -1;
+            }
+        } else {
+            struct timespec abs_deadline = {(time_t)(deadline / 1000000000ULL), (long)(deadline % 1000000000ULL)};
+            int rc;
+            while ((rc = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &abs_deadline, NULL)) == EINTR) {
+                if (stop && *stop) return -1;
+            }
+        }
+        unsigned long long woke = monotonic_ns();
+        pacer->total_wait_ns += woke - now;
+        pacer_refill(pacer, woke);
+    }
+    pacer->tokens -= cost;
+    pacer->acquired++;
+    return 0;
+}
+
+void pacer_report(const pacer_t *pacer, FILE *out, int process_num) {
+    fprintf(out, "\nProcess %d pacer: %.3f %s/s, burst %.0f, %llu sends, %llu waits (%llu spun), avg wait %.3f ms\n",
+            process_num, pacer->rate, pacer->bytes_mode ? "B" : "msg", pacer->burst,
+            pacer->acquired, pacer->waits, pacer->spins,
+            pacer->waits ? (double)pacer->total_wait_ns / pacer->waits / 1e6 : 0.0);
+}
+
+#endif //PROCESSES_PACER_H
@@ -0,0 +1,222 @@
+#define _POSIX_C_SOURCE 200809L // For nanosleep, sigaction
+#include "common.h"
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include "record.h"
+#include "pacer.h"
+#include "worker.h"
+#include "logger.h"
+#include "transport.h"
+
+// pipeline: in-process deployment. The three workers and the logger run as
+// threads of one process and exchange records over in-memory lock-free rings
+// (the "inproc" transport). Parsing (worker.h) and logging (logger.h) are the
+// code process2-5 run, so the log is identical; what is left out is the
+// kernel IPC on every record and the process-per-role isolation. Each worker
+// reads its values from a file ("-" for stdin) instead of a prompt, which
+// makes the mode usable as a no-IPC baseline.
+
+#define PIPELINE_WORKERS 3
+#define PIPELINE_IDLE_SPINS 64 // Idle logger passes that yield before it starts sleeping
+
+volatile sig_atomic_t terminate_flag = 0;
+atomic_int workers_running = 0;
+
+typedef struct {
+    int source;                 // 2 = integers, 3 = floats, 4 = strings
+    const char *input_path;     // NULL = worker not started
+    char rate_spec[64];         // Empty = no pacing
+    pthread_t thread;
+    int started;
+
+    // --- Statistics ---
+    unsigned long long sent;
+    unsigned long long invalid;
+    transport_t channel;        // Worker end, kept for the report
+    pacer_t pacer;
+} pipeline_worker_t;
+
+pipeline_worker_t workers[PIPELINE_WORKERS];
+transport_t channels[PIPELINE_WORKERS]; // Logger ends
+
+// End-to-end transit time (producer stamp -> logger ingest)
+unsigned long long transit_total_ns = 0;
+unsigned long long transit_max_ns = 0;
+unsigned long long transit_count = 0;
+
+void sigterm_handler(int signum) {
+    (void)signum; // Explicitly mark signum as unused
+    terminate_flag = 1;
+}
+
+// --- Worker thread: read, parse, stamp, pace, send ---
+void *pipeline_worker_main(void *arg) {
+    pipeline_worker_t *w = (pipeline_worker_t *)arg;
+    char name[MAX_PATH_LEN];
+    char line[WORKER_INPUT_MAX];
+    unsigned long long send_seq = 0;
+    log_record_t record;
+    memset(&record, 0, sizeof(record));
+
+    FILE *in = strcmp(w->input_path, "-") == 0 ? stdin : fopen(w->input_path, "r");
+    transport_endpoint_name(TRANSPORT_INPROC, w->source, 0, name, sizeof(name));
+    if (in == NULL || transport_connect(&w->channel, TRANSPORT_INPROC, w->source, name, &terminate_flag) == -1) {
+        fprintf(stderr, "\nPipeline: Worker P%d failed to start (%s): %s\n", w->source, w->input_path, strerror(errno));
+        if (in && in != stdin) fclose(in);
+        atomic_fetch_sub(&workers_running, 1);
+        return NULL;
+    }
+    int paced = w->rate_spec[0] != '\0' && pacer_init(&w->pacer, w->rate_spec) == 0;
+
+    while (!terminate_flag && worker_read_line(in, line, sizeof(line))) {
+        int parsed = worker_parse_value(w->source, line, &record);
+        if (parsed != 1) {
+            if (parsed == 0) w->invalid++;
+            continue;
+        }
+        worker_stamp(&record, &send_seq);
+        if (paced) pacer_acquire(&w->pacer, sizeof(wire_header_t), &terminate_flag);
+        if (transport_send_batch(&w->channel, &record, 1, NULL) == -1) break;
+        w->sent++;
+    }
+
+    if (in != stdin) fclose(in);
+    transport_close(&w->channel);
+    atomic_fetch_sub(&workers_running, 1);
+    return NULL;
+}
+
+// --- Logger delivery: measure the transit time, then log as P5 does ---
+void pipeline_deliver(const log_record_t *rec) {
+    unsigned long long now = monotonic_ns();
+    unsigned long long transit = now > rec->stamp.ts_ns ? now - rec->stamp.ts_ns : 0;
+    transit_total_ns += transit;
+    if (transit > transit_max_ns) transit_max_ns = transit;
+    transit_count++;
+    ingest_record(rec);
+}
+
+// --- Logger thread: poll every ring until the workers are done and it is dry ---
+void *pipeline_logger_main(void *arg) {
+    (void)arg;
+    int idle = 0;
+    while (1) {
+        int finished = atomic_load(&workers_running) == 0; // Read before the pass, so nothing sent after is missed
+        int any_read = 0;
+        for (int i = 0; i < PIPELINE_WORKERS; i++) {
+            if (channels[i].ring && transport_receive_batch(&channels[i], pipeline_deliver) > 0) any_read = 1;
+        }
+        flush_reorder(0);
+        if (any_read) {
+            idle = 0;
+            continue;
+        }
+        if (finished) break;
+        // Nothing to do: yield for a while, then back off to short sleeps
+        if (++idle < PIPELINE_IDLE_SPINS) {
+            sched_yield();
+        } else {
+            struct timespec ts = {0, 50000};
+            nanosleep(&ts, NULL);
+        }
+    }
+    flush_reorder(1);
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    const char *rate_spec = "";
+    while ((opt = getopt(argc, argv, "2:3:4:r:w:n:f:a:o:")) != -1) {
+        switch (opt) {
+            case '2': workers[0].input_path = optarg; break; // Integers
+            case '3': workers[1].input_path = optarg; break; // Floats
+            case '4': workers[2].input_path = optarg; break; // Strings
+            case 'r': // Worker rate spec, see pacer.h (default: as fast as possible)
+                rate_spec = optarg;
+                break;
+            default:
+                if (!logger_parse_option(opt, optarg)) { // -w, -n, -f, -a, -o as for process5
+                    fprintf(stderr, "\nUnknown option.\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+        }
+    }
+    if (argc - optind != 1 || (!workers[0].input_path && !workers[1].input_path && !workers[2].input_path)) {
+        fprintf(stderr, "\nUsage: %s [-2 int_input] [-3 float_input] [-4 string_input] [-r rate_spec] "
+                        "[-w reorder_window_ms] [-n reorder_max_records] [-f text|wal] [-a aggregation_spec] [-o route_spec] <log_filename>\n"
+                        "Inputs are files with one value per line, '-' reads stdin.\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    pacer_t rate_check;
+    if (rate_spec[0] != '\0' && pacer_init(&rate_check, rate_spec) == -1) {
+        fprintf(stderr, "\nInvalid rate spec '%s' (e.g. 500ms, 2000msg/s,burst=50, 1MB/s).\n", rate_spec);
+        exit(EXIT_FAILURE);
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = sigterm_handler;
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+
+    logger_echo = 0; // No menu to redraw, and the echo would dominate the run time
+    if (logger_start(argv[optind]) == -1) exit(EXIT_FAILURE);
+    printf("Pipeline (PID: %d) Started. Logging to: %s (workers and logger as threads)\n", getpid(), argv[optind]);
+    fflush(stdout);
+
+    // Rings are created before any worker thread attaches to them
+    for (int i = 0; i < PIPELINE_WORKERS; i++) {
+        workers[i].source = i + 2;
+        snprintf(workers[i].rate_spec, sizeof(workers[i].rate_spec), "%s", rate_spec);
+        if (!workers[i].input_path) continue;
+        char name[MAX_PATH_LEN];
+        transport_endpoint_name(TRANSPORT_INPROC, workers[i].source, 0, name, sizeof(name));
+        if (transport_open(&channels[i], TRANSPORT_INPROC, workers[i].source, name) == -1) {
+            perror("\nPipeline: Failed to create in-memory queue\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    unsigned long long start = monotonic_ns();
+    pthread_t logger_thread;
+    for (int i = 0; i < PIPELINE_WORKERS; i++) {
+        if (!workers[i].input_path) continue;
+        atomic_fetch_add(&workers_running, 1);
+        if (pthread_create(&workers[i].thread, NULL, pipeline_worker_main, &workers[i]) != 0) {
+            perror("\nPipeline: Failed to start worker thread\n");
+            atomic_fetch_sub(&workers_running, 1);
+            continue;
+        }
+        workers[i].started = 1;
+    }
+    if (pthread_create(&logger_thread, NULL, pipeline_logger_main, NULL) != 0) {
+        perror("\nPipeline: Failed to start logger thread\n");
+        terminate_flag = 1;
+        pipeline_logger_main(NULL); // Log what the workers managed to send on this thread
+    } else {
+        pthread_join(logger_thread, NULL);
+    }
+    for (int i = 0; i < PIPELINE_WORKERS; i++) {
+        if (workers[i].started) pthread_join(workers[i].thread, NULL);
+    }
+    double elapsed = (double)(monotonic_ns() - start) / 1e9;
+
+    // --- Reports ---
+    for (int i = 0; i < PIPELINE_WORKERS; i++) {
+        if (!workers[i].started) continue;
+        printf("Pipeline: P%d sent %llu records (%llu invalid lines skipped)\n",
+               workers[i].source, workers[i].sent, workers[i].invalid);
+        transport_report(&channels[i], stdout, 5);
+        transport_close(&channels[i]);
+    }
+    printf("Pipeline: %llu records in %.3f s (%.0f records/s), transit avg %.3f us, max %.3f us\n",
+           records_received, elapsed, elapsed > 0 ? (double)records_received / elapsed : 0.0,
+           transit_count ? (double)transit_total_ns / transit_count / 1e3 : 0.0, (double)transit_max_ns / 1e3);
+    logger_finish();
+    fflush(stdout);
+    return 0;
+}
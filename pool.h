@@ -0,0 +1,218 @@
+//
+// Worker launching for P1. Children are started with posix_spawn, which uses
+// vfork semantics on Linux (the parent's page tables are not copied), and P1
+// can keep a warm pool of standby workers per type. A standby is spawned
+// ahead of time and connected to P5 where its transport allows a second
+// producer. It then blocks on a pipe until P1 writes an activation message
+// carrying the worker's parameters, so a start costs one pipe write instead
+// of fork + exec + connect.
+//
+
+#ifndef PROCESSES_POOL_H
+#define PROCESSES_POOL_H
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "common.h"
+#include "pacer.h"
+#include "transport.h"
+
+#define POOL_MAX_STANDBY 4
+#define POOL_ACTIVATE_FD 3 // Standby's end of its activation pipe
+#define POOL_ACTIVATE_FD_STR "3"
+
+extern char **environ;
+
+// Activation message, smaller than PIPE_BUF so it arrives in one piece
+typedef struct {
+    char text_color[4];
+    char bg_color[4];
+    char pause_ms[12];
+    char rate_spec[64];              // Empty = pace by pause_ms
+    unsigned long long requested_ns; // When P1 activated the worker (monotonic)
+} pool_activation_t;
+
+typedef struct {
+    pid_t pid;
+    int activate_fd; // P1's write end of the activation pipe
+} pool_standby_t;
+
+typedef struct {
+    int size;  // Standby workers to keep (-p), 0 = no pool
+    int count;
+    pool_standby_t standby[POOL_MAX_STANDBY];
+
+    // --- Statistics ---
+    unsigned long long warm_starts;
+    unsigned long long cold_starts;
+    unsigned long long warm_ns;  // Total time P1 spent starting workers, per path
+    unsigned long long cold_ns;
+} worker_pool_t;
+
+// --- Returns 1 if a standby may connect while another producer is active ---
+// Socket endpoints accept one producer at a time, so a standby on a socket
+// connects when it is activated. Mapping the shm ring is safe, only writing
+// is single-producer.
+int pool_can_preconnect(transport_kind_t kind) {
+    return !transport_is_socket(kind);
+}
+
+// --- Start 'path' with posix_spawn ---
+// With 'activate_fd' != -1 the child gets it as POOL_ACTIVATE_FD. SIGPIPE is
+// reset to its default, P1 ignores it. Returns -1 with errno set if the
+// program could not be started.
+int pool_spawn(const char *path, char *const argv[], int activate_fd, pid_t *pid) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t default_signals;
+    sigemptyset(&default_signals);
+    sigaddset(&default_signals, SIGPIPE);
+    int err = posix_spawn_file_actions_init(&actions);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    err = posix_spawnattr_init(&attr);
+    if (err == 0) err = posix_spawnattr_setsigdefault(&attr, &default_signals);
+    if (err == 0) err = posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+    if (err == 0 && activate_fd != -1) {
+        err = posix_spawn_file_actions_adddup2(&actions, activate_fd, POOL_ACTIVATE_FD);
+    }
+    if (err == 0) err = posix_spawn(pid, path, &actions, &attr, argv, environ);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+// --- Spawn one standby worker, 'argv' must pass "-s" POOL_ACTIVATE_FD_STR ---
+int pool_add_standby(worker_pool_t *pool, const char *path, char *const argv[]) {
+    if (pool->count >= POOL_MAX_STANDBY) {
+        errno = ENOSPC;
+        return -1;
+    }
+    int fds[2];
+    if (pipe(fds) == -1) return -1;
+    // Keep the read end clear of POOL_ACTIVATE_FD, dup2 onto itself would keep close-on-exec
+    int read_fd = fcntl(fds[0], F_DUPFD_CLOEXEC, POOL_ACTIVATE_FD + 1);
+    close(fds[0]);
+    if (read_fd == -1 || fcntl(fds[1], F_SETFD, FD_CLOEXEC) == -1) {
+        if (read_fd != -1) close(read_fd);
+        close(fds[1]);
+        return -1;
+    }
+    pid_t pid;
+    int spawned = pool_spawn(path, argv, read_fd, &pid);
+    int saved_errno = errno;
+    close(read_fd);
+    if (spawned == -1) {
+        close(fds[1]);
+        errno = saved_errno;
+        return -1;
+    }
+    pool->standby[pool->count].pid = pid;
+    pool->standby[pool->count].activate_fd = fds[1];
+    pool->count++;
+    return 0;
+}
+
+// --- Hand the parameters to a standby, which becomes the running worker ---
+// Standbys that died meanwhile (their pipe is broken) are reaped and skipped.
+// Returns -1 when the pool has no live standby left. P1 must ignore SIGPIPE.
+int pool_activate(worker_pool_t *pool, pool_activation_t *activation, pid_t *pid) {
+    while (pool->count > 0) {
+        pool_standby_t standby = pool->standby[--pool->count];
+        activation->requested_ns = monotonic_ns();
+        ssize_t written = write(standby.activate_fd, activation, sizeof(*activation));
+        close(standby.activate_fd);
+        if (written == (ssize_t)sizeof(*activation)) {
+            *pid = standby.pid;
+            return 0;
+        }
+        kill(standby.pid, SIGTERM);
+        waitpid(standby.pid, NULL, 0);
+    }
+    return -1;
+}
+
+// --- Drop a standby that exited on its own (reaped by P1's supervisor) ---
+// Returns 1 if 'pid' was a standby of this pool.
+int pool_forget(worker_pool_t *pool, pid_t pid) {
+    for (int i = 0; i < pool->count; i++) {
+        if (pool->standby[i].pid != pid) continue;
+        close(pool->standby[i].activate_fd);
+        pool->standby[i] = pool->standby[--pool->count];
+        return 1;
+    }
+    return 0;
+}
+
+// --- Release every standby: closing its pipe makes it exit without sending ---
+void pool_drain(worker_pool_t *pool) {
+    for (int i = 0; i < pool->count; i++) close(pool->standby[i].activate_fd);
+    for (int i = 0; i < pool->count; i++) {
+        if (waitpid(pool->standby[i].pid, NULL, 0) == -1 && errno != ECHILD) {
+            perror("[P1 Warning]: waitpid error while draining the worker pool");
+        }
+    }
+    pool->count = 0;
+}
+
+// --- Worker: block until P1 activates this standby ---
+// Returns 0 with the message in *out, -1 if the pool was drained (EOF) or a
+// signal set 'stop_flag'.
+int pool_await_activation(int fd, pool_activation_t *out, volatile sig_atomic_t *stop_flag) {
+    size_t received = 0;
+    while (received < sizeof(*out)) {
+        ssize_t n = read(fd, (char *)out + received, sizeof(*out) - received);
+        if (n > 0) {
+            received += (size_t)n;
+        } else if (n == -1 && errno == EINTR && !*stop_flag) {
+            continue;
+        } else {
+            close(fd);
+            return -1;
+        }
+    }
+    close(fd);
+    out->text_color[sizeof(out->text_color) - 1] = '\0';
+    out->bg_color[sizeof(out->bg_color) - 1] = '\0';
+    out->pause_ms[sizeof(out->pause_ms) - 1] = '\0';
+    out->rate_spec[sizeof(out->rate_spec) - 1] = '\0';
+    return 0;
+}
+
+// --- Worker: take over the parameters of an activation message ---
+// Like control_apply_worker_config, an invalid rate spec keeps the argv pacing.
+void pool_apply_activation(const pool_activation_t *activation, pacer_t *pacer,
+                           char *text_color_code, size_t text_size,
+                           char *bg_color_code, size_t bg_size, int process_num) {
+    char rate_spec[sizeof(activation->rate_spec)];
+    if (activation->rate_spec[0] != '\0') snprintf(rate_spec, sizeof(rate_spec), "%s", activation->rate_spec);
+    else snprintf(rate_spec, sizeof(rate_spec), "%sms", activation->pause_ms);
+    if (pacer_init(pacer, rate_spec) == -1) {
+        fprintf(stderr, "\nProcess %d: Ignoring invalid activation rate spec '%s'.\n", process_num, rate_spec);
+    }
+    if (activation->text_color[0] != '\0') snprintf(text_color_code, text_size, "\x1B[%sm", activation->text_color);
+    if (activation->bg_color[0] != '\0') snprintf(bg_color_code, bg_size, "\x1B[%sm", activation->bg_color);
+}
+
+void pool_report(const worker_pool_t *pool, FILE *out, int process_num) {
+    fprintf(out, "[P1 Info]: Process %d starts: %llu warm (avg %.1f us), %llu spawned (avg %.1f us), %d standby\n",
+            process_num, pool->warm_starts,
+            pool->warm_starts ? (double)pool->warm_ns / pool->warm_starts / 1e3 : 0.0,
+            pool->cold_starts, pool->cold_starts ? (double)pool->cold_ns / pool->cold_starts / 1e3 : 0.0,
+            pool->count);
+}
+
+#endif //PROCESSES_POOL_H
@@ -9,12 +9,20 @@
 #include <signal.h>
 #include <errno.h>
 #include <time.h>
+#include "pacer.h"
+#include "control.h"
+#include "transport.h"
+#include "pool.h"
+#include "supervisor.h"
+#include "ctl.h"
+#include "reorder.h"
 
 // --- Global state for running processes ---
 pid_t pid_p2 = 0;
 pid_t pid_p3 = 0;
 pid_t pid_p4 = 0;
-pid_t pid_p5 = 0;
+pid_t pid_p5[MAX_LOGGER_SHARDS] = {0}; // One logger (P5) per shard
+int logger_shard_count = 1;           // Set from the optional second argument
 int running_children_count = 0;
 
 // --- Global vars for log file name and common params (to be set dynamically) ---
@@ -22,8 +30,118 @@ char *log_filename_arg = NULL;      // For P5 log file
 char common_text_color[3];      // To store common text color after input
 char common_bg_color[3];        // To store common background color after input
 char common_pause_ms_str[11];   // To store common pause time as string after input
+char common_rate_spec[64] = ""; // Optional token-bucket rate spec (-r), overrides the pause
+
+// --- Channel kind per worker (-t "2=mq,3=shm"), forwarded to every P5 shard ---
+transport_kind_t worker_transports[TRANSPORT_MAX_SOURCE + 1];
+
+// --- Warm pool of standby workers per type (-p), see pool.h ---
+worker_pool_t worker_pools[TRANSPORT_MAX_SOURCE + 1];
+int pool_size = 0;
+
+#define LOGGER_START_TIMEOUT_MS 1000 // Max wait for P5 to create its endpoints
+#define LOGGER_UPGRADE_TIMEOUT_MS 5000 // Max wait for a P5 to hand its channels to a successor
+
+// --- Supervision: children that die are reaped at once, failed ones restarted (supervisor.h) ---
+supervised_child_t supervised_workers[TRANSPORT_MAX_SOURCE + 1];
+supervised_child_t supervised_loggers[MAX_LOGGER_SHARDS];
+int supervisor_fd = -1; // Self-pipe written by the SIGCHLD handler
+
+// --- Live configuration for running workers (shared memory, see control.h) ---
+control_block_t *control = NULL;
+worker_config_t worker_configs[CONTROL_WORKER_SLOTS]; // Last published config per worker
 int common_params_set = 0;      // Flag: 0 = not set yet, 1 = set
 
+// --- Options forwarded verbatim to every P5 shard (e.g. "-w", "50") ---
+#define MAX_LOGGER_EXTRA_ARGS 32
+char *logger_extra_args[MAX_LOGGER_EXTRA_ARGS];
+int logger_extra_argc = 0;
+
+// --- Producer-side filtering and sampling per worker (-F "2=>100,every=10;4=~ERROR"), see filter.h ---
+// Parsed into worker_configs[].filter_spec and published with the live config.
+int parse_filter_map(const char *map) {
+    char copy[CONTROL_WORKER_SLOTS * (FILTER_SPEC_MAX + 8)];
+    if (strlen(map) >= sizeof(copy)) return -1;
+    snprintf(copy, sizeof(copy), "%s", map);
+    for (char *save = NULL, *entry = strtok_r(copy, ";", &save); entry; entry = strtok_r(NULL, ";", &save)) {
+        char *spec = strchr(entry, '=');
+        if (spec == NULL) return -1;
+        *spec++ = '\0';
+        int first = 2, last = 4;
+        if (strcmp(entry, "all") != 0) {
+            if (strlen(entry) != 1 || entry[0] < '2' || entry[0] > '4') return -1;
+            first = last = entry[0] - '0';
+        }
+        for (int process_num = first; process_num <= last; process_num++) {
+            if (filter_check(spec, process_num) == -1) return -1;
+            worker_config_t *config = &worker_configs[control_slot(process_num)];
+            snprintf(config->filter_spec, sizeof(config->filter_spec), "%s", strcmp(spec, "off") == 0 ? "" : spec);
+        }
+    }
+    return 0;
+}
+
+// --- Adaptive send batching (-B "64/500us"), the same spec for every worker, see sendbatch.h ---
+long reorder_window_ms = REORDER_DEFAULT_WINDOW_MS; // P5's reorder window (-w), bounds the batch budget
+
+// A record held in a batch for the reorder window or longer reaches P5 after
+// newer records were written, so the log would be out of order again.
+// Returns 1 if the budget of a valid 'spec' is below the window (0 = reordering off).
+int batch_within_window(const char *spec) {
+    int max;
+    unsigned long long budget_ns;
+    if (send_batch_parse(spec, &max, &budget_ns) == -1 || max <= 1 || reorder_window_ms <= 0) return 1;
+    return budget_ns < (unsigned long long)reorder_window_ms * 1000000ULL;
+}
+
+void set_batch_spec(const char *spec) {
+    for (int process_num = 2; process_num <= 4; process_num++) {
+        worker_config_t *config = &worker_configs[control_slot(process_num)];
+        snprintf(config->batch_spec, sizeof(config->batch_spec), "%s", strcmp(spec, "off") == 0 ? "" : spec);
+    }
+}
+
+// --- Sampled tracing (-T N): workers mark every Nth record, each P5 shard exports "<segment>.trace.json" ---
+char trace_every_str[12] = "";
+char logger_trace_paths[MAX_LOGGER_SHARDS][MAX_PATH_LEN * 2 + 16];
+
+void add_logger_option(const char *flag, char *value) {
+    if (logger_extra_argc + 2 > MAX_LOGGER_EXTRA_ARGS) {
+        fprintf(stderr, "[P1 Warning]: Too many logger options, ignoring %s %s.\n", flag, value);
+        return;
+    }
+    logger_extra_args[logger_extra_argc++] = (char *)flag;
+    logger_extra_args[logger_extra_argc++] = value;
+}
+
+// --- Publish the common parameters as the live config of every worker ---
+void publish_common_config() {
+    for (int process_num = 2; process_num <= 4; process_num++) {
+        worker_config_t *config = &worker_configs[control_slot(process_num)];
+        if (common_rate_spec[0] != '\0') {
+            snprintf(config->rate_spec, sizeof(config->rate_spec), "%s", common_rate_spec);
+        } else {
+            snprintf(config->rate_spec, sizeof(config->rate_spec), "%sms", common_pause_ms_str);
+        }
+        snprintf(config->text_color, sizeof(config->text_color), "%s", common_text_color);
+        snprintf(config->bg_color, sizeof(config->bg_color), "%s", common_bg_color);
+        if (control) control_publish(control, process_num, config);
+    }
+}
+
+// --- Mark the common parameters as set and publish them to the workers ---
+void apply_common_params() {
+    common_params_set = 1; // Mark parameters as set
+    publish_common_config();
+    fprintf(stderr,"Common parameters set (Text:%s, Bg:%s, Pause:%sms).\n",
+            common_text_color, common_bg_color, common_pause_ms_str);
+    if (common_rate_spec[0] != '\0') {
+        fprintf(stderr,"Rate spec %s overrides the pause time.\n", common_rate_spec);
+    }
+    fprintf(stderr,"----------------------------------------------\n");
+    fflush(stderr);
+}
+
 // --- Function to get common parameters from user input ---
 void get_common_child_params() {
     // Use stderr for prompts here to separate from P1 Menu prompt
@@ -75,39 +193,485 @@ void get_common_child_params() {
         int c; while ((c = getchar()) != '\n' && c != EOF);
     }
 
+    apply_common_params();
+}
 
-    common_params_set = 1; // Mark parameters as set
-    fprintf(stderr,"Common parameters set (Text:%s, Bg:%s, Pause:%sms).\n",
-            common_text_color, common_bg_color, common_pause_ms_str);
-    fprintf(stderr,"----------------------------------------------\n");
-    fflush(stderr);
+// --- "params" command: set the common parameters without prompting ---
+// Returns -1 (nothing changed) if a value is invalid.
+int set_common_params(const char *text_color, const char *bg_color, const char *pause_ms) {
+    char *end = NULL;
+    long pause_val = strtol(pause_ms, &end, 10);
+    if (strlen(text_color) >= sizeof(common_text_color) || strlen(bg_color) >= sizeof(common_bg_color) ||
+        strspn(text_color, "0123456789") != strlen(text_color) || strspn(bg_color, "0123456789") != strlen(bg_color) ||
+        text_color[0] == '\0' || bg_color[0] == '\0' || end == pause_ms || *end != '\0' || pause_val <= 0 ||
+        strlen(pause_ms) >= sizeof(common_pause_ms_str)) {
+        return -1;
+    }
+    snprintf(common_text_color, sizeof(common_text_color), "%s", text_color);
+    snprintf(common_bg_color, sizeof(common_bg_color), "%s", bg_color);
+    snprintf(common_pause_ms_str, sizeof(common_pause_ms_str), "%s", pause_ms);
+    apply_common_params();
+    return 0;
+}
+
+// --- Commands that need the common parameters take the defaults if none were set ---
+void ensure_common_params() {
+    if (common_params_set) return;
+    fprintf(stderr, "[P1 Info]: Common parameters not set, using the defaults.\n");
+    set_common_params("37", "40", "1000");
+}
+
+
+// --- Returns 1 if at least one logger shard is running ---
+int any_p5_running() {
+    for (int shard = 0; shard < logger_shard_count; shard++) {
+        if (pid_p5[shard] > 0) return 1;
+    }
+    return 0;
+}
+
+// --- Resolve the "<kind>:<name>" endpoint a worker is routed to ---
+void worker_ipc_endpoint(int process_num, char *out, size_t size) {
+    int shard = route_shard(process_num, logger_shard_count);
+    char name[MAX_PATH_LEN];
+    transport_endpoint_name(worker_transports[process_num], process_num, shard, name, sizeof(name));
+    transport_format_endpoint(worker_transports[process_num], name, out, size);
+    if (logger_shard_count > 1) {
+        fprintf(stderr,"[P1 Info]: Process %d routed to logger shard %d (%s).\n", process_num, shard, out);
+        fflush(stderr);
+    }
+}
+
+// --- Remove leftover IPC objects of every shard ---
+// Every kind is removed, not only the selected one, so a previous run with a
+// different -t selection leaves nothing behind.
+void unlink_all_shard_ipc() {
+    char name[MAX_PATH_LEN];
+    for (int shard = 0; shard < logger_shard_count; shard++) {
+        for (int process_num = 2; process_num <= TRANSPORT_MAX_SOURCE; process_num++) {
+            for (int kind = 0; kind < TRANSPORT_KIND_COUNT; kind++) {
+                transport_endpoint_name((transport_kind_t)kind, process_num, shard, name, sizeof(name));
+                transport_unlink_name((transport_kind_t)kind, name);
+            }
+        }
+    }
+}
+
+// --- Wait until every running shard has created the endpoints of P2, P3 and P4 ---
+// Replaces a fixed sleep: returns as soon as the loggers are ready.
+void wait_for_loggers() {
+    unsigned long long deadline = monotonic_ns() + LOGGER_START_TIMEOUT_MS * 1000000ULL;
+    char name[MAX_PATH_LEN];
+    for (int shard = 0; shard < logger_shard_count; shard++) {
+        if (pid_p5[shard] <= 0) continue;
+        for (int process_num = 2; process_num <= 4; process_num++) {
+            transport_endpoint_name(worker_transports[process_num], process_num, shard, name, sizeof(name));
+            while (!transport_endpoint_ready(worker_transports[process_num], name)) {
+                if (monotonic_ns() >= deadline) {
+                    fprintf(stderr, "[P1 Warning]: Process 5 shard %d has not created %s after %d ms.\n",
+                            shard, name, LOGGER_START_TIMEOUT_MS);
+                    fflush(stderr);
+                    return;
+                }
+                struct timespec ts = {0, 1000000}; // 1 ms
+                nanosleep(&ts, NULL);
+            }
+        }
+    }
 }
 
+// --- A child is running; report the recovery if it replaces a failed one ---
+void note_child_started(supervised_child_t *child, const char *label) {
+    int recovering = child->failed_ns != 0;
+    supervisor_started(child, monotonic_ns());
+    if (recovering) {
+        fprintf(stderr, "[P1 Info]: %s recovered (restart #%llu, %.3f ms after the failure).\n",
+                label, child->restarts, (double)child->last_recovery_ns / 1e6);
+        fflush(stderr);
+    }
+}
+
+// --- Build the argv of a P5 shard, 'takeover' adds "-u" (hitless upgrade) ---
+void build_logger_argv(char *segment, char *shard_str, int takeover, char *p5_argv[]) {
+    int p5_argc = 0;
+    p5_argv[p5_argc++] = "process5";
+    if (takeover) p5_argv[p5_argc++] = "-u";
+    for (int i = 0; i < logger_extra_argc; i++) p5_argv[p5_argc++] = logger_extra_args[i];
+    if (trace_every_str[0] != '\0') {
+        char *trace_path = logger_trace_paths[atoi(shard_str)];
+        snprintf(trace_path, sizeof(logger_trace_paths[0]), "%s.trace.json", segment);
+        p5_argv[p5_argc++] = "-T";
+        p5_argv[p5_argc++] = trace_path;
+    }
+    p5_argv[p5_argc++] = segment;
+    p5_argv[p5_argc++] = shard_str;
+    p5_argv[p5_argc] = NULL;
+}
 
-// --- Function to start Process 5 (uses log_filename_arg) ---
+// --- Function to start Process 5 shards (uses log_filename_arg) ---
 void ensure_p5_running() {
-    if (pid_p5 == 0) {
-        if (log_filename_arg == NULL) {
-            fprintf(stderr, "[P1 Error]: Log filename argument missing. Cannot start P5.\n");
+    if (log_filename_arg == NULL) {
+        fprintf(stderr, "[P1 Error]: Log filename argument missing. Cannot start P5.\n");
+        fflush(stderr);
+        return;
+    }
+    int started = 0;
+    int started_shards[MAX_LOGGER_SHARDS] = {0};
+    for (int shard = 0; shard < logger_shard_count; shard++) {
+        if (pid_p5[shard] != 0) continue;
+
+        char segment[MAX_PATH_LEN * 2];
+        char shard_str[4];
+        shard_log_name(log_filename_arg, shard, logger_shard_count, segment, sizeof(segment));
+        snprintf(shard_str, sizeof(shard_str), "%d", shard);
+
+        fprintf(stderr,"[P1 Info]: Starting Process 5 (Logger) shard %d, Log file: %s\n", shard, segment);
+        fflush(stderr);
+        char *p5_argv[MAX_LOGGER_EXTRA_ARGS + 7];
+        build_logger_argv(segment, shard_str, 0, p5_argv);
+        if (pool_spawn("./process5", p5_argv, -1, &pid_p5[shard]) == -1) {
+            perror("[P1 Error]: Failed to start Process 5");
+            pid_p5[shard] = 0;
+        } else {
+            fprintf(stderr,"[P1 Info]: Process 5 shard %d started with PID: %d\n", shard, pid_p5[shard]);
             fflush(stderr);
-            return;
+            started = 1;
+            started_shards[shard] = 1;
+        }
+    }
+    if (!started) return;
+    wait_for_loggers(); // One wait covers all shards, they initialise in parallel
+    for (int shard = 0; shard < logger_shard_count; shard++) {
+        if (!started_shards[shard]) continue;
+        char label[32];
+        snprintf(label, sizeof(label), "Process 5 shard %d", shard);
+        note_child_started(&supervised_loggers[shard], label);
+    }
+}
+
+// --- Build the argv of a worker, 'standby' adds the pool's "-s <fd>" ---
+// A standby may be spawned before the common parameters are set; its
+// activation message carries the real ones.
+void build_worker_argv(int process_num, char *endpoint, int standby, char *program, size_t program_size,
+                       char *child_argv[]) {
+    int child_argc = 0;
+    snprintf(program, program_size, "process%d", process_num);
+    child_argv[child_argc++] = program;
+    if (standby) {
+        child_argv[child_argc++] = "-s";
+        child_argv[child_argc++] = POOL_ACTIVATE_FD_STR;
+    }
+    if (trace_every_str[0] != '\0') {
+        child_argv[child_argc++] = "-T";
+        child_argv[child_argc++] = trace_every_str;
+    }
+    child_argv[child_argc++] = common_params_set ? common_text_color : "37";
+    child_argv[child_argc++] = common_params_set ? common_bg_color : "40";
+    child_argv[child_argc++] = common_params_set ? common_pause_ms_str : "1000";
+    child_argv[child_argc++] = endpoint;
+    if (common_rate_spec[0] != '\0') child_argv[child_argc++] = common_rate_spec;
+    child_argv[child_argc] = NULL;
+}
+
+// --- Top up the warm pool of one worker type ---
+void fill_worker_pool(int process_num) {
+    worker_pool_t *pool = &worker_pools[process_num];
+    if (pool->count >= pool->size) return;
+    char endpoint[MAX_PATH_LEN + 16]; // "<kind>:<name>"
+    char program[16], path[20];
+    char *child_argv[12];
+    worker_ipc_endpoint(process_num, endpoint, sizeof(endpoint));
+    build_worker_argv(process_num, endpoint, 1, program, sizeof(program), child_argv);
+    snprintf(path, sizeof(path), "./%s", program);
+    while (pool->count < pool->size) {
+        if (pool_add_standby(pool, path, child_argv) == -1) {
+            fprintf(stderr, "[P1 Warning]: Failed to spawn a standby Process %d: %s\n", process_num, strerror(errno));
+            break;
         }
-        fprintf(stderr,"[P1 Info]: Starting Process 5 (Logger), Log file: %s\n", log_filename_arg);
+    }
+    fflush(stderr);
+}
+
+const char *program_label(int process_num) {
+    static const char *labels[] = {"", "", "Process 2", "Process 3", "Process 4"};
+    return labels[process_num];
+}
+
+pid_t *worker_pid_slot(int process_num) {
+    if (process_num == 2) return &pid_p2;
+    if (process_num == 3) return &pid_p3;
+    return &pid_p4;
+}
+
+// --- Start a worker: activate a warm standby if there is one, else spawn it ---
+void start_worker(int process_num, pid_t *pid_ptr) {
+    worker_pool_t *pool = &worker_pools[process_num];
+    unsigned long long start = monotonic_ns();
+
+    pool_activation_t activation;
+    memset(&activation, 0, sizeof(activation));
+    snprintf(activation.text_color, sizeof(activation.text_color), "%s", common_text_color);
+    snprintf(activation.bg_color, sizeof(activation.bg_color), "%s", common_bg_color);
+    snprintf(activation.pause_ms, sizeof(activation.pause_ms), "%s", common_pause_ms_str);
+    snprintf(activation.rate_spec, sizeof(activation.rate_spec), "%s", common_rate_spec);
+    if (pool_activate(pool, &activation, pid_ptr) == 0) {
+        unsigned long long elapsed = monotonic_ns() - start;
+        pool->warm_starts++;
+        pool->warm_ns += elapsed;
+        running_children_count++;
+        fprintf(stderr,"[P1 Info]: Process %d activated from the warm pool, PID: %d (%.1f us)\n",
+                process_num, *pid_ptr, (double)elapsed / 1e3);
         fflush(stderr);
-        pid_p5 = fork();
-        if (pid_p5 == -1) {
-            perror("[P1 Error]: Failed to fork Process 5");
-        } else if (pid_p5 == 0) {
-            execlp("./process5", "process5", log_filename_arg, (char *)NULL);
-            perror("[P1 Error]: Failed to exec Process 5");
-            exit(EXIT_FAILURE);
+        note_child_started(&supervised_workers[process_num], program_label(process_num));
+        fill_worker_pool(process_num); // The replacement is spawned after the start, not before it
+        return;
+    }
+
+    char endpoint[MAX_PATH_LEN + 16]; // "<kind>:<name>"
+    char program[16], path[20];
+    char *child_argv[12];
+    worker_ipc_endpoint(process_num, endpoint, sizeof(endpoint));
+    build_worker_argv(process_num, endpoint, 0, program, sizeof(program), child_argv);
+    snprintf(path, sizeof(path), "./%s", program);
+    if (pool_spawn(path, child_argv, -1, pid_ptr) == -1) {
+        fprintf(stderr, "[P1 Error]: Failed to start Process %d: %s\n", process_num, strerror(errno));
+        fflush(stderr);
+        *pid_ptr = 0;
+        return;
+    }
+    unsigned long long elapsed = monotonic_ns() - start;
+    pool->cold_starts++;
+    pool->cold_ns += elapsed;
+    running_children_count++;
+    fprintf(stderr,"[P1 Info]: Process %d started with PID: %d (%.1f us)\n", process_num, *pid_ptr, (double)elapsed / 1e3);
+    fflush(stderr);
+    note_child_started(&supervised_workers[process_num], program_label(process_num));
+}
+
+// --- Stop every running logger shard ---
+void stop_all_p5() {
+    for (int shard = 0; shard < logger_shard_count; shard++) {
+        supervisor_cancel(&supervised_loggers[shard]);
+        if (pid_p5[shard] <= 0) continue;
+        fprintf(stderr,"[P1 Info]: Stopping Process 5 shard %d (PID: %d)...\n", shard, pid_p5[shard]);
+        fflush(stderr);
+        if (kill(pid_p5[shard], SIGTERM) == -1) {
+            if (errno == ESRCH) {
+                fprintf(stderr, "[P1 Warning]: Process 5 (PID: %d) already terminated.\n", pid_p5[shard]);
+            } else {
+                perror("[P1 Error]: Failed to send SIGTERM to Process 5");
+            }
         } else {
-            fprintf(stderr,"[P1 Info]: Process 5 started with PID: %d\n", pid_p5);
+            int status;
+            if(waitpid(pid_p5[shard], &status, 0) == -1 && errno != ECHILD) {
+                perror("[P1 Warning]: waitpid error while stopping P5");
+            } else {
+                fprintf(stderr,"[P1 Info]: Process 5 (PID: %d) confirmed terminated.\n", pid_p5[shard]);
+            }
             fflush(stderr);
-            struct timespec ts = {0, 100 * 1000000};
-            nanosleep(&ts, NULL);
         }
+        pid_p5[shard] = 0;
+    }
+}
+
+// --- Returns 1 if any worker type keeps a warm pool (-p, "resize") ---
+int pools_configured() {
+    for (int process_num = 2; process_num <= 4; process_num++) {
+        if (worker_pools[process_num].size > 0) return 1;
+    }
+    return 0;
+}
+
+// --- Returns 1 while the loggers are needed: active or pending workers, or a pool ---
+int loggers_needed() {
+    if (running_children_count > 0 || pools_configured()) return 1; // Standbys keep P5 in use
+    for (int process_num = 2; process_num <= 4; process_num++) {
+        if (supervised_workers[process_num].failed_ns != 0) return 1;
+    }
+    return 0;
+}
+
+void stop_p5_if_idle() {
+    if (!loggers_needed() && any_p5_running()) {
+        fprintf(stderr,"[P1 Info]: All children (P2, P3, P4) stopped. Stopping Process 5...\n");
+        fflush(stderr);
+        stop_all_p5();
+    }
+}
+
+// --- Restart every failed child whose backoff has expired ---
+void restart_due_children() {
+    unsigned long long now = monotonic_ns();
+    int loggers_due = 0;
+    for (int shard = 0; shard < logger_shard_count; shard++) {
+        if (!supervisor_due(&supervised_loggers[shard], now)) continue;
+        if (loggers_needed()) loggers_due = 1;
+        else supervisor_cancel(&supervised_loggers[shard]);
+    }
+    if (loggers_due) {
+        ensure_p5_running(); // Starts every missing shard
+        for (int shard = 0; shard < logger_shard_count; shard++) {
+            if (pid_p5[shard] != 0 || !supervisor_due(&supervised_loggers[shard], now)) continue;
+            long delay_ms = supervisor_failed(&supervised_loggers[shard], monotonic_ns());
+            fprintf(stderr, "[P1 Warning]: Restart of Process 5 shard %d failed, retrying in %ld ms.\n", shard, delay_ms);
+        }
+    }
+    for (int process_num = 2; process_num <= 4; process_num++) {
+        pid_t *slot = worker_pid_slot(process_num);
+        if (*slot != 0 || !supervisor_due(&supervised_workers[process_num], now)) continue;
+        fprintf(stderr, "[P1 Info]: Restarting Process %d...\n", process_num);
+        ensure_p5_running();
+        start_worker(process_num, slot);
+        if (*slot == 0) {
+            long delay_ms = supervisor_failed(&supervised_workers[process_num], monotonic_ns());
+            fprintf(stderr, "[P1 Warning]: Restart of Process %d failed, retrying in %ld ms.\n", process_num, delay_ms);
+        }
+    }
+    fflush(stderr);
+}
+
+// --- Reap every child that exited, then restart what failed ---
+// A worker that exits with status 0 ended on purpose (e.g. EOF on its input)
+// and is not restarted. A logger is restarted whenever it is still needed.
+void supervise_children() {
+    int status;
+    pid_t pid;
+    char how[96];
+    supervisor_clear_wakeups();
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        unsigned long long now = monotonic_ns();
+        int clean = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        supervisor_describe_status(status, how, sizeof(how));
+
+        for (int process_num = 2; process_num <= 4; process_num++) {
+            pid_t *slot = worker_pid_slot(process_num);
+            if (*slot != pid) continue;
+            *slot = 0;
+            running_children_count--;
+            if (clean) {
+                fprintf(stderr, "\n[P1 Info]: Process %d (PID: %d) exited (%s).\n", process_num, pid, how);
+            } else {
+                long delay_ms = supervisor_failed(&supervised_workers[process_num], now);
+                fprintf(stderr, "\n[P1 Warning]: Process %d (PID: %d) failed (%s), restarting in %ld ms.\n",
+                        process_num, pid, how, delay_ms);
+            }
+        }
+        for (int shard = 0; shard < logger_shard_count; shard++) {
+            if (pid_p5[shard] != pid) continue;
+            pid_p5[shard] = 0;
+            if (loggers_needed()) {
+                long delay_ms = supervisor_failed(&supervised_loggers[shard], now);
+                fprintf(stderr, "\n[P1 Warning]: Process 5 shard %d (PID: %d) failed (%s), restarting in %ld ms.\n",
+                        shard, pid, how, delay_ms);
+            } else {
+                fprintf(stderr, "\n[P1 Info]: Process 5 shard %d (PID: %d) exited (%s).\n", shard, pid, how);
+            }
+        }
+        for (int process_num = 2; process_num <= 4; process_num++) {
+            if (pool_forget(&worker_pools[process_num], pid)) {
+                fprintf(stderr, "\n[P1 Warning]: Standby Process %d (PID: %d) exited (%s).\n", process_num, pid, how);
+            }
+        }
+    }
+    fflush(stderr);
+    restart_due_children();
+    stop_p5_if_idle();
+}
+
+// --- Nanoseconds until the next pending restart, -1 if none ---
+long long next_restart_ns() {
+    unsigned long long now = monotonic_ns();
+    long long next = -1;
+    for (int i = 0; i <= TRANSPORT_MAX_SOURCE + MAX_LOGGER_SHARDS; i++) {
+        const supervised_child_t *child = i <= TRANSPORT_MAX_SOURCE ? &supervised_workers[i]
+                                                                    : &supervised_loggers[i - TRANSPORT_MAX_SOURCE - 1];
+        long long wait = supervisor_time_to_restart(child, now);
+        if (wait >= 0 && (next < 0 || wait < next)) next = wait;
+    }
+    return next;
+}
+
+// --- Menu option 9: children, restarts and recovery times ---
+void show_status() {
+    fprintf(stderr, "--- Status ---\n");
+    for (int process_num = 2; process_num <= 4; process_num++) {
+        pid_t pid = *worker_pid_slot(process_num);
+        const supervised_child_t *child = &supervised_workers[process_num];
+        fprintf(stderr, "Process %d: %s", process_num,
+                pid > 0 ? "running" : child->failed_ns != 0 ? "restart pending" : "stopped");
+        if (pid > 0) fprintf(stderr, " (PID %d)", pid);
+        fprintf(stderr, ", %d standby\n", worker_pools[process_num].count);
+        supervisor_report(child, stderr, program_label(process_num));
+    }
+    for (int shard = 0; shard < logger_shard_count; shard++) {
+        char label[32];
+        snprintf(label, sizeof(label), "Process 5 shard %d", shard);
+        fprintf(stderr, "%s: %s", label,
+                pid_p5[shard] > 0 ? "running" : supervised_loggers[shard].failed_ns != 0 ? "restart pending" : "stopped");
+        if (pid_p5[shard] > 0) fprintf(stderr, " (PID %d)", pid_p5[shard]);
+        fprintf(stderr, "\n");
+        supervisor_report(&supervised_loggers[shard], stderr, label);
+    }
+    fflush(stderr);
+}
+
+// --- Menu option 10: replace every running P5 without closing a channel ---
+// The new instance takes the channels over from the old one (handoff.h);
+// workers keep sending throughout. A successor that fails leaves the old
+// instance running. Returns the number of shards that were not upgraded.
+int upgrade_loggers() {
+    int failed = 0;
+    for (int shard = 0; shard < logger_shard_count; shard++) {
+        if (pid_p5[shard] <= 0) continue;
+        char segment[MAX_PATH_LEN * 2];
+        char shard_str[4];
+        shard_log_name(log_filename_arg, shard, logger_shard_count, segment, sizeof(segment));
+        snprintf(shard_str, sizeof(shard_str), "%d", shard);
+        char *p5_argv[MAX_LOGGER_EXTRA_ARGS + 7];
+        build_logger_argv(segment, shard_str, 1, p5_argv);
+
+        pid_t old_pid = pid_p5[shard], new_pid;
+        unsigned long long start = monotonic_ns();
+        if (pool_spawn("./process5", p5_argv, -1, &new_pid) == -1) {
+            perror("[P1 Error]: Failed to start the successor of Process 5");
+            failed++;
+            continue;
+        }
+        fprintf(stderr, "[P1 Info]: Upgrading Process 5 shard %d: PID %d -> %d...\n", shard, old_pid, new_pid);
+        fflush(stderr);
+
+        // The old instance exits once it has handed over and written its last record
+        unsigned long long deadline = start + LOGGER_UPGRADE_TIMEOUT_MS * 1000000ULL;
+        int status;
+        pid_t exited = 0;
+        while (exited == 0 && monotonic_ns() < deadline) {
+            if (waitpid(old_pid, &status, WNOHANG) == old_pid) exited = old_pid;
+            else if (waitpid(new_pid, &status, WNOHANG) == new_pid) exited = new_pid;
+            else {
+                struct timespec ts = {0, 1000000}; // 1 ms
+                nanosleep(&ts, NULL);
+            }
+        }
+        if (exited == old_pid) {
+            pid_p5[shard] = new_pid;
+            supervisor_started(&supervised_loggers[shard], monotonic_ns());
+            fprintf(stderr, "[P1 Info]: Process 5 shard %d upgraded in %.3f ms, no channel was closed.\n",
+                    shard, (double)(monotonic_ns() - start) / 1e6);
+        } else {
+            char how[96];
+            if (exited == new_pid) supervisor_describe_status(status, how, sizeof(how));
+            else {
+                snprintf(how, sizeof(how), "no handoff after %d ms", LOGGER_UPGRADE_TIMEOUT_MS);
+                kill(new_pid, SIGTERM);
+                waitpid(new_pid, NULL, 0);
+            }
+            fprintf(stderr, "[P1 Warning]: Upgrade of Process 5 shard %d failed (%s), PID %d keeps running.\n",
+                    shard, how, old_pid);
+            failed++;
+        }
+        fflush(stderr);
     }
+    return failed;
 }
 
 // --- Function to stop_process (uses stderr) ---
@@ -132,31 +696,446 @@ void stop_process(pid_t *pid_ptr, int process_num) {
         }
         *pid_ptr = 0;
         running_children_count--;
+        stop_p5_if_idle();
+    } else if (supervised_workers[process_num].failed_ns != 0) {
+        supervisor_cancel(&supervised_workers[process_num]);
+        fprintf(stderr,"[P1 Info]: Process %d is not running, its pending restart is cancelled.\n", process_num);
+        fflush(stderr);
+        stop_p5_if_idle();
+    } else {
+        fprintf(stderr,"[P1 Info]: Process %d is not running.\n", process_num);
+        fflush(stderr);
+    }
+}
 
-        if (running_children_count == 0 && pid_p5 > 0) {
-            fprintf(stderr,"[P1 Info]: All children (P2, P3, P4) stopped. Stopping Process 5 (PID: %d)...\n", pid_p5);
-            fflush(stderr);
-            if (kill(pid_p5, SIGTERM) == -1) {
-                if (errno == ESRCH) {
-                    fprintf(stderr, "[P1 Warning]: Process 5 (PID: %d) already terminated.\n", pid_p5);
-                } else {
-                    perror("[P1 Error]: Failed to send SIGTERM to Process 5");
-                }
-            } else {
-                int status;
-                if(waitpid(pid_p5, &status, 0) == -1 && errno != ECHILD) {
-                    perror("[P1 Warning]: waitpid error while stopping P5");
-                } else {
-                    fprintf(stderr,"[P1 Info]: Process 5 (PID: %d) confirmed terminated.\n", pid_p5);
-                }
-                fflush(stderr);
-            }
-            pid_p5 = 0;
+
+// --- Control API (ctl.h): socket clients, batch scripts and the menu run the same commands ---
+int menu_enabled = 1;                 // 0 = headless (-H): no menu, stdin is left to the workers
+int exit_requested = 0;               // Set by "exit"/"shutdown", main() cleans up and returns
+volatile sig_atomic_t terminate_requested = 0; // SIGTERM (and SIGINT when headless)
+char *ctl_socket_path = NULL;         // -c
+int ctl_listen_fd = -1;
+ctl_client_t ctl_clients[CTL_MAX_CLIENTS];
+int script_command = 0;               // 1 while run_script() runs one of its lines, only scripts may sleep
+
+#define SCRIPT_SLEEP_MAX_MS 3600000L
+
+static const char *command_help =
+    "params <text> <bg> <pause_ms> | start <2|3|4|all> | stop <2|3|4|all> | rate <2|3|4|all> <spec> | "
+    "color <2|3|4|all> <text> <bg> | filter <2|3|4|all> <spec|off> | batch <2|3|4|all> <max/budget|off> | resize <2|3|4|all> <standby> | status | upgrade | sleep <ms> | exit | shutdown";
+
+void terminate_handler(int signum) {
+    (void)signum;
+    terminate_requested = 1;
+}
+
+// --- "2", "3", "4" or "all" -> worker numbers, returns how many (0 = invalid) ---
+int parse_worker_targets(const char *arg, int targets[3]) {
+    if (strcmp(arg, "all") == 0) {
+        for (int i = 0; i < 3; i++) targets[i] = i + 2;
+        return 3;
+    }
+    if (strlen(arg) == 1 && arg[0] >= '2' && arg[0] <= '4') {
+        targets[0] = arg[0] - '0';
+        return 1;
+    }
+    return 0;
+}
+
+// --- start: a worker that is already running is an error only when named explicitly ---
+void command_start(int process_num, int named, ctl_reply_t *reply) {
+    pid_t *slot = worker_pid_slot(process_num);
+    if (*slot > 0) {
+        fprintf(stderr,"[P1 Info]: Process %d is already running (PID: %d).\n", process_num, *slot); fflush(stderr);
+        if (named) ctl_reply_error(reply, "Process %d is already running (PID %d)", process_num, *slot);
+        return;
+    }
+    ensure_common_params();
+    ensure_p5_running();
+    if (!any_p5_running() && running_children_count == 0) {
+        fprintf(stderr,"[P1 Error]: Prerequisite Process 5 is not running. Cannot start Process %d.\n", process_num); fflush(stderr);
+        ctl_reply_error(reply, "Process 5 is not running, cannot start Process %d", process_num);
+        return;
+    }
+    fprintf(stderr,"[P1 Info]: Starting Process %d with common parameters...\n", process_num); fflush(stderr);
+    start_worker(process_num, slot);
+    if (*slot <= 0) ctl_reply_error(reply, "failed to start Process %d", process_num);
+    else ctl_reply_add(reply, ",\"p%d\":%d", process_num, *slot);
+}
+
+void command_stop(int process_num, int named, ctl_reply_t *reply) {
+    pid_t *slot = worker_pid_slot(process_num);
+    if (*slot <= 0 && supervised_workers[process_num].failed_ns == 0) {
+        if (named) ctl_reply_error(reply, "Process %d is not running", process_num);
+        return;
+    }
+    stop_process(slot, process_num);
+    ctl_reply_add(reply, ",\"p%d\":0", process_num);
+}
+
+// --- rate/color/filter: publish a live config, NULL keeps the current value ---
+void command_configure(int process_num, const char *rate, const char *text, const char *bg, const char *filter,
+                       const char *batch, ctl_reply_t *reply) {
+    if (control == NULL) {
+        ctl_reply_error(reply, "live configuration is unavailable (control block not mapped)");
+        return;
+    }
+    ensure_common_params();
+    worker_config_t *config = &worker_configs[control_slot(process_num)];
+    if (rate) snprintf(config->rate_spec, sizeof(config->rate_spec), "%s", rate);
+    if (text) snprintf(config->text_color, sizeof(config->text_color), "%s", text);
+    if (bg) snprintf(config->bg_color, sizeof(config->bg_color), "%s", bg);
+    if (filter) snprintf(config->filter_spec, sizeof(config->filter_spec), "%s", strcmp(filter, "off") == 0 ? "" : filter);
+    if (batch) snprintf(config->batch_spec, sizeof(config->batch_spec), "%s", strcmp(batch, "off") == 0 ? "" : batch);
+    control_publish(control, process_num, config);
+    fprintf(stderr, "[P1 Info]: Published config for Process %d (rate %s, colors %s/%s, filter %s, batch %s).\n",
+            process_num, config->rate_spec, config->text_color, config->bg_color,
+            config->filter_spec[0] != '\0' ? config->filter_spec : "off",
+            config->batch_spec[0] != '\0' ? config->batch_spec : "off");
+    fflush(stderr);
+}
+
+// --- resize: standby workers kept for one type; shrinking releases the pool first ---
+void command_resize(int process_num, int size, ctl_reply_t *reply) {
+    worker_pool_t *pool = &worker_pools[process_num];
+    if (size < pool->count) pool_drain(pool);
+    pool->size = size;
+    if (size > 0) {
+        ensure_p5_running(); // Standbys connect ahead of time
+        fill_worker_pool(process_num);
+    }
+    fprintf(stderr, "[P1 Info]: Process %d warm pool resized to %d (%d standby).\n", process_num, size, pool->count);
+    fflush(stderr);
+    ctl_reply_add(reply, ",\"p%d_standby\":%d", process_num, pool->count);
+    stop_p5_if_idle();
+}
+
+const char *child_state(pid_t pid, const supervised_child_t *child) {
+    return pid > 0 ? "running" : child->failed_ns != 0 ? "restart pending" : "stopped";
+}
+
+void command_status(ctl_reply_t *reply) {
+    ctl_reply_add(reply, ",\"params_set\":%s,\"workers\":[", common_params_set ? "true" : "false");
+    for (int process_num = 2; process_num <= 4; process_num++) {
+        pid_t pid = *worker_pid_slot(process_num);
+        const supervised_child_t *child = &supervised_workers[process_num];
+        const worker_pool_t *pool = &worker_pools[process_num];
+        ctl_reply_add(reply, "%s{\"id\":%d,\"state\":\"%s\",\"pid\":%d,\"transport\":\"%s\",\"standby\":%d,\"pool\":%d,"
+                             "\"restarts\":%llu,\"warm_starts\":%llu,\"cold_starts\":%llu",
+                      process_num > 2 ? "," : "", process_num, child_state(pid, child), pid > 0 ? pid : 0,
+                      transport_kind_names[worker_transports[process_num]], pool->count, pool->size,
+                      child->restarts, pool->warm_starts, pool->cold_starts);
+        ctl_reply_add_string(reply, "rate", worker_configs[control_slot(process_num)].rate_spec);
+        ctl_reply_add_string(reply, "filter", worker_configs[control_slot(process_num)].filter_spec);
+        ctl_reply_add_string(reply, "batch", worker_configs[control_slot(process_num)].batch_spec);
+        ctl_reply_add(reply, "}");
+    }
+    ctl_reply_add(reply, "],\"loggers\":[");
+    for (int shard = 0; shard < logger_shard_count; shard++) {
+        ctl_reply_add(reply, "%s{\"shard\":%d,\"state\":\"%s\",\"pid\":%d,\"restarts\":%llu}", shard > 0 ? "," : "",
+                      shard, child_state(pid_p5[shard], &supervised_loggers[shard]), pid_p5[shard] > 0 ? pid_p5[shard] : 0,
+                      supervised_loggers[shard].restarts);
+    }
+    ctl_reply_add(reply, "]");
+}
+
+// --- exit is refused while workers run, shutdown stops them first ---
+int can_exit() {
+    if (running_children_count == 0 && !(any_p5_running() && !pools_configured())) return 1;
+    fprintf(stderr, "[P1 Error]: Cannot exit. Stop all other processes first (P2, P3, P4).\n");
+    if (pid_p2 > 0) fprintf(stderr," - P2 (PID %d) is running.\n", pid_p2);
+    if (pid_p3 > 0) fprintf(stderr," - P3 (PID %d) is running.\n", pid_p3);
+    if (pid_p4 > 0) fprintf(stderr," - P4 (PID %d) is running.\n", pid_p4);
+    for (int shard = 0; shard < logger_shard_count; shard++) {
+        if (pid_p5[shard] <= 0) continue;
+        if (running_children_count > 0) fprintf(stderr," - P5 shard %d (PID %d) is running (required by P2/P3/P4).\n", shard, pid_p5[shard]);
+        else fprintf(stderr," - P5 shard %d (PID %d) is running (should stop soon).\n", shard, pid_p5[shard]);
+    }
+    fflush(stderr);
+    return 0;
+}
+
+void run_command(char *line, ctl_reply_t *reply);
+
+// --- Script "sleep": wait for the deadline in a select() loop ---
+// Children are still supervised and control clients served meanwhile; their
+// commands are not part of the script, so they cannot sleep themselves.
+void script_sleep(unsigned long long deadline_ns) {
+    script_command = 0;
+    while (!exit_requested && !terminate_requested) {
+        unsigned long long now = monotonic_ns();
+        if (now >= deadline_ns) break;
+        fd_set read_set;
+        FD_ZERO(&read_set);
+        int max_fd = -1;
+        if (supervisor_fd != -1) {
+            FD_SET(supervisor_fd, &read_set);
+            max_fd = supervisor_fd;
         }
+        max_fd = ctl_add_fds(ctl_listen_fd, ctl_clients, &read_set, max_fd);
+        long long wait_ns = (long long)(deadline_ns - now);
+        long long restart_ns = next_restart_ns();
+        if (restart_ns >= 0 && restart_ns < wait_ns) wait_ns = restart_ns;
+        struct timeval tv = {(time_t)(wait_ns / 1000000000LL), (suseconds_t)((wait_ns % 1000000000LL) / 1000)};
+        if (select(max_fd + 1, &read_set, NULL, NULL, &tv) == -1) {
+            if (errno != EINTR) break;
+            continue;
+        }
+        supervise_children();
+        ctl_service(ctl_listen_fd, ctl_clients, &read_set, run_command);
+    }
+    script_command = 1;
+}
+
+// --- Run one command line, the single entry point of every client ---
+void run_command(char *line, ctl_reply_t *reply) {
+    char *argv[CTL_MAX_ARGS];
+    int argc = ctl_split(line, argv, CTL_MAX_ARGS);
+    if (argc == 0) {
+        ctl_reply_error(reply, "empty command");
+        return;
+    }
+    ctl_reply_begin(reply, argv[0]);
+    const char *cmd = argv[0];
+    int targets[3];
+    int target_count = argc >= 2 ? parse_worker_targets(argv[1], targets) : 0;
+
+    if (strcmp(cmd, "start") == 0 || strcmp(cmd, "stop") == 0) {
+        if (argc != 2 || target_count == 0) {
+            ctl_reply_error(reply, "usage: %s <2|3|4|all>", cmd);
+            return;
+        }
+        for (int i = 0; i < target_count; i++) {
+            if (strcmp(cmd, "start") == 0) command_start(targets[i], target_count == 1, reply);
+            else command_stop(targets[i], target_count == 1, reply);
+        }
+    } else if (strcmp(cmd, "params") == 0) {
+        if (argc != 4 || set_common_params(argv[1], argv[2], argv[3]) == -1) {
+            ctl_reply_error(reply, "usage: params <text_color> <bg_color> <pause_ms>, e.g. params 32 40 500");
+        }
+    } else if (strcmp(cmd, "rate") == 0) {
+        pacer_t rate_check;
+        if (argc != 3 || target_count == 0 || pacer_init(&rate_check, argv[2]) == -1) {
+            ctl_reply_error(reply, "usage: rate <2|3|4|all> <spec>, e.g. rate all 2000msg/s,burst=50");
+            return;
+        }
+        for (int i = 0; i < target_count; i++) command_configure(targets[i], argv[2], NULL, NULL, NULL, NULL, reply);
+    } else if (strcmp(cmd, "color") == 0) {
+        if (argc != 4 || target_count == 0 || strlen(argv[2]) > 3 || strlen(argv[3]) > 3) {
+            ctl_reply_error(reply, "usage: color <2|3|4|all> <text_color> <bg_color>");
+            return;
+        }
+        for (int i = 0; i < target_count; i++) command_configure(targets[i], NULL, argv[2], argv[3], NULL, NULL, reply);
+    } else if (strcmp(cmd, "filter") == 0) {
+        // Checked against every target first, so a spec is applied to all of them or none
+        int valid = argc == 3 && target_count > 0;
+        for (int i = 0; valid && i < target_count; i++) valid = filter_check(argv[2], targets[i]) == 0;
+        if (!valid) {
+            ctl_reply_error(reply, "usage: filter <2|3|4|all> <spec|off>, e.g. filter 2 10..500,every=10 "
+                                   "(>X <X A..B for 2/3, ^prefix ~text for 4, every=N, sample=K/N)");
+            return;
+        }
+        for (int i = 0; i < target_count; i++) command_configure(targets[i], NULL, NULL, NULL, argv[2], NULL, reply);
+    } else if (strcmp(cmd, "batch") == 0) {
+        if (argc != 3 || target_count == 0 || send_batch_check(argv[2]) == -1) {
+            ctl_reply_error(reply, "usage: batch <2|3|4|all> <max/budget|off>, e.g. batch all 64/500us (max 1-%d)",
+                            SEND_BATCH_MAX);
+            return;
+        }
+        if (!batch_within_window(argv[2])) {
+            ctl_reply_error(reply, "batch budget must be below the reorder window of %ld ms", reorder_window_ms);
+            return;
+        }
+        for (int i = 0; i < target_count; i++) command_configure(targets[i], NULL, NULL, NULL, NULL, argv[2], reply);
+    } else if (strcmp(cmd, "resize") == 0) {
+        char *end = NULL;
+        long size = argc == 3 ? strtol(argv[2], &end, 10) : -1;
+        if (argc != 3 || target_count == 0 || end == argv[2] || *end != '\0' || size < 0 || size > POOL_MAX_STANDBY) {
+            ctl_reply_error(reply, "usage: resize <2|3|4|all> <standby 0-%d>", POOL_MAX_STANDBY);
+            return;
+        }
+        for (int i = 0; i < target_count; i++) command_resize(targets[i], (int)size, reply);
+    } else if (strcmp(cmd, "status") == 0) {
+        command_status(reply);
+    } else if (strcmp(cmd, "upgrade") == 0) {
+        if (!any_p5_running()) {
+            fprintf(stderr, "[P1 Info]: No Process 5 is running, nothing to upgrade.\n");
+            ctl_reply_error(reply, "no Process 5 is running");
+        } else {
+            int failed = upgrade_loggers();
+            if (failed > 0) ctl_reply_error(reply, "%d logger shard(s) not upgraded", failed);
+        }
+    } else if (strcmp(cmd, "sleep") == 0) {
+        // For scripts: let the workers run for a while between commands. Over
+        // the socket or from the menu it would only stall everyone else.
+        char *end = NULL;
+        long ms = argc == 2 ? strtol(argv[1], &end, 10) : -1;
+        if (!script_command) {
+            ctl_reply_error(reply, "sleep is only available in scripts (-x)");
+            return;
+        }
+        if (argc != 2 || end == argv[1] || *end != '\0' || ms < 0 || ms > SCRIPT_SLEEP_MAX_MS) {
+            ctl_reply_error(reply, "usage: sleep <ms 0-%ld>", SCRIPT_SLEEP_MAX_MS);
+            return;
+        }
+        script_sleep(monotonic_ns() + (unsigned long long)ms * 1000000ULL);
+    } else if (strcmp(cmd, "exit") == 0) {
+        if (can_exit()) exit_requested = 1;
+        else ctl_reply_error(reply, "workers are running, stop them first or use shutdown");
+    } else if (strcmp(cmd, "shutdown") == 0) {
+        for (int process_num = 2; process_num <= 4; process_num++) {
+            supervisor_cancel(&supervised_workers[process_num]);
+            if (*worker_pid_slot(process_num) > 0) stop_process(worker_pid_slot(process_num), process_num);
+        }
+        exit_requested = 1;
+    } else if (strcmp(cmd, "help") == 0) {
+        ctl_reply_add_string(reply, "commands", command_help);
     } else {
-        fprintf(stderr,"[P1 Info]: Process %d is not running.\n", process_num);
+        ctl_reply_error(reply, "unknown command '%s' (try help)", cmd);
+    }
+}
+
+// --- The menu is one more client: its choices become command lines ---
+int menu_command(const char *fmt, ...) {
+    char line[CTL_LINE_MAX];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    ctl_reply_t reply;
+    ctl_reply_begin(&reply, "");
+    run_command(line, &reply);
+    if (!reply.ok) {
+        fprintf(stderr, "[P1 Error]: %s\n", reply.error);
+        fflush(stderr);
+    }
+    return reply.ok;
+}
+
+// --- Batch mode (-x): run a script ('-' = stdin), one JSON reply per command on stdout ---
+// Returns the number of commands that failed.
+int run_script(const char *path) {
+    FILE *script = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!script) {
+        fprintf(stderr, "[P1 Error]: Cannot open script %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    char line[CTL_LINE_MAX], reply[CTL_REPLY_MAX];
+    int failed = 0;
+    while (!exit_requested && !terminate_requested && fgets(line, sizeof(line), script)) {
+        line[strcspn(line, "\n")] = '\0';
+        char copy[CTL_LINE_MAX], *words[1];
+        snprintf(copy, sizeof(copy), "%s", line);
+        if (ctl_split(copy, words, 1) == 0) continue; // Blank or comment
+        script_command = 1;
+        size_t len = ctl_execute(run_command, line, reply, sizeof(reply));
+        script_command = 0;
+        fwrite(reply, 1, len, stdout);
+        fflush(stdout);
+        if (strncmp(reply, "{\"ok\":false", 11) == 0) failed++;
+        supervise_children(); // Children that exited during the script are reaped in order
+    }
+    if (script != stdin) fclose(script);
+    return failed;
+}
+
+// --- Menu option 8: change rate/colors/filter of running workers without restarting them ---
+void reconfigure_workers() {
+    char target_str[4], rate_str[64], text_str[4], bg_str[4], filter_str[FILTER_SPEC_MAX];
+    if (common_params_set == 0) {
+        fprintf(stderr, "[P1 Info]: Start a worker first, common parameters are not set yet.\n");
         fflush(stderr);
+        return;
+    }
+
+    fprintf(stderr, "Reconfigure which process (2, 3, 4 or 0 for all): ");
+    fflush(stderr);
+    if (scanf("%3s", target_str) != 1) return;
+    fprintf(stderr, "New rate spec (e.g. 500ms, 2000msg/s,burst=50, 1MB/s; '-' to keep): ");
+    fflush(stderr);
+    if (scanf("%63s", rate_str) != 1) return;
+    fprintf(stderr, "New text color code ('-' to keep): ");
+    fflush(stderr);
+    if (scanf("%3s", text_str) != 1) return;
+    fprintf(stderr, "New background color code ('-' to keep): ");
+    fflush(stderr);
+    if (scanf("%3s", bg_str) != 1) return;
+    fprintf(stderr, "New filter spec (e.g. >100, 0..1,sample=1/10, ~ERROR, off; '-' to keep): ");
+    fflush(stderr);
+    if (scanf("%63s", filter_str) != 1) return;
+    int c; while ((c = getchar()) != '\n' && c != EOF);
+
+    const char *target = strcmp(target_str, "0") == 0 ? "all" : target_str;
+    if (strcmp(rate_str, "-") != 0 && !menu_command("rate %s %s", target, rate_str)) return;
+    if (strcmp(text_str, "-") != 0 || strcmp(bg_str, "-") != 0) {
+        // A kept color is re-sent as it is
+        int targets[3];
+        int count = parse_worker_targets(target, targets);
+        const worker_config_t *config = &worker_configs[control_slot(count > 0 ? targets[0] : 2)];
+        menu_command("color %s %s %s", target, strcmp(text_str, "-") != 0 ? text_str : config->text_color,
+                     strcmp(bg_str, "-") != 0 ? bg_str : config->bg_color);
+    }
+    if (strcmp(filter_str, "-") != 0) menu_command("filter %s %s", target, filter_str);
+}
+
+// --- Block until the menu has input, serving the control socket and supervising the children meanwhile ---
+// Returns 1 when stdin is readable, 0 when P1 should exit. stdin is unbuffered,
+// so select() on fd 0 sees exactly what scanf has not read.
+int wait_for_input() {
+    while (!exit_requested) {
+        if (terminate_requested) {
+            fprintf(stderr, "\n[P1 Info]: Termination requested, shutting down.\n");
+            menu_command("shutdown");
+            return 0;
+        }
+        fd_set read_set;
+        FD_ZERO(&read_set);
+        int max_fd = -1;
+        if (menu_enabled) {
+            FD_SET(STDIN_FILENO, &read_set);
+            max_fd = STDIN_FILENO;
+        }
+        if (supervisor_fd != -1) {
+            FD_SET(supervisor_fd, &read_set);
+            if (supervisor_fd > max_fd) max_fd = supervisor_fd;
+        }
+        max_fd = ctl_add_fds(ctl_listen_fd, ctl_clients, &read_set, max_fd);
+        struct timeval tv, *timeout = NULL;
+        long long wait_ns = next_restart_ns();
+        if (wait_ns >= 0) {
+            tv.tv_sec = (time_t)(wait_ns / 1000000000LL);
+            tv.tv_usec = (suseconds_t)((wait_ns % 1000000000LL) / 1000);
+            timeout = &tv;
+        }
+        int ready = select(max_fd + 1, &read_set, NULL, NULL, timeout);
+        if (ready == -1) {
+            if (errno != EINTR) return menu_enabled; // Let the menu read (and fail) instead of spinning
+            continue;
+        }
+        supervise_children();
+        ctl_service(ctl_listen_fd, ctl_clients, &read_set, run_command);
+        if (menu_enabled && FD_ISSET(STDIN_FILENO, &read_set)) return 1;
+    }
+    return 0;
+}
+
+// --- Stop the pools and loggers and remove every IPC object ---
+void shutdown_p1() {
+    for (int process_num = 2; process_num <= 4; process_num++) {
+        worker_pool_t *pool = &worker_pools[process_num];
+        if (pool->size > 0 || pool->warm_starts + pool->cold_starts > 0) pool_report(pool, stderr, process_num);
+        pool_drain(pool); // Standbys exit before their logger drains
+        supervisor_cancel(&supervised_workers[process_num]);
+        if (supervised_workers[process_num].restarts > 0) {
+            supervisor_report(&supervised_workers[process_num], stderr, program_label(process_num));
+        }
     }
+    stop_all_p5();
+    ctl_close(ctl_listen_fd, ctl_clients, ctl_socket_path);
+    fprintf(stderr,"[P1 Info]: Exiting Main Process (P1).\n"); fflush(stderr);
+    unlink_all_shard_ipc();
+    control_unmap(control);
+    shm_unlink(CONTROL_SHM_NAME);
 }
 
 
@@ -164,34 +1143,183 @@ void stop_process(pid_t *pid_ptr, int process_num) {
 int main(int argc, char *argv[]) {
 
     // --- Check for log file name argument ONLY ---
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <log_filename>\n", argv[0]);
-        fprintf(stderr, "Example: %s my_system_log.txt\n", argv[0]);
+    int opt;
+    char *script_path = NULL;
+    transport_parse_map(NULL, worker_transports); // Historical pairing unless -t says otherwise
+    while ((opt = getopt(argc, argv, "w:n:r:d:f:a:t:p:b:o:T:F:B:c:x:H")) != -1) {
+        switch (opt) {
+            case 'p': // Standby workers kept per type, activated instead of spawned
+                pool_size = (int)strtol(optarg, NULL, 10);
+                if (pool_size < 0 || pool_size > POOL_MAX_STANDBY) {
+                    fprintf(stderr, "[P1 Error]: Pool size must be 0..%d.\n", POOL_MAX_STANDBY);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 't': // Channel kind per worker, e.g. "2=mq,3=shm,4=seqpacket"
+                if (transport_parse_map(optarg, worker_transports) == -1) {
+                    fprintf(stderr, "[P1 Error]: Invalid transport spec '%s' (e.g. 2=mq,3=shm,4=seqpacket; kinds: fifo, mq, stream, seqpacket, shm).\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                add_logger_option("-t", optarg);
+                break;
+            case 'r': // Worker rate spec, e.g. "2000msg/s,burst=50" or "1MB/s"
+                strncpy(common_rate_spec, optarg, sizeof(common_rate_spec) - 1);
+                common_rate_spec[sizeof(common_rate_spec) - 1] = '\0';
+                break;
+            case 'w': // P5 reorder window (ms), also the limit of the batch budget
+                reorder_window_ms = strtol(optarg, NULL, 10);
+                add_logger_option("-w", optarg);
+                break;
+            case 'n': add_logger_option("-n", optarg); break; // P5 reorder buffer size (records)
+            case 'd': add_logger_option("-d", optarg); break; // P5 drain deadline on shutdown (ms)
+            case 'f': add_logger_option("-f", optarg); break; // P5 log format (text or wal)
+            case 'a': add_logger_option("-a", optarg); break; // P5 windowed aggregation spec
+            case 'b': add_logger_option("-b", optarg); break; // P5 busy-poll idle period (us)
+            case 'o': add_logger_option("-o", optarg); break; // P5 routing table to separate sinks
+            case 'T': // Sampled tracing: every Nth record of each worker, per-shard trace files
+                if (strtol(optarg, NULL, 10) < 1) {
+                    fprintf(stderr, "[P1 Error]: Trace sampling must be every N >= 1 records.\n");
+                    exit(EXIT_FAILURE);
+                }
+                snprintf(trace_every_str, sizeof(trace_every_str), "%ld", strtol(optarg, NULL, 10));
+                break;
+            case 'F': // Worker-side filter/sampling, e.g. "2=>100,every=10;4=~ERROR"
+                if (parse_filter_map(optarg) == -1) {
+                    fprintf(stderr, "[P1 Error]: Invalid filter spec '%s' (e.g. 2=10..500,every=10;3=<0.5;4=^ERR,sample=5/100).\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'B': // Adaptive send batching in the workers, "<max records>/<latency budget>"
+                if (send_batch_check(optarg) == -1) {
+                    fprintf(stderr, "[P1 Error]: Invalid batch spec '%s' (e.g. 64/500us, 16/2ms; max 1-%d).\n", optarg, SEND_BATCH_MAX);
+                    exit(EXIT_FAILURE);
+                }
+                set_batch_spec(optarg);
+                break;
+            case 'c': ctl_socket_path = optarg; break; // Control socket for scripts and orchestration
+            case 'x': script_path = optarg; break;     // Batch mode: run these commands first
+            case 'H': menu_enabled = 0; break;         // Headless: no menu, driven by -x and -c only
+            default: break;
+        }
+    }
+    if (argc - optind != 1 && argc - optind != 2) {
+        fprintf(stderr, "Usage: %s [-r rate_spec] [-w reorder_window_ms] [-n reorder_max_records] [-d drain_deadline_ms] [-f text|wal] [-a aggregation_spec] [-t transport_spec] [-o route_spec] [-b busy_poll_idle_us] [-T trace_every] [-F filter_spec] [-B batch_max/budget] [-p pool_size] [-c control_socket] [-x script|-] [-H] <log_filename> [logger_shards]\n", argv[0]);
+        fprintf(stderr, "Example: %s my_system_log.txt 2\n", argv[0]);
+        fprintf(stderr, "Headless: %s -H -c %s -x load.txt my_system_log.txt\n", argv[0], CTL_SOCKET_DEFAULT);
+        exit(EXIT_FAILURE);
+    }
+    // Checked once -w is known, whichever order the options came in
+    if (!batch_within_window(worker_configs[0].batch_spec)) {
+        fprintf(stderr, "[P1 Error]: Batch budget of '%s' must be below the reorder window of %ld ms (-w), "
+                        "or batched records are logged out of order.\n", worker_configs[0].batch_spec, reorder_window_ms);
+        exit(EXIT_FAILURE);
+    }
+    log_filename_arg = argv[optind]; // Store log filename
+    if (argc - optind == 2) {
+        long shards = strtol(argv[optind + 1], NULL, 10);
+        if (shards < 1 || shards > MAX_LOGGER_SHARDS) {
+            fprintf(stderr, "[P1 Error]: Logger shards must be 1..%d.\n", MAX_LOGGER_SHARDS);
+            exit(EXIT_FAILURE);
+        }
+        if (shards > LOGGER_PRODUCERS) {
+            // A shard without a producer would only be started and supervised for nothing
+            fprintf(stderr, "[P1 Warning]: Only %d producers, starting %d logger shards instead of %ld.\n",
+                    LOGGER_PRODUCERS, LOGGER_PRODUCERS, shards);
+            shards = LOGGER_PRODUCERS;
+        }
+        logger_shard_count = (int)shards;
+    }
+    pacer_t rate_check;
+    if (common_rate_spec[0] != '\0' && pacer_init(&rate_check, common_rate_spec) == -1) {
+        fprintf(stderr, "[P1 Error]: Invalid rate spec '%s' (e.g. 500ms, 2000msg/s,burst=50, 1MB/s).\n", common_rate_spec);
         exit(EXIT_FAILURE);
     }
-    log_filename_arg = argv[1]; // Store log filename
-
-    // Variables for menu choice
-    int choice;
 
     fprintf(stderr,"Main Process (P1) Started. PID: %d\n", getpid());
     fprintf(stderr,"Process 5 Log File will be: %s\n", log_filename_arg);
+    if (logger_shard_count > 1) {
+        fprintf(stderr,"Logger shards: %d (segments %s.shard0..%d, merge with ./logmerge)\n",
+                logger_shard_count, log_filename_arg, logger_shard_count - 1);
+    }
+    fprintf(stderr,"Transports: P2 %s, P3 %s, P4 %s\n", transport_kind_names[worker_transports[2]],
+            transport_kind_names[worker_transports[3]], transport_kind_names[worker_transports[4]]);
+    for (int process_num = 2; process_num <= 4; process_num++) {
+        const char *spec = worker_configs[control_slot(process_num)].filter_spec;
+        if (spec[0] != '\0') fprintf(stderr,"Filter: P%d sends only %s\n", process_num, spec);
+    }
+    if (worker_configs[0].batch_spec[0] != '\0') {
+        fprintf(stderr,"Send batching: up to %s per batch (records/latency budget)\n", worker_configs[0].batch_spec);
+    }
+    if (pool_size > 0) fprintf(stderr,"Warm pool: %d standby worker(s) per type\n", pool_size);
     fprintf(stderr,"Common parameters for P2/P3/P4 will be requested on first start.\n");
     fflush(stderr);
 
     // Clean up IPC
-    unlink(FIFO_PATH);
-    mq_unlink(MQ_NAME);
-    unlink(SOCKET_PATH);
+    unlink_all_shard_ipc();
 
-    display_menu(); // Display menu once at the beginning
+    // Control block for live reconfiguration of running workers
+    control = control_map(1);
+    if (control == NULL) {
+        perror("[P1 Warning]: Failed to create control block, live reconfiguration disabled");
+    }
+
+    // Activation messages go over pipes, a dead standby must not kill P1
+    signal(SIGPIPE, SIG_IGN);
+    // Children are reaped as soon as they exit, the menu waits on stdin and the self-pipe
+    supervisor_fd = supervisor_init();
+    if (supervisor_fd == -1) {
+        perror("[P1 Warning]: Failed to install the SIGCHLD supervisor, crashed children are not restarted");
+    }
+    setvbuf(stdin, NULL, _IONBF, 0);
+    if (pool_size > 0) {
+        // The loggers start now, so the first worker start pays neither for them nor for a spawn
+        ensure_p5_running();
+        for (int process_num = 2; process_num <= 4; process_num++) {
+            worker_pools[process_num].size = pool_size;
+            fill_worker_pool(process_num);
+        }
+    }
 
-    while (1) {
+    // Control socket and termination signals (the socket is served from the menu's select loop)
+    if (ctl_socket_path) {
+        ctl_listen_fd = ctl_listen(ctl_socket_path, ctl_clients);
+        if (ctl_listen_fd == -1) {
+            fprintf(stderr, "[P1 Error]: Cannot listen on control socket %s: %s\n", ctl_socket_path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        fprintf(stderr,"[P1 Info]: Control socket: %s\n", ctl_socket_path);
+    }
+    struct sigaction term_action;
+    memset(&term_action, 0, sizeof(term_action));
+    term_action.sa_handler = terminate_handler; // No SA_RESTART: select() returns at once
+    sigaction(SIGTERM, &term_action, NULL);
+    if (!menu_enabled) sigaction(SIGINT, &term_action, NULL);
+
+    // Batch mode: the script runs before the menu or the socket take over
+    int script_failures = script_path ? run_script(script_path) : 0;
+    if (script_path && strcmp(script_path, "-") == 0 && menu_enabled) {
+        menu_enabled = 0; // The script consumed stdin
+        if (!exit_requested && ctl_listen_fd == -1) menu_command("shutdown");
+    }
+
+    if (menu_enabled && !exit_requested) display_menu(); // Display menu once at the beginning
+
+    while (!exit_requested) {
         // Prompt on stdout
         fflush(stdout);
 
-        // Read menu choice
-        if (scanf("%d", &choice) != 1) {
+        // Wait for a menu choice (control socket commands and failed children are handled meanwhile)
+        if (!wait_for_input()) break;
+        int choice;
+        int scanned = scanf("%d", &choice);
+        if (scanned == EOF) {
+            // No more menu input: a control socket keeps P1 running, otherwise it shuts down
+            menu_enabled = 0;
+            fprintf(stderr, "\n[P1 Info]: Menu input closed.\n");
+            if (ctl_listen_fd == -1) menu_command("shutdown");
+            continue;
+        }
+        if (scanned != 1) {
             fprintf(stderr, "\n[P1 Error]: Invalid input. Please enter a number.\n");
             fflush(stderr);
             int c; while ((c = getchar()) != '\n' && c != EOF);
@@ -202,148 +1330,48 @@ int main(int argc, char *argv[]) {
 
         // --- Check if common parameters need to be set before starting P2/P3/P4 ---
         if ((choice >= 1 && choice <= 3) && common_params_set == 0) {
-            // Call the function to get parameters ONLY if the flag is not set
             get_common_child_params();
-            // Need to show P1 prompt again after getting params
             printf("\n[P1 Menu]: ");
             fflush(stdout);
-            // Reread choice, because user might have changed their mind,
-            // or just hit enter after param input. Simplest is to just loop again.
-            // Alternatively, assume the original choice is still valid.
-            // Let's assume the original choice is valid for now.
         }
 
-        // Process the choice
+        // Process the choice: each one is a command, as a control client would send it
         switch (choice) {
             case 1: // Start P2
-                if (pid_p2 > 0) {
-                    fprintf(stderr,"[P1 Info]: Process 2 is already running (PID: %d).\n", pid_p2); fflush(stderr);
-                } else if (common_params_set == 0) { // Should not happen if check above works, but safety check
-                    fprintf(stderr,"[P1 Error]: Cannot start P2, common parameters not set yet (should have been prompted).\n"); fflush(stderr);
-                } else { // Parameters are set, proceed
-                    ensure_p5_running();
-                    if (pid_p5 > 0 || running_children_count > 0) {
-                        fprintf(stderr,"[P1 Info]: Starting Process 2 with common parameters...\n"); fflush(stderr);
-                        pid_p2 = fork();
-                        if (pid_p2 == -1) { perror("[P1 Error]: Failed to fork Process 2"); }
-                        else if (pid_p2 == 0) {
-                            execlp("./process2", "process2",
-                                   common_text_color, common_bg_color, common_pause_ms_str,
-                                   FIFO_PATH, (char *)NULL);
-                            perror("[P1 Error]: Failed to exec Process 2");
-                            exit(EXIT_FAILURE);
-                        } else {
-                            fprintf(stderr,"[P1 Info]: Process 2 started with PID: %d\n", pid_p2); fflush(stderr);
-                            running_children_count++;
-                        }
-                    } else {
-                        fprintf(stderr,"[P1 Error]: Prerequisite Process 5 is not running. Cannot start Process 2.\n"); fflush(stderr);
-                    }
-                }
-                break;
-
             case 2: // Start P3
-                if (pid_p3 > 0) {
-                    fprintf(stderr,"[P1 Info]: Process 3 is already running (PID: %d).\n", pid_p3); fflush(stderr);
-                } else if (common_params_set == 0) {
-                    fprintf(stderr,"[P1 Error]: Cannot start P3, common parameters not set yet (should have been prompted).\n"); fflush(stderr);
-                } else {
-                    ensure_p5_running();
-                    if (pid_p5 > 0 || running_children_count > 0) {
-                        fprintf(stderr,"[P1 Info]: Starting Process 3 with common parameters...\n"); fflush(stderr);
-                        pid_p3 = fork();
-                        if (pid_p3 == -1) { perror("[P1 Error]: Failed to fork Process 3"); }
-                        else if (pid_p3 == 0) {
-                            execlp("./process3", "process3",
-                                   common_text_color, common_bg_color, common_pause_ms_str,
-                                   MQ_NAME, (char *)NULL);
-                            perror("[P1 Error]: Failed to exec Process 3");
-                            exit(EXIT_FAILURE);
-                        } else {
-                            fprintf(stderr,"[P1 Info]: Process 3 started with PID: %d\n", pid_p3); fflush(stderr);
-                            running_children_count++;
-                        }
-                    } else {
-                        fprintf(stderr,"[P1 Error]: Prerequisite Process 5 is not running. Cannot start Process 3.\n");
-                        fflush(stderr);
-                        display_menu();
-                        fflush(stderr);
-                    }
-                }
-                break;
-
             case 3: // Start P4
-                if (pid_p4 > 0) {
-                    fprintf(stderr,"[P1 Info]: Process 4 is already running (PID: %d).\n", pid_p4); fflush(stderr);
-                } else if (common_params_set == 0) {
-                    fprintf(stderr,"[P1 Error]: Cannot start P4, common parameters not set yet (should have been prompted).\n"); fflush(stderr);
-                } else {
-                    ensure_p5_running();
-                    if (pid_p5 > 0 || running_children_count > 0) {
-                        fprintf(stderr,"[P1 Info]: Starting Process 4 with common parameters...\n"); fflush(stderr);
-                        pid_p4 = fork();
-                        if (pid_p4 == -1) { perror("[P1 Error]: Failed to fork Process 4"); }
-                        else if (pid_p4 == 0) {
-                            execlp("./process4", "process4",
-                                   common_text_color, common_bg_color, common_pause_ms_str,
-                                   SOCKET_PATH, (char *)NULL);
-                            perror("[P1 Error]: Failed to exec Process 4");
-                            exit(EXIT_FAILURE);
-                        } else {
-                            fprintf(stderr,"[P1 Info]: Process 4 started with PID: %d\n", pid_p4); fflush(stderr);
-                            running_children_count++;
-                        }
-                    } else {
-                        fprintf(stderr,"[P1 Error]: Prerequisite Process 5 is not running. Cannot start Process 4.\n"); fflush(stderr);
-                    }
-                }
+                menu_command("start %d", choice + 1);
                 break;
-
             case 4: // Stop P2
-                stop_process(&pid_p2, 2);
+            case 5: // Stop P3
+            case 6: // Stop P4
+                menu_command("stop %d", choice - 2);
                 fprintf(stderr,"----------------------------------------\n");
                 display_menu();
                 break;
-            case 5: // Stop P3
-                stop_process(&pid_p3, 3);
+            case 7: // Exit
+                menu_command("exit");
+                break;
+            case 8: // Live reconfiguration
+                reconfigure_workers();
                 fprintf(stderr,"----------------------------------------\n");
                 display_menu();
                 break;
-            case 6: // Stop P4
-                stop_process(&pid_p4, 4);
-                fprintf(stderr,"----------------------------------------\n");
+            case 9: // Status of the children, restarts and recovery times
+                show_status();
                 display_menu();
                 break;
-
-            case 7: // Exit
-                if (running_children_count > 0 || pid_p5 > 0) {
-                    fprintf(stderr, "[P1 Error]: Cannot exit. Stop all other processes first (P2, P3, P4).\n");
-                    // ... (print running processes using stderr) ...
-                    if (pid_p2 > 0) fprintf(stderr," - P2 (PID %d) is running.\n", pid_p2);
-                    if (pid_p3 > 0) fprintf(stderr," - P3 (PID %d) is running.\n", pid_p3);
-                    if (pid_p4 > 0) fprintf(stderr," - P4 (PID %d) is running.\n", pid_p4);
-                    if (pid_p5 > 0 && running_children_count > 0) fprintf(stderr," - P5 (PID %d) is running (required by P2/P3/P4).\n", pid_p5);
-                    else if (pid_p5 > 0) fprintf(stderr," - P5 (PID %d) is running (should stop soon).\n", pid_p5);
-                    fflush(stderr);
-                } else {
-                    fprintf(stderr,"[P1 Info]: Exiting Main Process (P1).\n"); fflush(stderr);
-                    unlink(FIFO_PATH);
-                    mq_unlink(MQ_NAME);
-                    unlink(SOCKET_PATH);
-                    return 0; // Exit
-                }
+            case 10: // Hitless logger upgrade
+                menu_command("upgrade");
+                display_menu();
                 break;
             default:
                 fprintf(stderr, "[P1 Error]: Invalid choice (%d). Please try again.\n", choice); fflush(stderr);
                 display_menu(); // Show menu on invalid choice
                 break;
         }
-
-        // --- Връщаме паузата в края на цикъла на P1 ---
-        struct timespec ts = {0, 50 * 1000000}; // 50 ms пауза
-        nanosleep(&ts, NULL);
-
     } // end while
 
-    return 0; // Should not reach here
+    shutdown_p1();
+    return script_failures > 0 ? EXIT_FAILURE : 0;
 }
\ No newline at end of file
@@ -1,5 +1,11 @@
 #define _POSIX_C_SOURCE 200809L // For nanosleep
 #include "common.h"
+#include "record.h"
+#include "pacer.h"
+#include "control.h"
+#include "transport.h"
+#include "worker.h"
+#include "pool.h"
 #include <signal.h>
 #include <time.h>
 #include <mqueue.h>
@@ -22,87 +28,172 @@ void reset_colors() {
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 5) {
-        fprintf(stderr, "\nUsage: %s <text_color_code> <bg_color_code> <pause_ms> <mq_name>\n", argv[0]);
+    // "-s <fd>": standby worker of P1's warm pool, activated through <fd> (see pool.h)
+    int standby_fd = -1;
+    int trace_every = 0; // "-T N": sample every Nth record for P5's trace (see trace.h)
+    int opt;
+    while ((opt = getopt(argc, argv, "s:T:")) != -1) {
+        if (opt == 's') standby_fd = (int)strtol(optarg, NULL, 10);
+        if (opt == 'T') trace_every = (int)strtol(optarg, NULL, 10);
+    }
+    if (argc - optind != 4 && argc - optind != 5) {
+        fprintf(stderr, "\nUsage: %s [-s activation_fd] [-T trace_every] <text_color_code> <bg_color_code> <pause_ms> <[kind:]endpoint> [rate_spec]\n", argv[0]);
         exit(EXIT_FAILURE);
     }
+    char **args = argv + optind - 1; // args[1..5] are the positional arguments
 
-    snprintf(text_color_code, sizeof(text_color_code), "\x1B[%sm", argv[1]);
-    snprintf(bg_color_code, sizeof(bg_color_code), "\x1B[%sm", argv[2]);
+    snprintf(text_color_code, sizeof(text_color_code), "\x1B[%sm", args[1]);
+    snprintf(bg_color_code, sizeof(bg_color_code), "\x1B[%sm", args[2]);
 
-    long pause_ms_long = strtol(argv[3], NULL, 10);
+    long pause_ms_long = strtol(args[3], NULL, 10);
     if (pause_ms_long <= 0) {
         fprintf(stderr, "\nInvalid pause time (must be > 0).\n");
         exit(EXIT_FAILURE);
     }
-    struct timespec pause_duration = {pause_ms_long / 1000, (pause_ms_long % 1000) * 1000000};
+    // Token-bucket pacing: the optional rate spec overrides the whole-ms pause
+    char default_rate_spec[32];
+    snprintf(default_rate_spec, sizeof(default_rate_spec), "%ldms", pause_ms_long);
+    const char *rate_spec = argc - optind == 5 ? args[5] : default_rate_spec;
+    pacer_t pacer;
+    if (pacer_init(&pacer, rate_spec) == -1) {
+        fprintf(stderr, "\nInvalid rate spec '%s' (e.g. 500ms, 2000msg/s,burst=50, 1MB/s).\n", rate_spec);
+        exit(EXIT_FAILURE);
+    }
 
-    const char *mq_name = argv[4];
-    mqd_t mq_desc;
-    char buffer[MAX_MSG_SIZE];
+    // Live configuration published by P1 (optional, runs with argv config without it)
+    control_block_t *control = control_map(0);
+    unsigned int control_seen_version = 0;
+    unsigned long control_applied_generation = 0;
+    worker_filter_t filter; // P1's filter/sampling spec arrives with the live config
+    filter_init(&filter, 3);
+    send_batch_t batch; // Adaptive send batching, configured like the filter
+    send_batch_init(&batch);
+    worker_input_t input;
+    worker_input_init(&input, STDIN_FILENO);
+
+    // Channel to P5, message queue unless P1 picked another kind ("shm:/proc3_shm")
+    transport_t channel;
+    transport_kind_t channel_kind;
+    char channel_name[MAX_PATH_LEN];
+    if (transport_parse_endpoint(args[4], TRANSPORT_MQ, &channel_kind, channel_name, sizeof(channel_name)) == -1) {
+        fprintf(stderr, "\nInvalid endpoint '%s' (kinds: fifo, mq, stream, seqpacket, shm).\n", args[4]);
+        exit(EXIT_FAILURE);
+    }
+    unsigned long long send_seq = 0; // Per-producer sequence number for the record stamp
+    log_record_t record;
+    memset(&record, 0, sizeof(record));
 
     struct sigaction action;
     memset(&action, 0, sizeof(action));
     action.sa_handler = sigterm_handler;
     sigaction(SIGTERM, &action, NULL);
+    // Ignore SIGPIPE, handle write errors instead
+    signal(SIGPIPE, SIG_IGN);
+
+    // A standby connects early where the transport allows a second producer,
+    // then waits for P1 to activate it with the real parameters
+    int connected = 0;
+    unsigned long long activation_ns = 0;
+    if (standby_fd != -1) {
+        pool_activation_t activation;
+        if (pool_can_preconnect(channel_kind)) {
+            connected = transport_connect(&channel, channel_kind, 3, channel_name, &terminate_flag) == 0;
+        }
+        if (pool_await_activation(standby_fd, &activation, &terminate_flag) == -1) {
+            if (connected) transport_close(&channel);
+            control_unmap(control);
+            return 0; // Pool drained before this worker was needed
+        }
+        pool_apply_activation(&activation, &pacer, text_color_code, sizeof(text_color_code),
+                              bg_color_code, sizeof(bg_color_code), 3);
+        activation_ns = monotonic_ns() - activation.requested_ns;
+    }
 
     set_colors();
-    printf("\nProcess 3 (PID: %d) Started. Reading Floats. MQ: %s\n", getpid(), mq_name);
+    printf("\nProcess 3 (PID: %d) Started. Reading Floats. %s: %s\n", getpid(),
+           transport_kind_names[channel_kind], channel_name);
+    if (standby_fd != -1) printf("Process 3: Activated from the warm pool after %.1f us.\n", (double)activation_ns / 1e3);
     reset_colors();
     fflush(stdout);
 
-    // Open Message Queue for writing - P5 should have created it
-    mq_desc = mq_open(mq_name, O_WRONLY);
-    if (mq_desc == (mqd_t)-1) {
+    // Connect to the channel P5 created (a pre-connected standby already is)
+    if (!connected && transport_connect(&channel, channel_kind, 3, channel_name, &terminate_flag) == -1) {
         set_colors();
-        perror("\nProcess 3: Failed to open message queue\n");
+        perror("\nProcess 3: Failed to connect to P5\n");
         reset_colors();
         exit(EXIT_FAILURE);
     }
 
+    int prompt = 1; // 0 while a batch flush interrupted the wait for the same line
     while (!terminate_flag) {
-        double value;
-        set_colors();
-        printf("\nProcess 3: Enter a float: ");
-        reset_colors();
-        fflush(stdout);
+        // Pick up a new config from P1 on the loop boundary (one atomic load if unchanged)
+        worker_config_t live_config;
+        if (control_poll(control, 3, &control_seen_version, &live_config) &&
+            live_config.generation != 0 && live_config.generation != control_applied_generation) {
+            control_apply_worker_config(&live_config, &pacer, &filter, &batch, text_color_code, sizeof(text_color_code),
+                                        bg_color_code, sizeof(bg_color_code), 3);
+            control_applied_generation = live_config.generation;
+        }
+
+        char line[WORKER_INPUT_MAX];
+        int parsed = 0;
+        if (prompt) {
+            set_colors();
+            printf("\nProcess 3: Enter a float: ");
+            reset_colors();
+            fflush(stdout);
+        }
 
-        if (scanf("%lf", &value) == 1) {
-            int c;
-            while ((c = getchar()) != '\n' && c != EOF);
-
-            snprintf(buffer, sizeof(buffer), "3: %lf", value);
-            // No need for newline here, P5 adds it from the message format
-
-            if (mq_send(mq_desc, buffer, strlen(buffer) + 1, 0) == -1) { // Send null terminator too? Check P5's receive
-                set_colors();
-                perror("\nProcess 3: Failed to send message\n");
-                reset_colors();
-                // Check if queue is full (errno == EAGAIN if non-blocking, but we are blocking)
-                // or if queue was closed. Assume closed on error for simplicity.
-                terminate_flag = 1;
-            } else {
-                nanosleep(&pause_duration, NULL);
+        // A pending batch bounds the wait for input: its oldest value is sent when due
+        int have_line = worker_input_line(&input, line, sizeof(line), send_batch_wait_ns(&batch, monotonic_ns()));
+        if (have_line == -1) {
+            worker_flush_batch(&channel, &batch, SEND_FLUSH_BUDGET, 3, &terminate_flag);
+            prompt = 0; // Still waiting for the line prompted for
+            continue;
+        }
+        prompt = 1;
+        unsigned long long read_ns = trace_every > 0 ? monotonic_ns() : 0;
+        if (!have_line) {
+            set_colors();
+            fprintf(stderr, "\nProcess 3: Input stream error or EOF reached. Terminating.\n");
+            reset_colors();
+            terminate_flag = 1;
+        } else if ((parsed = worker_parse_value(3, line, &record)) == 1) {
+            // Dropped by P1's filter/sampling spec: never stamped, paced or sent
+            if (!filter_accept(&filter, &record)) continue;
+            // Sent as a binary record: the exact double, not "%lf" rounded to six decimals
+            worker_stamp(&record, &send_seq);
+            worker_trace(&record, read_ns, trace_every);
+
+            // Wait for the token bucket before sending (replaces the fixed pause);
+            // a pending batch goes out first if the wait would make it late
+            size_t cost = sizeof(wire_header_t);
+            if (batch.count > 0 && (long long)pacer_wait_ns(&pacer, cost) > send_batch_wait_ns(&batch, monotonic_ns())) {
+                worker_flush_batch(&channel, &batch, SEND_FLUSH_PACE, 3, &terminate_flag);
             }
-        } else {
+            pacer_acquire(&pacer, cost, &terminate_flag);
+
+            // Sent at once at low rates, collected into a batch under load (see sendbatch.h)
+            if (send_batch_add(&batch, &record, monotonic_ns())) {
+                worker_flush_batch(&channel, &batch, SEND_FLUSH_FULL, 3, &terminate_flag);
+            }
+        } else if (parsed == 0) {
             set_colors();
             fprintf(stderr, "\nProcess 3: Invalid input. Please enter a float.\n");
             reset_colors();
-            int c;
-            while ((c = getchar()) != '\n' && c != EOF);
-            if (feof(stdin) || ferror(stdin)) {
-                set_colors();
-                fprintf(stderr, "\nProcess 3: Input stream error or EOF reached. Terminating.\n");
-                reset_colors();
-                terminate_flag = 1;
-            }
         }
         fflush(stdout);
     }
 
     // Cleanup
-    mq_close(mq_desc);
+    worker_flush_batch(&channel, &batch, SEND_FLUSH_EXIT, 3, &terminate_flag);
+    transport_close(&channel);
     set_colors();
+    control_unmap(control);
+    filter_report(&filter, stdout, 3);
+    send_batch_report(&batch, stdout, 3);
+    pacer_report(&pacer, stdout, 3);
+    transport_report(&channel, stdout, 3);
     printf("\nProcess 3 (PID: %d) Finishing.\n", getpid());
     reset_colors();
     fflush(stdout);
@@ -1,5 +1,11 @@
 #define _POSIX_C_SOURCE 200809L // For nanosleep
 #include "common.h"
+#include "record.h"
+#include "pacer.h"
+#include "control.h"
+#include "transport.h"
+#include "worker.h"
+#include "pool.h"
 #include <signal.h>
 #include <time.h>
 #include <sys/socket.h>
@@ -24,26 +30,61 @@ void reset_colors() {
 
 
 int main(int argc, char *argv[]) {
-    if (argc != 5) {
-        fprintf(stderr, "\nUsage: %s <text_color_code> <bg_color_code> <pause_ms> <socket_path>\n", argv[0]);
+    // "-s <fd>": standby worker of P1's warm pool, activated through <fd> (see pool.h)
+    int standby_fd = -1;
+    int trace_every = 0; // "-T N": sample every Nth record for P5's trace (see trace.h)
+    int opt;
+    while ((opt = getopt(argc, argv, "s:T:")) != -1) {
+        if (opt == 's') standby_fd = (int)strtol(optarg, NULL, 10);
+        if (opt == 'T') trace_every = (int)strtol(optarg, NULL, 10);
+    }
+    if (argc - optind != 4 && argc - optind != 5) {
+        fprintf(stderr, "\nUsage: %s [-s activation_fd] [-T trace_every] <text_color_code> <bg_color_code> <pause_ms> <[kind:]endpoint> [rate_spec]\n", argv[0]);
         exit(EXIT_FAILURE);
     }
+    char **args = argv + optind - 1; // args[1..5] are the positional arguments
 
-    snprintf(text_color_code, sizeof(text_color_code), "\x1B[%sm", argv[1]);
-    snprintf(bg_color_code, sizeof(bg_color_code), "\x1B[%sm", argv[2]);
+    snprintf(text_color_code, sizeof(text_color_code), "\x1B[%sm", args[1]);
+    snprintf(bg_color_code, sizeof(bg_color_code), "\x1B[%sm", args[2]);
 
-    long pause_ms_long = strtol(argv[3], NULL, 10);
+    long pause_ms_long = strtol(args[3], NULL, 10);
     if (pause_ms_long <= 0) {
         fprintf(stderr, "\nInvalid pause time (must be > 0).\n");
         exit(EXIT_FAILURE);
     }
-    struct timespec pause_duration = {pause_ms_long / 1000, (pause_ms_long % 1000) * 1000000};
+    // Token-bucket pacing: the optional rate spec overrides the whole-ms pause
+    char default_rate_spec[32];
+    snprintf(default_rate_spec, sizeof(default_rate_spec), "%ldms", pause_ms_long);
+    const char *rate_spec = argc - optind == 5 ? args[5] : default_rate_spec;
+    pacer_t pacer;
+    if (pacer_init(&pacer, rate_spec) == -1) {
+        fprintf(stderr, "\nInvalid rate spec '%s' (e.g. 500ms, 2000msg/s,burst=50, 1MB/s).\n", rate_spec);
+        exit(EXIT_FAILURE);
+    }
 
-    const char *socket_path = argv[4];
-    int sock_fd;
-    struct sockaddr_un server_addr;
-    char input_buffer[MAX_MSG_SIZE - 10]; // Leave space for prefix "4: \n"
-    char send_buffer[MAX_MSG_SIZE];
+    // Live configuration published by P1 (optional, runs with argv config without it)
+    control_block_t *control = control_map(0);
+    unsigned int control_seen_version = 0;
+    unsigned long control_applied_generation = 0;
+    worker_filter_t filter; // P1's filter/sampling spec arrives with the live config
+    filter_init(&filter, 4);
+    send_batch_t batch; // Adaptive send batching, configured like the filter
+    send_batch_init(&batch);
+    worker_input_t input;
+    worker_input_init(&input, STDIN_FILENO);
+
+    // Channel to P5, stream socket unless P1 picked another kind ("seqpacket:/tmp/proc4_socket")
+    transport_t channel;
+    transport_kind_t channel_kind;
+    char channel_name[MAX_PATH_LEN];
+    if (transport_parse_endpoint(args[4], TRANSPORT_STREAM, &channel_kind, channel_name, sizeof(channel_name)) == -1) {
+        fprintf(stderr, "\nInvalid endpoint '%s' (kinds: fifo, mq, stream, seqpacket, shm).\n", args[4]);
+        exit(EXIT_FAILURE);
+    }
+    char input_buffer[WORKER_INPUT_MAX]; // Leave space for the wire header
+    unsigned long long send_seq = 0; // Per-producer sequence number for the record stamp
+    log_record_t record;
+    memset(&record, 0, sizeof(record));
 
     struct sigaction action;
     memset(&action, 0, sizeof(action));
@@ -53,67 +94,92 @@ int main(int argc, char *argv[]) {
     signal(SIGPIPE, SIG_IGN);
 
 
+    // A standby connects early where the transport allows a second producer,
+    // then waits for P1 to activate it with the real parameters
+    int connected = 0;
+    unsigned long long activation_ns = 0;
+    if (standby_fd != -1) {
+        pool_activation_t activation;
+        if (pool_can_preconnect(channel_kind)) {
+            connected = transport_connect(&channel, channel_kind, 4, channel_name, &terminate_flag) == 0;
+        }
+        if (pool_await_activation(standby_fd, &activation, &terminate_flag) == -1) {
+            if (connected) transport_close(&channel);
+            control_unmap(control);
+            return 0; // Pool drained before this worker was needed
+        }
+        pool_apply_activation(&activation, &pacer, text_color_code, sizeof(text_color_code),
+                              bg_color_code, sizeof(bg_color_code), 4);
+        activation_ns = monotonic_ns() - activation.requested_ns;
+    }
+
     set_colors();
-    printf("\nProcess 4 (PID: %d) Started. Reading Strings. Socket: %s\n", getpid(), socket_path);
+    printf("\nProcess 4 (PID: %d) Started. Reading Strings. %s: %s\n", getpid(),
+           transport_kind_names[channel_kind], channel_name);
+    if (standby_fd != -1) printf("Process 4: Activated from the warm pool after %.1f us.\n", (double)activation_ns / 1e3);
     reset_colors();
     fflush(stdout);
 
-    // Create socket
-    sock_fd = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (sock_fd == -1) {
+    // Connect to the channel P5 created (a pre-connected standby already is)
+    if (!connected && transport_connect(&channel, channel_kind, 4, channel_name, &terminate_flag) == -1) {
         set_colors();
-        perror("\nProcess 4: Failed to create socket\n");
+        perror("\nProcess 4: Failed to connect to P5\n");
         reset_colors();
+        transport_close(&channel);
         exit(EXIT_FAILURE);
     }
 
-    // Set up server address structure
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sun_family = AF_UNIX;
-    strncpy(server_addr.sun_path, socket_path, sizeof(server_addr.sun_path) - 1);
+    int prompt = 1; // 0 while a batch flush interrupted the wait for the same line
+    while (!terminate_flag) {
+        // Pick up a new config from P1 on the loop boundary (one atomic load if unchanged)
+        worker_config_t live_config;
+        if (control_poll(control, 4, &control_seen_version, &live_config) &&
+            live_config.generation != 0 && live_config.generation != control_applied_generation) {
+            control_apply_worker_config(&live_config, &pacer, &filter, &batch, text_color_code, sizeof(text_color_code),
+                                        bg_color_code, sizeof(bg_color_code), 4);
+            control_applied_generation = live_config.generation;
+        }
 
-    // Connect to P5's socket
-    if (connect(sock_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) == -1) {
-        set_colors();
-        perror("\nProcess 4: Failed to connect to socket\n");
-        reset_colors();
-        close(sock_fd);
-        exit(EXIT_FAILURE);
-    }
+        if (prompt) {
+            set_colors();
+            printf("\nProcess 4: Enter a string: ");
+            reset_colors();
+            fflush(stdout);
+        }
 
-    while (!terminate_flag) {
-        set_colors();
-        struct timespec extra_delay = {0, 1 * 1000000}; // Example: 100ms extra delay
-        nanosleep(&extra_delay, NULL);
-        printf("\nProcess 4: Enter a string: ");
-        reset_colors();
-        fflush(stdout);
+        // A pending batch bounds the wait for input: its oldest value is sent when due
+        int have_line = worker_input_line(&input, input_buffer, sizeof(input_buffer), send_batch_wait_ns(&batch, monotonic_ns()));
+        if (have_line == -1) {
+            worker_flush_batch(&channel, &batch, SEND_FLUSH_BUDGET, 4, &terminate_flag);
+            prompt = 0; // Still waiting for the line prompted for
+            continue;
+        }
+        prompt = 1;
+        unsigned long long read_ns = trace_every > 0 ? monotonic_ns() : 0;
+        if (have_line) {
+            // Sent as a binary record: header plus the string bytes
+            worker_parse_value(4, input_buffer, &record); // Any line is a valid string
+            // Dropped by P1's filter/sampling spec: never stamped, paced or sent
+            if (!filter_accept(&filter, &record)) continue;
+            worker_stamp(&record, &send_seq);
+            worker_trace(&record, read_ns, trace_every);
+
+            // Wait for the token bucket before sending (replaces the fixed pause);
+            // a pending batch goes out first if the wait would make it late
+            size_t cost = sizeof(wire_header_t) + strlen(record.text);
+            if (batch.count > 0 && (long long)pacer_wait_ns(&pacer, cost) > send_batch_wait_ns(&batch, monotonic_ns())) {
+                worker_flush_batch(&channel, &batch, SEND_FLUSH_PACE, 4, &terminate_flag);
+            }
+            pacer_acquire(&pacer, cost, &terminate_flag);
 
-        if (fgets(input_buffer, sizeof(input_buffer), stdin) != NULL) {
-            // Remove trailing newline if present
-            input_buffer[strcspn(input_buffer, "\n")] = 0;
-
-            snprintf(send_buffer, sizeof(send_buffer), "4: %s\n", input_buffer);
-
-            if (send(sock_fd, send_buffer, strlen(send_buffer), 0) == -1) {
-                if (errno == EPIPE) {
-                    set_colors();
-                    fprintf(stderr, "\nProcess 4: Socket connection closed by P5. Terminating.\n");
-                    reset_colors();
-                    terminate_flag = 1; // Stop the loop
-                } else {
-                    set_colors();
-                    perror("\nProcess 4: Failed to send data\n");
-                    reset_colors();
-                    terminate_flag = 1; // Terminate on other send errors too
-                }
-            } else {
-                nanosleep(&pause_duration, NULL);
+            // Sent at once at low rates, collected into a batch under load (see sendbatch.h)
+            if (send_batch_add(&batch, &record, monotonic_ns())) {
+                worker_flush_batch(&channel, &batch, SEND_FLUSH_FULL, 4, &terminate_flag);
             }
 
         } else {
             // Handle input error or EOF
-            if (feof(stdin)) {
+            if (input.eof) {
                 set_colors();
                 printf("\nProcess 4: EOF detected on input. Terminating.\n");
                 reset_colors();
@@ -128,8 +194,14 @@ int main(int argc, char *argv[]) {
     }
 
     // Cleanup
-    close(sock_fd);
+    worker_flush_batch(&channel, &batch, SEND_FLUSH_EXIT, 4, &terminate_flag);
+    transport_close(&channel);
     set_colors();
+    control_unmap(control);
+    filter_report(&filter, stdout, 4);
+    send_batch_report(&batch, stdout, 4);
+    pacer_report(&pacer, stdout, 4);
+    transport_report(&channel, stdout, 4);
     printf("\nProcess 4 (PID: %d) Finishing.\n", getpid());
     reset_colors();
     fflush(stdout);
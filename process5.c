@@ -7,84 +7,260 @@
 #include <sys/un.h>
 #include <errno.h>
 #include <fcntl.h> // For O_NONBLOCK
+#include "record.h"
+#include "logger.h"
+#include "transport.h"
+#include "handoff.h"
+#include "busypoll.h"
 
 volatile sig_atomic_t terminate_flag = 0;
-FILE *log_fp = NULL;
 
-// IPC Descriptors
-int fifo_fd = -1;
-mqd_t mq_desc = (mqd_t)-1;
-int listen_sock_fd = -1;
-int client_sock_fd = -1; // Only one client (P4) expected
+// Channels, one per producer (sources 2, 3, 4); the kind of each is picked
+// at runtime (-t, see transport.h), names are derived from the shard index
+int shard_index = 0;
+transport_kind_t channel_kinds[TRANSPORT_MAX_SOURCE + 1];
+transport_t channels[3];
+#define CHANNEL_COUNT 3
 
-// IPC Paths/Names
-const char *fifo_path = FIFO_PATH;
-const char *mq_name = MQ_NAME;
-const char *socket_path = SOCKET_PATH;
+// Shutdown drain
+long drain_deadline_ms = 2000;        // Max time spent reading channels dry after SIGTERM
+
+// Hitless upgrade (handoff.h): a successor takes the channels over
+int takeover = 0;                     // -u: start from the running instance's channels
+int handoff_fd = -1;                  // Listening for a successor
+int handed_off = 0;                   // Channels now belong to the successor
+char handoff_name[MAX_PATH_LEN];
+
+// Busy polling (-b, busypoll.h) and the delivery latency it buys
+busy_poll_t busy_poll;                // idle_ns == 0: always block in pselect()
+unsigned long long delivery_total_ns = 0; // Producer stamp -> read by P5
+unsigned long long delivery_max_ns = 0;
+unsigned long long delivery_count = 0;
+
+// Sampled tracing (-T, trace.h): SIGUSR1 exports the spans so far
+volatile sig_atomic_t trace_export_flag = 0;
 
 void sigterm_handler(int signum) {
     (void)signum; // Explicitly mark signum as unused
     terminate_flag = 1;
 }
 
+void sigusr1_handler(int signum) {
+    (void)signum;
+    trace_export_flag = 1;
+}
+
+// --- Write the trace file, reporting where it went ---
+void export_trace() {
+    long spans = trace_export();
+    if (spans == -1) perror("\nProcess 5: Failed to write trace file\n");
+    else printf("\nProcess 5: Exported %ld trace spans to %s\n", spans, trace_ring.path);
+    fflush(stdout);
+}
+
+// --- Delivery from the event loop: measure the producer -> P5 latency ---
+void deliver_record(const log_record_t *rec) {
+    if (rec->stamped) {
+        unsigned long long now = monotonic_ns();
+        unsigned long long latency = now > rec->stamp.ts_ns ? now - rec->stamp.ts_ns : 0;
+        delivery_total_ns += latency;
+        if (latency > delivery_max_ns) delivery_max_ns = latency;
+        delivery_count++;
+    }
+    ingest_record(rec);
+}
+
 // Function to clean up resources
 void cleanup() {
     printf("\nProcess 5 (PID: %d) Cleaning up...\n", getpid());
-
-    if (log_fp) {
-        fflush(log_fp); // Ensure all data is written
-        fclose(log_fp);
-        log_fp = NULL;
+    if (busy_poll.idle_ns > 0) busy_poll_report(&busy_poll, stdout);
+    if (delivery_count > 0) {
+        printf("\nProcess 5: Delivery latency (producer stamp -> read) avg %.3f us, max %.3f us over %llu records\n",
+               (double)delivery_total_ns / delivery_count / 1e3, (double)delivery_max_ns / 1e3, delivery_count);
     }
 
-    // Close and unlink IPC resources
-    if (fifo_fd != -1) {
-        close(fifo_fd);
-        unlink(fifo_path); // Remove FIFO from filesystem
-        fifo_fd = -1;
-    }
-    if (mq_desc != (mqd_t)-1) {
-        mq_close(mq_desc);
-        mq_unlink(mq_name); // Remove message queue
-        mq_desc = (mqd_t)-1;
+    logger_finish();
+    if (trace_ring.spans) {
+        // After logger_finish(): the records still held have completed their spans
+        trace_report(stdout);
+        export_trace();
+        trace_free();
     }
-    if (client_sock_fd != -1) {
-        close(client_sock_fd);
-        client_sock_fd = -1;
+    if (handoff_fd != -1) {
+        close(handoff_fd);
+        if (!handed_off) unlink(handoff_name); // After a handoff the name is the successor's
     }
-    if (listen_sock_fd != -1) {
-        close(listen_sock_fd);
-        unlink(socket_path); // Remove socket file
-        listen_sock_fd = -1;
+
+    // Close and unlink IPC resources (detached channels are left alone)
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        if (channels[i].source == 0) continue; // Never opened
+        transport_report(&channels[i], stdout, 5);
+        transport_close(&channels[i]);
     }
     printf("\nProcess 5 (PID: %d) Finished.\n", getpid());
     fflush(stdout);
 }
 
 
-// Make descriptor non-blocking
-int make_non_blocking(int fd) {
-    int flags = fcntl(fd, F_GETFL, 0);
-    if (flags == -1) {
-        perror("fcntl(F_GETFL)");
-        return -1;
+// --- Drain phase: stop accepting producers, read everything that is left ---
+// Runs after SIGTERM. The IPC names are removed first so no new producer can
+// connect, the already-open descriptors keep working until every channel is
+// dry or the drain deadline expires. Records are then flushed and fsync'ed.
+void drain_channels() {
+    logger_echo = 0; // Console echo would only slow the drain down
+    unsigned long long received_before = records_received;
+    unsigned long long start = monotonic_ns();
+    unsigned long long deadline = start + (unsigned long long)drain_deadline_ms * 1000000ULL;
+
+    printf("\nProcess 5: Draining channels (deadline %ld ms)...\n", drain_deadline_ms);
+    fflush(stdout);
+
+    // Stop accepting: take over a pending connection, then remove every name
+    int open_flags[CHANNEL_COUNT];
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        transport_stop_accepting(&channels[i]);
+        open_flags[i] = 1;
     }
-    if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
-        perror("fcntl(F_SETFL O_NONBLOCK)");
-        return -1;
+
+    while (monotonic_ns() < deadline) {
+        int any_read = 0;
+        for (int i = 0; i < CHANNEL_COUNT; i++) {
+            if (!open_flags[i]) continue;
+            ssize_t rc = transport_receive_batch(&channels[i], ingest_record);
+            if (rc == -1) open_flags[i] = 0;
+            if (rc > 0) any_read = 1;
+        }
+        // Dry: nothing came in from any channel during this pass
+        if (!any_read) break;
     }
-    return 0;
+
+    // Whatever is still queued past the deadline is lost
+    char lost[256];
+    int lost_len = 0;
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        transport_t *t = &channels[i];
+        lost_len += snprintf(lost + lost_len, sizeof(lost) - (size_t)lost_len, "%s%ld %s %s (P%d)",
+                             i ? ", " : "", open_flags[i] ? transport_pending(t) : 0L,
+                             transport_kind_names[t->kind], transport_pending_unit(t), t->source);
+        if (t->carry_len > 0) transport_decode_stream(t, NULL, 0, ingest_record);
+    }
+
+    flush_reorder(1);
+    if (log_fp) {
+        fflush(log_fp);
+        if (fsync(fileno(log_fp)) == -1) perror("\nProcess 5: fsync of log file failed\n");
+    }
+    sinks_sync();
+
+    printf("\nProcess 5: Drain finished in %.3f ms: %llu records drained, lost %s.\n",
+           (double)(monotonic_ns() - start) / 1e6, records_received - received_before, lost);
+    fflush(stdout);
 }
 
 
+// --- A successor asked for the channels: hand them over and finish ---
+// Reading stops here; once the successor has adopted the channels,
+// everything already read is written to the log before it is told it may append.
+void hand_over_channels() {
+    int conn = accept(handoff_fd, NULL, NULL);
+    if (conn == -1) return;
+    char request = 0;
+    if (read(conn, &request, 1) != 1 || request != HANDOFF_REQUEST) {
+        close(conn);
+        return;
+    }
+    unsigned long long start = monotonic_ns();
+    if (handoff_send_channels(conn, channels, CHANNEL_COUNT) == -1) {
+        perror("\nProcess 5: Handoff failed, keeping the channels\n");
+        close(conn);
+        return;
+    }
+    // Nothing is read until the successor has adopted every channel
+    if (handoff_await_ack(conn, channels, CHANNEL_COUNT) == -1) {
+        perror("\nProcess 5: Successor did not take the channels over, keeping them\n");
+        close(conn);
+        return;
+    }
+    handed_off = 1;
+    terminate_flag = 1;
+    flush_reorder(1);
+    if (log_fp) fflush(log_fp);
+    sinks_sync(); // Routed sinks are appended to by the successor as well
+    char done = HANDOFF_DONE;
+    if (write(conn, &done, 1) != 1) perror("\nProcess 5: Failed to confirm handoff\n");
+    close(conn);
+    if (log_fp && fsync(fileno(log_fp)) == -1) perror("\nProcess 5: fsync of log file failed\n");
+    printf("\nProcess 5 (PID: %d): Channels handed to successor, log released after %.3f ms.\n",
+           getpid(), (double)(monotonic_ns() - start) / 1e6);
+    fflush(stdout);
+}
+
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "\nUsage: %s <log_filename>\n", argv[0]);
+    int opt;
+    transport_parse_map(NULL, channel_kinds); // Historical pairing unless -t says otherwise
+    while ((opt = getopt(argc, argv, "w:n:d:f:a:t:ub:o:T:")) != -1) {
+        switch (opt) {
+            case 'u': // Take the channels over from the running instance of this shard
+                takeover = 1;
+                break;
+            case 't': // Channel kind per producer, e.g. "2=mq,3=shm,4=seqpacket"
+                if (transport_parse_map(optarg, channel_kinds) == -1) {
+                    fprintf(stderr, "\nInvalid transport spec '%s' (e.g. 2=mq,3=shm,4=seqpacket; kinds: fifo, mq, stream, seqpacket, shm).\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'b': // Busy-poll: spin while records arrive, block after this many us without one
+                if (busy_poll_init(&busy_poll, optarg) == -1) {
+                    fprintf(stderr, "\nInvalid busy-poll idle period '%s' (microseconds, 0 = off).\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'T': // Trace the records the workers sample (-T N there), export to this file
+                if (trace_init(optarg) == -1) {
+                    perror("\nProcess 5: Failed to allocate the trace ring\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'd': // Drain deadline on shutdown in milliseconds
+                drain_deadline_ms = strtol(optarg, NULL, 10);
+                break;
+            default:
+                logger_parse_option(opt, optarg); // -w, -n, -f, -a, -o
+                break;
+        }
+    }
+    if (argc - optind != 1 && argc - optind != 2) {
+        fprintf(stderr, "\nUsage: %s [-w reorder_window_ms] [-n reorder_max_records] [-d drain_deadline_ms] [-f text|wal] [-a aggregation_spec] [-t transport_spec] [-o route_spec] [-b busy_poll_idle_us] [-T trace_file] [-u] <log_filename> [shard_index]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (drain_deadline_ms < 0) {
+        fprintf(stderr, "\nInvalid drain deadline (must be >= 0 ms).\n");
         exit(EXIT_FAILURE);
     }
-    const char *log_filename = argv[1];
+    const char *log_filename = argv[optind];
+    if (argc - optind == 2) {
+        shard_index = (int)strtol(argv[optind + 1], NULL, 10);
+        if (shard_index < 0 || shard_index >= MAX_LOGGER_SHARDS) {
+            fprintf(stderr, "\nInvalid shard index (must be 0..%d).\n", MAX_LOGGER_SHARDS - 1);
+            exit(EXIT_FAILURE);
+        }
+        // P1 names the segments of a sharded log "<log>.shardN", routed sinks follow suit
+        char suffix[16];
+        int suffix_len = snprintf(suffix, sizeof(suffix), ".shard%d", shard_index);
+        size_t name_len = strlen(log_filename);
+        if (name_len > (size_t)suffix_len && strcmp(log_filename + name_len - (size_t)suffix_len, suffix) == 0) {
+            logger_sink_shard = shard_index;
+        }
+    }
 
-    printf("\nProcess 5 (PID: %d) Started. Logging to: %s\n", getpid(), log_filename);
+    printf("\nProcess 5 (PID: %d, shard %d) Started. Logging to: %s\n", getpid(), shard_index, log_filename);
+    printf("Process 5: Reorder window %ld ms, up to %ld records.\n", reorder_window_ms, reorder_max_records);
+    if (busy_poll.idle_ns > 0) {
+        printf("Process 5: Busy-polling, blocking after %.3f ms without a record.\n", (double)busy_poll.idle_ns / 1e6);
+    }
+    if (trace_ring.spans) {
+        printf("Process 5: Tracing sampled records into %s (SIGUSR1 exports it now).\n", trace_ring.path);
+    }
     fflush(stdout);
 
     // Register signal handler *before* creating resources
@@ -92,87 +268,55 @@ int main(int argc, char *argv[]) {
     memset(&action, 0, sizeof(action));
     action.sa_handler = sigterm_handler;
     sigaction(SIGTERM, &action, NULL);
+    action.sa_handler = sigusr1_handler;
+    sigaction(SIGUSR1, &action, NULL);
 
     // Setup cleanup function on exit/termination
     atexit(cleanup); // Register cleanup to be called on normal exit
     // Signal handler sets flag, main loop checks flag and calls cleanup
 
 
-    // Open log file in append mode
-    log_fp = fopen(log_filename, "a");
-    if (!log_fp) {
-        perror("\nProcess 5: Failed to open log file\n");
-        exit(EXIT_FAILURE);
-    }
-    if (setvbuf(log_fp, NULL, _IOLBF, 0) != 0) {
-        perror("\nProcess 5: Failed to set line buffering\n");
-        // Decide if this is fatal, maybe exit?
-        // exit(EXIT_FAILURE); // Optional: exit if buffering fails
-    }
-
-
-    // --- Set up IPC mechanisms ---
-
-    // 1. FIFO (for P2)
-    if (mkfifo(fifo_path, 0666) == -1) {
-        if (errno != EEXIST) { // Ignore error if FIFO already exists
-            perror("\nProcess 5: Failed to create FIFO\n");
-            exit(EXIT_FAILURE); // Use atexit cleanup
-        }
-    }
-    fifo_fd = open(fifo_path, O_RDONLY | O_NONBLOCK); // Non-blocking read
-    if (fifo_fd == -1) {
-        perror("\nProcess 5: Failed to open FIFO\n");
-        exit(EXIT_FAILURE);
-    }
-    if (make_non_blocking(fifo_fd) == -1) exit(EXIT_FAILURE);
-
-    // 2. Message Queue (for P3)
-    struct mq_attr attr;
-    attr.mq_flags = 0;
-    attr.mq_maxmsg = MQ_MAX_MSGS;
-    attr.mq_msgsize = MAX_MSG_SIZE;
-    attr.mq_curmsgs = 0;
-    // Open/Create MQ with non-blocking flag
-    mq_desc = mq_open(mq_name, O_CREAT | O_RDONLY | O_NONBLOCK, 0666, &attr);
-    if (mq_desc == (mqd_t)-1) {
-        perror("\nProcess 5: Failed to create/open message queue\n");
-        if (errno == EEXIST) {
-            // Try opening without create if it exists but failed before
-            mq_desc = mq_open(mq_name, O_RDONLY | O_NONBLOCK);
-            if (mq_desc == (mqd_t)-1){
-                perror("\nProcess 5: Failed to open existing message queue\n");
-                exit(EXIT_FAILURE);
-            }
-        } else {
+    // Successor: receive the live channels, then wait until the old instance
+    // has written its last record before appending to the same log
+    handoff_socket_name(shard_index, handoff_name, sizeof(handoff_name));
+    if (takeover) {
+        unsigned long long start = monotonic_ns();
+        int conn = handoff_receive_channels(handoff_name, channels, CHANNEL_COUNT);
+        if (conn == -1) {
+            fprintf(stderr, "\nProcess 5: Takeover from %s failed: %s\n", handoff_name, strerror(errno));
             exit(EXIT_FAILURE);
         }
+        logger_skip_recovery = handoff_wait_done(conn); // Clean release: no torn tail to look for
+        printf("Process 5: Took over the channels in %.3f ms%s.\n", (double)(monotonic_ns() - start) / 1e6,
+               logger_skip_recovery ? "" : " (previous instance did not release the log)");
+        for (int i = 0; i < CHANNEL_COUNT; i++) {
+            channel_kinds[channels[i].source] = channels[i].kind; // The running kinds win over -t
+            printf("Process 5: P%d -> %s %s (taken over)\n", channels[i].source,
+                   transport_kind_names[channels[i].kind], channels[i].name);
+        }
     }
 
-    // 3. Unix Domain Socket (for P4)
-    listen_sock_fd = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (listen_sock_fd == -1) {
-        perror("\nProcess 5: Failed to create socket\n");
-        exit(EXIT_FAILURE);
-    }
-    if (make_non_blocking(listen_sock_fd) == -1) exit(EXIT_FAILURE);
-
+    // Reorder buffer, WAL recovery and the log file itself
+    if (logger_start(log_filename) == -1) exit(EXIT_FAILURE);
 
-    struct sockaddr_un addr;
-    memset(&addr, 0, sizeof(addr));
-    addr.sun_family = AF_UNIX;
-    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
-    unlink(socket_path); // Remove old socket file if it exists
 
-    if (bind(listen_sock_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
-        perror("\nProcess 5: Failed to bind socket\n");
-        exit(EXIT_FAILURE);
+    // --- Set up IPC mechanisms ---
+    // One endpoint per producer, of the kind selected for it
+    for (int i = 0; i < CHANNEL_COUNT && !takeover; i++) {
+        int source = i + 2;
+        char name[MAX_PATH_LEN];
+        transport_endpoint_name(channel_kinds[source], source, shard_index, name, sizeof(name));
+        if (transport_open(&channels[i], channel_kinds[source], source, name) == -1) {
+            fprintf(stderr, "\nProcess 5: Failed to open %s channel %s for P%d: %s\n",
+                    transport_kind_names[channel_kinds[source]], name, source, strerror(errno));
+            exit(EXIT_FAILURE); // Use atexit cleanup
+        }
+        printf("Process 5: P%d -> %s %s\n", source, transport_kind_names[channel_kinds[source]], name);
     }
 
-    if (listen(listen_sock_fd, 1) == -1) { // Listen for 1 connection (P4)
-        perror("\nProcess 5: Failed to listen on socket\n");
-        exit(EXIT_FAILURE);
-    }
+    // Listen for a successor (hitless upgrade, -u)
+    handoff_fd = handoff_listen(handoff_name);
+    if (handoff_fd == -1) perror("\nProcess 5: Failed to create handoff socket, upgrades need a restart\n");
 
     printf("\nProcess 5: IPC mechanisms initialized. Waiting for data...\n");
     fflush(stdout);
@@ -181,36 +325,52 @@ int main(int argc, char *argv[]) {
     // --- Main Event Loop using select ---
     fd_set read_fds;
     int max_fd;
-    char buffer[MAX_MSG_SIZE];
     struct timespec select_timeout = {1, 0}; // 1 second timeout for select
 
+    // Channels select() cannot wait on (shared memory) are polled on a short timer
+    int polled_channels = 0;
+    for (int i = 0; i < CHANNEL_COUNT; i++) polled_channels |= transport_needs_polling(&channels[i]);
+
     while (!terminate_flag) {
+        if (trace_export_flag) {
+            trace_export_flag = 0;
+            export_trace();
+        }
+
         FD_ZERO(&read_fds);
         max_fd = 0;
 
-        // Add FIFO fd
-        FD_SET(fifo_fd, &read_fds);
-        if (fifo_fd > max_fd) max_fd = fifo_fd;
-
-        // Add Listening socket fd (to accept new connection from P4)
-        FD_SET(listen_sock_fd, &read_fds);
-        if (listen_sock_fd > max_fd) max_fd = listen_sock_fd;
-
-
-        // Add Client socket fd (if connected)
-        if (client_sock_fd != -1) {
-            FD_SET(client_sock_fd, &read_fds);
-            if (client_sock_fd > max_fd) max_fd = client_sock_fd;
+        // Listening sockets (new producer connections) and data descriptors
+        for (int i = 0; i < CHANNEL_COUNT; i++) {
+            max_fd = transport_add_fds(&channels[i], &read_fds, max_fd);
+        }
+        if (handoff_fd != -1) {
+            FD_SET(handoff_fd, &read_fds);
+            if (handoff_fd > max_fd) max_fd = handoff_fd;
         }
-
-        // Add Message Queue - select() doesn't work directly on POSIX MQs.
-        // We'll check it non-blockingly after select returns.
 
         // Wait for activity or timeout
         // Use pselect to handle signals safely during select
+        // Wake up no later than when the oldest buffered record is due
+        long long due_ns = reorder_time_to_ready(&reorder, monotonic_ns());
+        if (polled_channels && (due_ns < 0 || due_ns > TRANSPORT_POLL_NS)) due_ns = TRANSPORT_POLL_NS;
+        if (due_ns >= 0 && due_ns < 1000000000LL) {
+            select_timeout.tv_sec = 0;
+            select_timeout.tv_nsec = (long)due_ns;
+        }
+
+        // Busy-poll: while records keep coming, only look, never block
+        unsigned long long wait_start = monotonic_ns();
+        int spin = busy_poll_should_spin(&busy_poll, wait_start);
+        if (spin) {
+            select_timeout.tv_sec = 0;
+            select_timeout.tv_nsec = 0;
+        }
+
         sigset_t empty_mask;
         sigemptyset(&empty_mask);
         int activity = pselect(max_fd + 1, &read_fds, NULL, NULL, &select_timeout, &empty_mask);
+        if (busy_poll.idle_ns > 0) busy_poll_waited(&busy_poll, spin, monotonic_ns() - wait_start);
 
         // Reset timeout for next iteration (pselect might modify it)
         select_timeout.tv_sec = 1;
@@ -231,126 +391,32 @@ int main(int argc, char *argv[]) {
             break;
         }
 
-        // --- Handle IPC activity ---
-
-        // 1. Check Listening Socket for new P4 connection
-        if (FD_ISSET(listen_sock_fd, &read_fds)) {
-            if (client_sock_fd != -1) {
-                // Should not happen if only P4 connects, but handle defensively
-                printf("\nProcess 5: Ignoring new connection attempt, already connected to P4.\n");
-                // Accept and immediately close the new connection? Or just ignore.
-                int temp_sock = accept(listen_sock_fd, NULL, NULL);
-                if (temp_sock != -1) close(temp_sock);
-            } else {
-                client_sock_fd = accept(listen_sock_fd, NULL, NULL);
-                if (client_sock_fd == -1) {
-                    if (errno != EAGAIN && errno != EWOULDBLOCK) {
-                        perror("\nProcess 5: Failed to accept socket connection\n");
-                        terminate_flag = 1; // Error accepting
-                    }
-                    // else: No connection pending right now (EAGAIN/EWOULDBLOCK)
-                } else {
-                    printf("\nProcess 5: Accepted connection from P4 (socket fd %d).\n", client_sock_fd);
-                    fflush(stdout);
-                    if (make_non_blocking(client_sock_fd) == -1) {
-                        terminate_flag = 1; // Error setting non-blocking
-                    }
-                }
-            }
+        // A successor takes over: stop here, before reading any channel again
+        if (handoff_fd != -1 && FD_ISSET(handoff_fd, &read_fds)) {
+            hand_over_channels();
+            if (handed_off) break;
         }
 
-
-        // 2. Check Client Socket (P4) for data
-        if (client_sock_fd != -1 && FD_ISSET(client_sock_fd, &read_fds)) {
-            ssize_t bytes_read = read(client_sock_fd, buffer, sizeof(buffer) - 1);
-            if (bytes_read > 0) {
-                buffer[bytes_read] = '\0'; // Null-terminate
-                fprintf(log_fp, "%s", buffer); // Already includes "4: ..." and newline
-                // fflush(log_fp); // Line buffering should handle this
-                printf("\nProcess 5: Received from P4: %s\n", buffer);
-                display_menu();// Log to console too
-                fflush(stdout);
-            } else if (bytes_read == 0) {
-                // Connection closed by P4
-                printf("\nProcess 5: P4 closed socket connection (fd %d).\n", client_sock_fd);
-                fflush(stdout);
-                close(client_sock_fd);
-                client_sock_fd = -1;
-            } else { // bytes_read == -1
-                if (errno != EAGAIN && errno != EWOULDBLOCK) {
-                    perror("\nProcess 5: Error reading from client socket\n");
-                    close(client_sock_fd); // Close on error
-                    client_sock_fd = -1;
-                }
-                // else: No data available right now (EAGAIN/EWOULDBLOCK)
-            }
-        }
-
-        // 3. Check FIFO (P2) for data
-        if (FD_ISSET(fifo_fd, &read_fds)) {
-            ssize_t bytes_read = read(fifo_fd, buffer, sizeof(buffer) - 1);
-            if (bytes_read > 0) {
-                buffer[bytes_read] = '\0'; // Null-terminate
-                fprintf(log_fp, "%s", buffer); // Already includes "2: ..." and newline
-                // fflush(log_fp);
-                printf("\nProcess 5: Received from P2: %s\n", buffer);
-                display_menu();
-                fflush(stdout);
-
-                // Re-open FIFO for reading if P2 closed its writing end?
-                // No, the read end stays open. We just get EOF (read returns 0)
-                // when all writers close. Let's handle EOF below.
-
-            } else if (bytes_read == 0) {
-                // EOF on FIFO - P2 process likely terminated and closed write end.
-                // We need to reopen the FIFO to accept new connections if P2 restarts.
-                printf("\nProcess 5: P2 closed FIFO write end. Reopening read end.\n");
-                fflush(stdout);
-                close(fifo_fd);
-                fifo_fd = open(fifo_path, O_RDONLY | O_NONBLOCK);
-                if (fifo_fd == -1) {
-                    perror("\nProcess 5: Failed to reopen FIFO after P2 close\n");
-                    terminate_flag = 1; // Cannot continue without FIFO
-                } else {
-                    if (make_non_blocking(fifo_fd) == -1) terminate_flag = 1;
-                }
-
-            } else { // bytes_read == -1
-                if (errno != EAGAIN && errno != EWOULDBLOCK) {
-                    perror("\nProcess 5: Error reading from FIFO\n");
-                    terminate_flag = 1; // Terminate on unexpected FIFO error
-                }
-                // else: No data available right now (EAGAIN/EWOULDBLOCK)
+        // --- Handle IPC activity ---
+        // New connections, data on ready descriptors, polled channels
+        unsigned long long received_before = records_received;
+        for (int i = 0; i < CHANNEL_COUNT; i++) {
+            if (transport_service(&channels[i], &read_fds, deliver_record) == -1 &&
+                channels[i].kind == TRANSPORT_FIFO) {
+                terminate_flag = 1; // Cannot continue without the FIFO
             }
         }
 
-
-        // 4. Check Message Queue (P3) non-blockingly
-        ssize_t mq_bytes_read;
-        do {
-            mq_bytes_read = mq_receive(mq_desc, buffer, MAX_MSG_SIZE, NULL); // Use MAX_MSG_SIZE as buffer size
-            if (mq_bytes_read >= 0) {
-                buffer[mq_bytes_read] = '\0'; // Null-terminate received message
-                fprintf(log_fp, "%s\n", buffer); // Add newline, msg doesn't have it
-                // fflush(log_fp);
-                printf("\nProcess 5: Received from P3: %s\n", buffer);
-                display_menu();
-                fflush(stdout);
-            } else { // mq_bytes_read == -1
-                if (errno != EAGAIN) { // EAGAIN means queue is empty (expected)
-                    perror("\nProcess 5: mq_receive error\n");
-                    // Consider if this error is fatal
-                    // terminate_flag = 1;
-                    break; // Exit the mq read loop for this select cycle
-                }
-                // else: Queue is empty, break the loop
-                break;
-            }
-        } while (mq_bytes_read >= 0 && !terminate_flag); // Keep reading if messages are available
-
+        // Release records whose reorder window has expired
+        flush_reorder(0);
+        if (busy_poll.idle_ns > 0) busy_poll_after_pass(&busy_poll, spin, records_received != received_before);
 
     } // End while (!terminate_flag)
 
+    // Read every channel dry before cleanup() unlinks the IPC objects,
+    // unless a successor now owns them
+    if (!handed_off) drain_channels();
+
     // Cleanup is handled by atexit or explicit call if needed
     // cleanup(); // atexit should cover normal termination path
 
@@ -0,0 +1,226 @@
+//
+// Record stamping shared by the workers (P2, P3, P4), the logger (P5) and the
+// offline log tools. Every record carries the producer's monotonic timestamp
+// and a per-producer sequence number so that logs written by different
+// logger shards can be merged back into a single ordered stream.
+//
+
+#ifndef PROCESSES_RECORD_H
+#define PROCESSES_RECORD_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "common.h"
+#include "numfmt.h"
+
+// Log line layout: "[<ts_ns>/<seq>] <source>: <value>"
+#define RECORD_STAMP_FMT "[%llu/%llu] "
+
+typedef struct {
+    unsigned long long ts_ns; // CLOCK_MONOTONIC of the producer, in ns
+    unsigned long long seq;   // Per-producer sequence number, starts at 1
+} record_stamp_t;
+
+// --- Current CLOCK_MONOTONIC time in nanoseconds ---
+unsigned long long monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+// --- Write the "[ts/seq] " prefix, returns number of chars written ---
+int format_record_stamp(char *buf, size_t size, record_stamp_t stamp) {
+    int n = snprintf(buf, size, RECORD_STAMP_FMT, stamp.ts_ns, stamp.seq);
+    if (n < 0) return 0;
+    if ((size_t)n >= size) return (int)(size > 0 ? size - 1 : 0);
+    return n;
+}
+
+// --- Parse the "[ts/seq] " prefix ---
+// Returns 1 and points *rest past the prefix on success, 0 for unstamped lines.
+int parse_record_stamp(const char *line, record_stamp_t *stamp, const char **rest) {
+    int consumed = 0;
+    if (sscanf(line, "[%llu/%llu] %n", &stamp->ts_ns, &stamp->seq, &consumed) != 2 || consumed == 0) {
+        return 0;
+    }
+    if (rest) *rest = line + consumed;
+    return 1;
+}
+
+// --- Compare two stamps by (timestamp, sequence) ---
+int compare_record_stamp(const record_stamp_t *a, const record_stamp_t *b) {
+    if (a->ts_ns != b->ts_ns) return a->ts_ns < b->ts_ns ? -1 : 1;
+    if (a->seq != b->seq) return a->seq < b->seq ? -1 : 1;
+    return 0;
+}
+
+// --- Typed records ---
+// Workers send values in binary and P5 (or an offline reader) renders the
+// text once. VALUE_LINE is an already-rendered line: window summaries, lines
+// from text producers without a stamp, and WAL files from before typed records.
+typedef enum {
+    VALUE_LINE = 0,
+    VALUE_INT = 1,
+    VALUE_DOUBLE = 2,
+    VALUE_STRING = 3
+} value_type_t;
+
+// --- Stage timestamps of a sampled (traced) record, CLOCK_MONOTONIC ns ---
+typedef struct {
+    unsigned long long read_ns;    // Worker: input line read
+    unsigned long long encode_ns;  // Worker: value parsed and stamped
+    unsigned long long send_ns;    // Worker: encoded for the channel, after pacing
+    unsigned long long receive_ns; // P5: the read that returned it
+    unsigned long long decode_ns;  // P5: decoded from the wire
+} record_trace_t;
+
+typedef struct {
+    record_stamp_t stamp;
+    int source;
+    int type;                // value_type_t
+    int stamped;             // 0 = no producer stamp, 'stamp' is the arrival time
+    union {
+        int64_t i;
+        double d;
+    } value;
+    int traced;              // Sampled for tracing, 'trace' is valid (see trace.h)
+    record_trace_t trace;
+    char text[MAX_MSG_SIZE]; // VALUE_STRING / VALUE_LINE payload
+} log_record_t;
+
+// --- Binary wire format (worker -> P5) ---
+// A fixed 32-byte header, followed by 'length' bytes for VALUE_STRING.
+// The magic byte can never start a text line, so P5 accepts both encodings
+// on the same channel. A traced record sets WIRE_TRACED in 'type' and
+// carries a wire_trace_t between the header and the text.
+#define WIRE_MAGIC 0xA5u
+#define WIRE_TRACED 0x80u
+
+typedef struct {
+    uint8_t magic;
+    uint8_t type;
+    uint16_t source;
+    uint32_t length;
+    uint64_t ts_ns;
+    uint64_t seq;
+    union {
+        int64_t i;
+        double d;
+    } value;
+} wire_header_t;
+
+typedef struct {
+    uint64_t read_ns;
+    uint64_t encode_ns;
+    uint64_t send_ns;
+} wire_trace_t;
+
+// --- Encode a record for sending, returns the encoded size ---
+size_t wire_encode(char *buf, size_t size, const log_record_t *rec) {
+    wire_header_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = WIRE_MAGIC;
+    hdr.type = (uint8_t)rec->type;
+    hdr.source = (uint16_t)rec->source;
+    hdr.ts_ns = rec->stamp.ts_ns;
+    hdr.seq = rec->stamp.seq;
+    size_t trace_len = rec->traced ? sizeof(wire_trace_t) : 0;
+    size_t text_len = 0;
+    if (rec->type == VALUE_STRING || rec->type == VALUE_LINE) {
+        text_len = strnlen(rec->text, sizeof(rec->text));
+        if (text_len > size - sizeof(hdr) - trace_len) text_len = size - sizeof(hdr) - trace_len;
+    } else {
+        hdr.value.i = rec->value.i; // Copies the double bits too
+    }
+    hdr.length = (uint32_t)text_len;
+    if (rec->traced) {
+        // Encoding is the last step before the send call
+        wire_trace_t trace = {rec->trace.read_ns, rec->trace.encode_ns, monotonic_ns()};
+        hdr.type |= WIRE_TRACED;
+        memcpy(buf + sizeof(hdr), &trace, sizeof(trace));
+    }
+    memcpy(buf, &hdr, sizeof(hdr));
+    memcpy(buf + sizeof(hdr) + trace_len, rec->text, text_len);
+    return sizeof(hdr) + trace_len + text_len;
+}
+
+// --- Decode one record from 'buf' ---
+// Returns the bytes consumed, 0 if more bytes are needed, -1 if malformed.
+int wire_decode(const char *buf, size_t len, log_record_t *rec) {
+    wire_header_t hdr;
+    if (len < sizeof(hdr)) return 0;
+    memcpy(&hdr, buf, sizeof(hdr));
+    int traced = (hdr.type & WIRE_TRACED) != 0;
+    size_t trace_len = traced ? sizeof(wire_trace_t) : 0;
+    hdr.type &= (uint8_t)~WIRE_TRACED;
+    if (hdr.magic != WIRE_MAGIC || hdr.type > VALUE_STRING || hdr.length >= sizeof(rec->text)) return -1;
+    if (len < sizeof(hdr) + trace_len + hdr.length) return 0;
+    rec->stamp.ts_ns = hdr.ts_ns;
+    rec->stamp.seq = hdr.seq;
+    rec->source = hdr.source;
+    rec->type = hdr.type;
+    rec->stamped = 1;
+    rec->value.i = hdr.value.i;
+    rec->traced = traced;
+    if (traced) {
+        wire_trace_t trace;
+        memcpy(&trace, buf + sizeof(hdr), sizeof(trace));
+        memset(&rec->trace, 0, sizeof(rec->trace));
+        rec->trace.read_ns = trace.read_ns;
+        rec->trace.encode_ns = trace.encode_ns;
+        rec->trace.send_ns = trace.send_ns;
+    }
+    memcpy(rec->text, buf + sizeof(hdr) + trace_len, hdr.length);
+    rec->text[hdr.length] = '\0';
+    return (int)(sizeof(hdr) + trace_len + hdr.length);
+}
+
+// --- Parse a text line ("[ts/seq] 2: 42" or an unstamped line) into a record ---
+void record_from_text_line(const char *line, int source, unsigned long long arrival_ns, log_record_t *rec) {
+    const char *payload = line;
+    rec->source = source;
+    rec->traced = 0;
+    rec->stamped = parse_record_stamp(line, &rec->stamp, &payload);
+    if (!rec->stamped) {
+        rec->stamp.ts_ns = arrival_ns;
+        rec->stamp.seq = 0;
+        rec->type = VALUE_LINE;
+        snprintf(rec->text, sizeof(rec->text), "%s", line);
+        return;
+    }
+    // Strip the "<source>: " prefix so the value renders like a binary record
+    const char *value = strstr(payload, ": ");
+    rec->type = VALUE_STRING;
+    snprintf(rec->text, sizeof(rec->text), "%s", value ? value + 2 : payload);
+}
+
+// --- Render the value part only ("42", "0.1", "hello") ---
+int render_record_value(const log_record_t *rec, char *out, size_t size) {
+    char num[32];
+    switch (rec->type) {
+        case VALUE_INT:
+            fmt_i64(num, rec->value.i);
+            return snprintf(out, size, "%s", num);
+        case VALUE_DOUBLE:
+            fmt_double(num, rec->value.d);
+            return snprintf(out, size, "%s", num);
+        default:
+            return snprintf(out, size, "%s", rec->text);
+    }
+}
+
+// --- Render a full log line without the newline: "[ts/seq] <source>: <value>" ---
+int render_record_line(const log_record_t *rec, char *out, size_t size) {
+    if (rec->type == VALUE_LINE) {
+        if (!rec->stamped) return snprintf(out, size, "%s", rec->text);
+        int n = format_record_stamp(out, size, rec->stamp);
+        return n + snprintf(out + n, size - (size_t)n, "%s", rec->text);
+    }
+    int n = format_record_stamp(out, size, rec->stamp);
+    n += snprintf(out + n, size - (size_t)n, "%d: ", rec->source);
+    return n + render_record_value(rec, out + n, size - (size_t)n);
+}
+
+#endif //PROCESSES_RECORD_H
@@ -0,0 +1,157 @@
+//
+// Bounded reorder buffer used by P5. Records arrive in the order P5 happens to
+// service its channels; they are held in a min-heap keyed by the producer
+// stamp and released once they are older than the reorder window or when the
+// buffer is full, so the log comes out in timestamp order.
+//
+
+#ifndef PROCESSES_REORDER_H
+#define PROCESSES_REORDER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "record.h"
+
+#define REORDER_DEFAULT_WINDOW_MS 20
+#define REORDER_DEFAULT_MAX_RECORDS 1024
+
+typedef struct {
+    log_record_t record;
+    unsigned long long arrival_ns; // When P5 received the record
+    unsigned long long order;      // Arrival counter, keeps equal stamps FIFO
+} reorder_entry_t;
+
+typedef struct {
+    reorder_entry_t *slots;  // Record storage, 'capacity' entries
+    int *heap;               // Min-heap of slot indices
+    int *free_slots;         // Stack of unused slot indices
+    int count;
+    int free_count;
+    int capacity;
+    unsigned long long window_ns;
+    unsigned long long arrivals;
+
+    // --- Statistics ---
+    record_stamp_t last_emitted;
+    unsigned long long emitted;
+    unsigned long long late;        // Arrived after a newer record was already emitted
+    unsigned long long forced;      // Released early because the buffer was full
+    unsigned long long total_hold_ns;
+    unsigned long long max_hold_ns;
+    int max_depth;
+} reorder_buffer_t;
+
+int reorder_entry_less(const reorder_buffer_t *rb, int a, int b) {
+    int cmp = compare_record_stamp(&rb->slots[a].record.stamp, &rb->slots[b].record.stamp);
+    if (cmp != 0) return cmp < 0;
+    return rb->slots[a].order < rb->slots[b].order;
+}
+
+void reorder_swap(int *heap, int i, int j) {
+    int tmp = heap[i]; heap[i] = heap[j]; heap[j] = tmp;
+}
+
+// --- Allocate the buffer, returns -1 on allocation failure ---
+int reorder_init(reorder_buffer_t *rb, int capacity, unsigned long long window_ns) {
+    memset(rb, 0, sizeof(*rb));
+    if (capacity < 1) capacity = 1;
+    rb->slots = calloc((size_t)capacity, sizeof(reorder_entry_t));
+    rb->heap = calloc((size_t)capacity, sizeof(int));
+    rb->free_slots = calloc((size_t)capacity, sizeof(int));
+    if (!rb->slots || !rb->heap || !rb->free_slots) {
+        free(rb->slots); free(rb->heap); free(rb->free_slots);
+        return -1;
+    }
+    rb->capacity = capacity;
+    rb->window_ns = window_ns;
+    for (int i = 0; i < capacity; i++) rb->free_slots[i] = capacity - 1 - i;
+    rb->free_count = capacity;
+    return 0;
+}
+
+void reorder_free(reorder_buffer_t *rb) {
+    free(rb->slots); free(rb->heap); free(rb->free_slots);
+    rb->slots = NULL; rb->heap = NULL; rb->free_slots = NULL;
+    rb->count = rb->capacity = rb->free_count = 0;
+}
+
+int reorder_full(const reorder_buffer_t *rb) {
+    return rb->count >= rb->capacity;
+}
+
+// --- Insert a record, the caller must make room first when full ---
+int reorder_push(reorder_buffer_t *rb, const log_record_t *record, unsigned long long arrival_ns) {
+    if (reorder_full(rb)) return -1;
+    int slot = rb->free_slots[--rb->free_count];
+    reorder_entry_t *entry = &rb->slots[slot];
+    entry->record = *record;
+    entry->arrival_ns = arrival_ns;
+    entry->order = rb->arrivals++;
+
+    int pos = rb->count++;
+    rb->heap[pos] = slot;
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+        if (!reorder_entry_less(rb, rb->heap[pos], rb->heap[parent])) break;
+        reorder_swap(rb->heap, pos, parent);
+        pos = parent;
+    }
+    if (rb->count > rb->max_depth) rb->max_depth = rb->count;
+    return 0;
+}
+
+// --- Returns 1 if the oldest record may be released at time 'now_ns' ---
+int reorder_ready(const reorder_buffer_t *rb, unsigned long long now_ns) {
+    if (rb->count == 0) return 0;
+    const reorder_entry_t *top = &rb->slots[rb->heap[0]];
+    return top->record.stamp.ts_ns + rb->window_ns <= now_ns;
+}
+
+// --- Nanoseconds until the oldest record becomes ready, -1 if empty ---
+long long reorder_time_to_ready(const reorder_buffer_t *rb, unsigned long long now_ns) {
+    if (rb->count == 0) return -1;
+    unsigned long long deadline = rb->slots[rb->heap[0]].record.stamp.ts_ns + rb->window_ns;
+    return deadline <= now_ns ? 0 : (long long)(deadline - now_ns);
+}
+
+// --- Remove the oldest record into *out and update the statistics ---
+int reorder_pop(reorder_buffer_t *rb, unsigned long long now_ns, reorder_entry_t *out) {
+    if (rb->count == 0) return -1;
+    int slot = rb->heap[0];
+    *out = rb->slots[slot];
+    rb->free_slots[rb->free_count++] = slot;
+
+    rb->heap[0] = rb->heap[--rb->count];
+    int pos = 0;
+    while (1) {
+        int left = 2 * pos + 1, right = left + 1, smallest = pos;
+        if (left < rb->count && reorder_entry_less(rb, rb->heap[left], rb->heap[smallest])) smallest = left;
+        if (right < rb->count && reorder_entry_less(rb, rb->heap[right], rb->heap[smallest])) smallest = right;
+        if (smallest == pos) break;
+        reorder_swap(rb->heap, pos, smallest);
+        pos = smallest;
+    }
+
+    if (rb->emitted > 0 && compare_record_stamp(&out->record.stamp, &rb->last_emitted) < 0) {
+        rb->late++;
+    } else {
+        rb->last_emitted = out->record.stamp;
+    }
+    unsigned long long hold = now_ns > out->arrival_ns ? now_ns - out->arrival_ns : 0;
+    rb->total_hold_ns += hold;
+    if (hold > rb->max_hold_ns) rb->max_hold_ns = hold;
+    rb->emitted++;
+    return 0;
+}
+
+void reorder_report(const reorder_buffer_t *rb, FILE *out) {
+    fprintf(out, "Reorder buffer: window %llu ms, capacity %d, emitted %llu, "
+                 "late %llu, forced %llu, max depth %d, avg hold %.3f ms, max hold %.3f ms\n",
+            rb->window_ns / 1000000ULL, rb->capacity, rb->emitted, rb->late, rb->forced, rb->max_depth,
+            rb->emitted ? (double)rb->total_hold_ns / rb->emitted / 1e6 : 0.0,
+            (double)rb->max_hold_ns / 1e6);
+}
+
+#endif //PROCESSES_REORDER_H
@@ -0,0 +1,160 @@
+//
+// Adaptive send batching for the workers (P2, P3, P4). Without it a worker
+// makes one write, mq_send or send per input value. With a batch spec from
+// P1 ("<max>/<budget>", e.g. "64/500us", via the control block) values
+// collect in a batch. It is sent when it reaches its target size or when its
+// oldest value has waited for the latency budget. The target follows the
+// arrival rate: the number of values expected within the budget, from a
+// moving average of the gaps between them, capped at max. A slow stream has
+// a target of one, so each value is still sent at once. Under load, batches
+// grow to max and the syscalls per value drop accordingly.
+//
+
+#ifndef PROCESSES_SENDBATCH_H
+#define PROCESSES_SENDBATCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "record.h"
+
+#define SEND_BATCH_MAX 64
+#define SEND_BATCH_SPEC_MAX 32
+#define SEND_BATCH_MAX_BUDGET_NS 1000000000ULL // 1 s
+#define SEND_BATCH_SIZE_BUCKETS 7              // Sizes 1, 2-3, 4-7 ... 64
+#define SEND_BATCH_GAP_WEIGHT 8.0              // Moving average over about the last 8 gaps
+
+typedef enum {
+    SEND_FLUSH_FULL,   // Reached the target size
+    SEND_FLUSH_BUDGET, // Oldest value waited for the latency budget
+    SEND_FLUSH_PACE,   // The pacer would have held it past the budget
+    SEND_FLUSH_EXIT,   // Worker stopping
+    SEND_FLUSH_REASONS
+} send_flush_reason_t;
+
+static const char *send_flush_reason_names[] = {"full", "budget", "pacing", "exit"};
+
+typedef struct {
+    char spec[SEND_BATCH_SPEC_MAX]; // As configured, "" = off
+    int max;                        // 1 = every value is sent at once
+    unsigned long long budget_ns;
+    log_record_t records[SEND_BATCH_MAX];
+    int count;
+    int target;                     // Current size limit, 1..max
+    unsigned long long oldest_ns;   // When records[0] was added
+    unsigned long long last_add_ns;
+    double gap_ns;                  // Moving average of the gaps between values, 0 = none yet
+
+    // --- Statistics ---
+    unsigned long long batches;
+    unsigned long long records_sent;
+    int largest;
+    unsigned long long flushes[SEND_FLUSH_REASONS];
+    unsigned long long sizes[SEND_BATCH_SIZE_BUCKETS];
+} send_batch_t;
+
+void send_batch_init(send_batch_t *b) {
+    memset(b, 0, sizeof(*b));
+    b->max = 1;
+    b->target = 1;
+}
+
+// --- Parse "<max>/<n>us|ms" or "off", returns -1 if invalid ---
+int send_batch_parse(const char *spec, int *max, unsigned long long *budget_ns) {
+    if (spec[0] == '\0' || strcmp(spec, "off") == 0) {
+        *max = 1;
+        *budget_ns = 0;
+        return 0;
+    }
+    if (strlen(spec) >= SEND_BATCH_SPEC_MAX) return -1;
+    char *end = NULL;
+    long records = strtol(spec, &end, 10);
+    if (end == spec || *end != '/' || records < 1 || records > SEND_BATCH_MAX) return -1;
+    const char *budget_text = end + 1;
+    double budget = strtod(budget_text, &end);
+    if (end == budget_text || budget <= 0.0) return -1;
+    if (strcmp(end, "us") == 0) budget *= 1e3;
+    else if (strcmp(end, "ms") == 0) budget *= 1e6;
+    else return -1;
+    if (budget > (double)SEND_BATCH_MAX_BUDGET_NS) return -1;
+    *max = (int)records;
+    *budget_ns = (unsigned long long)budget;
+    return 0;
+}
+
+// --- Replace the spec; on error -1 and 'b' is unchanged ---
+// Pending records stay; the next add or wait applies the new limits.
+int send_batch_configure(send_batch_t *b, const char *spec) {
+    int max;
+    unsigned long long budget_ns;
+    if (send_batch_parse(spec, &max, &budget_ns) == -1) return -1;
+    snprintf(b->spec, sizeof(b->spec), "%s", max > 1 ? spec : "");
+    b->max = max;
+    b->budget_ns = budget_ns;
+    if (b->target > max) b->target = max;
+    return 0;
+}
+
+int send_batch_check(const char *spec) {
+    int max;
+    unsigned long long budget_ns;
+    return send_batch_parse(spec, &max, &budget_ns);
+}
+
+// --- Add a stamped record at 'now_ns', returns 1 when the batch should be sent ---
+int send_batch_add(send_batch_t *b, const log_record_t *rec, unsigned long long now_ns) {
+    if (b->last_add_ns != 0) {
+        double gap = (double)(now_ns - b->last_add_ns);
+        b->gap_ns = b->gap_ns == 0.0 ? gap : b->gap_ns + (gap - b->gap_ns) / SEND_BATCH_GAP_WEIGHT;
+    }
+    b->last_add_ns = now_ns;
+    // Values expected within the budget; a stream slower than that sends each one at once
+    double expected = b->gap_ns > 0.0 ? (double)b->budget_ns / b->gap_ns : 1.0;
+    b->target = expected >= (double)b->max ? b->max : expected < 1.0 ? 1 : (int)expected;
+
+    if (b->count == 0) b->oldest_ns = now_ns;
+    b->records[b->count++] = *rec;
+    return b->count >= b->target || b->count >= SEND_BATCH_MAX;
+}
+
+// --- Time left before the oldest pending record is due, -1 = nothing pending ---
+long long send_batch_wait_ns(const send_batch_t *b, unsigned long long now_ns) {
+    if (b->count == 0) return -1;
+    unsigned long long due = b->oldest_ns + b->budget_ns;
+    return now_ns >= due ? 0 : (long long)(due - now_ns);
+}
+
+// --- The pending records were sent (or given up), account the batch ---
+void send_batch_sent(send_batch_t *b, send_flush_reason_t reason) {
+    if (b->count == 0) return;
+    int bucket = 0;
+    while (bucket < SEND_BATCH_SIZE_BUCKETS - 1 && (2 << bucket) <= b->count) bucket++;
+    b->sizes[bucket]++;
+    b->flushes[reason]++;
+    b->batches++;
+    b->records_sent += (unsigned long long)b->count;
+    if (b->count > b->largest) b->largest = b->count;
+    b->count = 0;
+}
+
+void send_batch_report(const send_batch_t *b, FILE *out, int process_num) {
+    if (b->spec[0] == '\0' && b->largest <= 1) return;
+    fprintf(out, "\nProcess %d batching (%s): %llu records in %llu sends, avg %.1f, max %d; flushed",
+            process_num, b->spec[0] != '\0' ? b->spec : "off", b->records_sent, b->batches,
+            b->batches ? (double)b->records_sent / (double)b->batches : 0.0, b->largest);
+    for (int reason = 0; reason < SEND_FLUSH_REASONS; reason++) {
+        fprintf(out, " %llu %s%s", b->flushes[reason], send_flush_reason_names[reason],
+                reason < SEND_FLUSH_REASONS - 1 ? "," : ";");
+    }
+    fprintf(out, " sizes");
+    for (int bucket = 0; bucket < SEND_BATCH_SIZE_BUCKETS; bucket++) {
+        if (b->sizes[bucket] == 0) continue;
+        int low = 1 << bucket, high = (2 << bucket) - 1;
+        if (low == high || bucket == SEND_BATCH_SIZE_BUCKETS - 1) fprintf(out, " %d:%llu", low, b->sizes[bucket]);
+        else fprintf(out, " %d-%d:%llu", low, high, b->sizes[bucket]);
+    }
+    fprintf(out, "\n");
+}
+
+#endif //PROCESSES_SENDBATCH_H
@@ -0,0 +1,442 @@
+//
+// Routed output sinks for the logger (-o). A routing table maps sources, and
+// optionally a predicate on the value, to separate output files. Each sink
+// has its own double buffer, writer thread, format and rotation policy. The
+// event loop copies a rendered record into the sink's active buffer. The
+// writer swaps the buffers and writes with plain write() calls, so sinks share
+// no stdio lock and sinks on different disks are written in parallel. A
+// record that matches no route goes to the main log as before.
+//
+// Route spec, routes separated by ';', the first matching route wins:
+//   <sources>[<predicate>]=<path>[,text|wal][,rotate=<size>][,keep=<n>][,buffer=<size>]
+//   sources:   "2", "2+3", or "*" for every source
+//   predicate: ">N" / "<N" on the numeric value, "~text" on the rendered value
+//   size:      bytes with an optional K, M or G suffix
+// Example: "4~ERROR=errors.log;2+3=numbers.wal,wal,rotate=64M,keep=5"
+//
+
+#ifndef PROCESSES_SINK_H
+#define PROCESSES_SINK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "common.h"
+#include "record.h"
+#include "wal.h"
+
+#define SINK_MAX_ROUTES 8
+#define SINK_MAX_SINKS 8
+#define SINK_DEFAULT_BUFFER (1 << 20)  // Output a sink may hold before the event loop waits
+#define SINK_MIN_BUFFER (1 << 16)      // Must hold the largest record
+#define SINK_DEFAULT_KEEP 3            // Rotated files kept: <path>.1 (newest) ... <path>.N
+
+typedef enum {
+    SINK_PREDICATE_NONE = 0,
+    SINK_PREDICATE_ABOVE,
+    SINK_PREDICATE_BELOW,
+    SINK_PREDICATE_CONTAINS
+} sink_predicate_t;
+
+typedef struct {
+    unsigned int source_mask;   // Bit per source ID
+    int predicate;              // sink_predicate_t
+    double threshold;
+    char needle[64];
+    int sink;                   // Index into sinks[]
+} sink_route_t;
+
+typedef struct {
+    char path[MAX_PATH_LEN * 2];
+    int wal;                         // 1 = WAL records, 0 = text lines, -1 = as the main log
+    unsigned long long rotate_bytes; // 0 = never rotate
+    int keep;
+    size_t capacity;
+
+    // --- Owned by the writer thread once started ---
+    int fd;
+    unsigned long long file_bytes;
+
+    // --- Double buffer: the event loop fills 'active', the writer drains 'writing' ---
+    pthread_mutex_t lock;
+    pthread_cond_t wake;   // Writer: data was committed, or stop
+    pthread_cond_t space;  // Event loop: 'active' was taken, or a buffer was written out
+    pthread_t thread;
+    int started;
+    char *active;
+    size_t active_len;
+    char *writing;
+    int busy;              // Writer is writing 'writing'
+    int stop;
+
+    // --- Statistics ---
+    unsigned long long records;
+    unsigned long long bytes_written;
+    unsigned long long writes;
+    unsigned long long rotations;
+    unsigned long long write_errors;
+    unsigned long long stalls;       // Appends that waited for the writer (buffer full)
+    unsigned long long stall_ns;
+} sink_t;
+
+sink_route_t sink_routes[SINK_MAX_ROUTES];
+int sink_route_count = 0;
+sink_t sinks[SINK_MAX_SINKS];
+int sink_count = 0;
+int sinks_dirty = 0; // Records appended since the last commit
+
+// --- "64M" -> 67108864, returns -1 if malformed ---
+long long sink_parse_size(const char *text) {
+    char *end = NULL;
+    long long value = strtoll(text, &end, 10);
+    if (end == text || value < 0) return -1;
+    switch (*end) {
+        case 'K': value <<= 10; end++; break;
+        case 'M': value <<= 20; end++; break;
+        case 'G': value <<= 30; end++; break;
+        default: break;
+    }
+    return *end == '\0' ? value : -1;
+}
+
+// --- Find or add the sink writing 'path' ---
+int sink_for_path(const char *path) {
+    for (int i = 0; i < sink_count; i++) {
+        if (strcmp(sinks[i].path, path) == 0) return i;
+    }
+    if (sink_count >= SINK_MAX_SINKS) return -1;
+    sink_t *sink = &sinks[sink_count];
+    memset(sink, 0, sizeof(*sink));
+    snprintf(sink->path, sizeof(sink->path), "%s", path);
+    sink->wal = -1;
+    sink->keep = SINK_DEFAULT_KEEP;
+    sink->capacity = SINK_DEFAULT_BUFFER;
+    sink->fd = -1;
+    return sink_count++;
+}
+
+// --- Parse one "<match>=<path>[,options]" route ---
+int sink_parse_route(char *route) {
+    if (sink_route_count >= SINK_MAX_ROUTES) return -1;
+    sink_route_t *r = &sink_routes[sink_route_count];
+    memset(r, 0, sizeof(*r));
+    char *eq = strchr(route, '=');
+    if (!eq || eq == route) return -1;
+    *eq = '\0';
+    char *options = strchr(eq + 1, ',');
+    if (options) *options++ = '\0';
+    if (eq[1] == '\0') return -1;
+
+    // Sources, then an optional predicate
+    char *p = route;
+    if (*p == '*') {
+        r->source_mask = ~0u;
+        p++;
+    } else {
+        while (1) {
+            char *end = NULL;
+            long source = strtol(p, &end, 10);
+            if (end == p || source < 0 || source > 31) return -1;
+            r->source_mask |= 1u << source;
+            p = end;
+            if (*p != '+') break;
+            p++;
+        }
+    }
+    if (*p == '>' || *p == '<') {
+        char *end = NULL;
+        r->predicate = *p == '>' ? SINK_PREDICATE_ABOVE : SINK_PREDICATE_BELOW;
+        r->threshold = strtod(p + 1, &end);
+        if (end == p + 1 || *end != '\0') return -1;
+    } else if (*p == '~') {
+        r->predicate = SINK_PREDICATE_CONTAINS;
+        if (p[1] == '\0') return -1;
+        snprintf(r->needle, sizeof(r->needle), "%s", p + 1);
+    } else if (*p != '\0') {
+        return -1;
+    }
+
+    int index = sink_for_path(eq + 1);
+    if (index == -1) return -1;
+    sink_t *sink = &sinks[index];
+    while (options && *options) {
+        char *next = strchr(options, ',');
+        if (next) *next++ = '\0';
+        if (strcmp(options, "wal") == 0) {
+            sink->wal = 1;
+        } else if (strcmp(options, "text") == 0) {
+            sink->wal = 0;
+        } else if (strncmp(options, "rotate=", 7) == 0) {
+            long long size = sink_parse_size(options + 7);
+            if (size < 0) return -1;
+            sink->rotate_bytes = (unsigned long long)size;
+        } else if (strncmp(options, "keep=", 5) == 0) {
+            sink->keep = atoi(options + 5);
+            if (sink->keep < 1 || sink->keep > 99) return -1;
+        } else if (strncmp(options, "buffer=", 7) == 0) {
+            long long size = sink_parse_size(options + 7);
+            if (size < SINK_MIN_BUFFER) return -1;
+            sink->capacity = (size_t)size;
+        } else {
+            return -1;
+        }
+        options = next;
+    }
+    r->sink = index;
+    sink_route_count++;
+    return 0;
+}
+
+// --- Parse a route spec (-o), returns -1 if any route is malformed ---
+int sinks_parse(const char *spec) {
+    char copy[1024];
+    if (strlen(spec) >= sizeof(copy)) return -1;
+    snprintf(copy, sizeof(copy), "%s", spec);
+    char *save = NULL;
+    for (char *route = strtok_r(copy, ";", &save); route; route = strtok_r(NULL, ";", &save)) {
+        if (sink_parse_route(route) == -1) return -1;
+    }
+    return sink_route_count > 0 ? 0 : -1;
+}
+
+// --- Sink of the first route 'rec' matches, -1 = main log ---
+int sink_route(const log_record_t *rec) {
+    for (int i = 0; i < sink_route_count; i++) {
+        const sink_route_t *r = &sink_routes[i];
+        if (rec->source < 0 || rec->source > 31 || !(r->source_mask & (1u << rec->source))) continue;
+        if (r->predicate == SINK_PREDICATE_CONTAINS) {
+            char value[MAX_MSG_SIZE + 32];
+            render_record_value(rec, value, sizeof(value));
+            if (!strstr(value, r->needle)) continue;
+        } else if (r->predicate != SINK_PREDICATE_NONE) {
+            double value;
+            if (rec->type == VALUE_INT) value = (double)rec->value.i;
+            else if (rec->type == VALUE_DOUBLE) value = rec->value.d;
+            else {
+                char *end = NULL;
+                value = strtod(rec->text, &end);
+                if (end == rec->text) continue; // Not a number, cannot match
+            }
+            if (r->predicate == SINK_PREDICATE_ABOVE ? !(value > r->threshold) : !(value < r->threshold)) continue;
+        }
+        return r->sink;
+    }
+    return -1;
+}
+
+// --- Writer: open (or reopen after a rotation) the sink file for appending ---
+int sink_open_file(sink_t *sink) {
+    sink->fd = open(sink->path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+    if (sink->fd == -1) return -1;
+    off_t size = lseek(sink->fd, 0, SEEK_END);
+    sink->file_bytes = size > 0 ? (unsigned long long)size : 0;
+    if (sink->wal && sink->file_bytes == 0) {
+        if (write(sink->fd, WAL_MAGIC, WAL_MAGIC_LEN) != WAL_MAGIC_LEN) return -1;
+        sink->file_bytes = WAL_MAGIC_LEN;
+    }
+    return 0;
+}
+
+// --- Writer: <path>.N-1 -> <path>.N ... <path> -> <path>.1, then a fresh file ---
+void sink_rotate(sink_t *sink) {
+    char from[sizeof(sink->path) + 16], to[sizeof(sink->path) + 16];
+    close(sink->fd);
+    for (int i = sink->keep - 1; i >= 1; i--) {
+        snprintf(from, sizeof(from), "%s.%d", sink->path, i);
+        snprintf(to, sizeof(to), "%s.%d", sink->path, i + 1);
+        rename(from, to); // Missing generations are fine
+    }
+    snprintf(to, sizeof(to), "%s.1", sink->path);
+    if (rename(sink->path, to) == -1) perror("\nProcess 5: Failed to rotate sink\n");
+    if (sink_open_file(sink) == -1) perror("\nProcess 5: Failed to reopen sink after rotation\n");
+    sink->rotations++;
+}
+
+// --- Writer thread: write out whatever the event loop committed ---
+void *sink_writer_main(void *arg) {
+    sink_t *sink = (sink_t *)arg;
+    pthread_mutex_lock(&sink->lock);
+    while (1) {
+        while (sink->active_len == 0 && !sink->stop) pthread_cond_wait(&sink->wake, &sink->lock);
+        if (sink->active_len == 0) break; // Stopped and dry
+        char *data = sink->active;
+        size_t len = sink->active_len;
+        sink->active = sink->writing;
+        sink->active_len = 0;
+        sink->writing = data;
+        sink->busy = 1;
+        pthread_cond_broadcast(&sink->space); // 'active' is empty again, a waiting appender can fill it
+        pthread_mutex_unlock(&sink->lock);
+
+        size_t done = 0;
+        if (sink->fd == -1) sink->write_errors++; // Lost with the file after a failed rotation
+        while (done < len && sink->fd != -1) {
+            ssize_t n = write(sink->fd, data + done, len - done);
+            if (n == -1) {
+                if (errno == EINTR) continue;
+                sink->write_errors++;
+                break;
+            }
+            done += (size_t)n;
+        }
+        sink->writes++;
+        sink->bytes_written += done;
+        sink->file_bytes += done;
+        if (sink->rotate_bytes > 0 && sink->file_bytes >= sink->rotate_bytes) sink_rotate(sink);
+
+        pthread_mutex_lock(&sink->lock);
+        sink->busy = 0;
+        pthread_cond_broadcast(&sink->space); // For sinks_sync, which also waits for 'busy'
+    }
+    pthread_mutex_unlock(&sink->lock);
+    return NULL;
+}
+
+// --- Open every sink and start its writer, 'shard' >= 0 names per-shard segments ---
+// Sinks without a format take the main log's ('default_wal'). WAL sinks are
+// recovered like the main log unless 'skip_recovery' is set.
+int sinks_start(int shard, int default_wal, int skip_recovery) {
+    for (int i = 0; i < sink_count; i++) {
+        sink_t *sink = &sinks[i];
+        if (sink->wal == -1) sink->wal = default_wal;
+        if (shard >= 0) {
+            char segment[sizeof(sink->path) + 16];
+            int len = snprintf(segment, sizeof(segment), "%s.shard%d", sink->path, shard);
+            if (len < 0 || (size_t)len >= sizeof(sink->path)) {
+                fprintf(stderr, "\nProcess 5: Sink path %s is too long.\n", sink->path);
+                return -1;
+            }
+            memcpy(sink->path, segment, (size_t)len + 1);
+        }
+        if (sink->wal && !skip_recovery) {
+            wal_recovery_t recovery;
+            if (wal_recover(sink->path, &recovery) == -1) {
+                fprintf(stderr, "\nProcess 5: WAL recovery of sink %s failed: %s\n", sink->path, strerror(errno));
+                return -1;
+            }
+            if (recovery.truncated_bytes > 0) {
+                printf("Process 5: Sink %s: truncated %llu torn bytes.\n", sink->path, recovery.truncated_bytes);
+            }
+        }
+        sink->active = malloc(sink->capacity);
+        sink->writing = malloc(sink->capacity);
+        if (!sink->active || !sink->writing || sink_open_file(sink) == -1) {
+            fprintf(stderr, "\nProcess 5: Failed to open sink %s: %s\n", sink->path, strerror(errno));
+            return -1;
+        }
+        pthread_mutex_init(&sink->lock, NULL);
+        pthread_cond_init(&sink->wake, NULL);
+        pthread_cond_init(&sink->space, NULL);
+        if (pthread_create(&sink->thread, NULL, sink_writer_main, sink) != 0) {
+            fprintf(stderr, "\nProcess 5: Failed to start the writer of sink %s.\n", sink->path);
+            return -1;
+        }
+        sink->started = 1;
+        printf("Process 5: Sink %s (%s%s) <- ", sink->path, sink->wal ? "wal" : "text",
+               sink->rotate_bytes ? ", rotating" : "");
+        for (int r = 0, first = 1; r < sink_route_count; r++) {
+            if (sink_routes[r].sink != i) continue;
+            printf("%sroute %d", first ? "" : ", ", r + 1);
+            first = 0;
+        }
+        printf("\n");
+    }
+    return 0;
+}
+
+// --- Copy one record's bytes into the sink, waiting only if its buffer is full ---
+void sink_append(sink_t *sink, const void *head, size_t head_len, const void *body, size_t body_len) {
+    size_t len = head_len + body_len;
+    pthread_mutex_lock(&sink->lock);
+    if (sink->active_len + len > sink->capacity) {
+        // The writer is behind: hand it what is there and wait for the swap
+        unsigned long long start = monotonic_ns();
+        sink->stalls++;
+        pthread_cond_signal(&sink->wake);
+        while (sink->active_len + len > sink->capacity) pthread_cond_wait(&sink->space, &sink->lock);
+        sink->stall_ns += monotonic_ns() - start;
+    }
+    memcpy(sink->active + sink->active_len, head, head_len);
+    memcpy(sink->active + sink->active_len + head_len, body, body_len);
+    sink->active_len += len;
+    sink->records++;
+    pthread_mutex_unlock(&sink->lock);
+    sinks_dirty = 1;
+}
+
+// --- Render 'rec' in the sink's format and append it ---
+void sink_write_record(int index, const log_record_t *rec) {
+    sink_t *sink = &sinks[index];
+    if (sink->wal) {
+        wal_header_t hdr;
+        const void *payload = rec->type == VALUE_INT || rec->type == VALUE_DOUBLE ? (const void *)&rec->value
+                                                                               : (const void *)rec->text;
+        size_t len = payload == (const void *)&rec->value ? sizeof(rec->value) : strlen(rec->text);
+        len = wal_make_header(&hdr, rec->source, rec->stamp, rec->type, payload, len);
+        sink_append(sink, &hdr, sizeof(hdr), payload, len);
+        return;
+    }
+    char line[MAX_MSG_SIZE + 64];
+    int len = render_record_line(rec, line, sizeof(line) - 1);
+    if (len < 0) return;
+    if ((size_t)len > sizeof(line) - 2) len = (int)sizeof(line) - 2;
+    line[len++] = '\n';
+    sink_append(sink, line, (size_t)len, NULL, 0);
+}
+
+// --- End of an event loop pass: wake the writers that have something to write ---
+void sinks_commit() {
+    sinks_dirty = 0;
+    for (int i = 0; i < sink_count; i++) {
+        sink_t *sink = &sinks[i];
+        if (!sink->started) continue;
+        pthread_mutex_lock(&sink->lock);
+        if (sink->active_len > 0) pthread_cond_signal(&sink->wake);
+        pthread_mutex_unlock(&sink->lock);
+    }
+}
+
+// --- Wait until every sink has written what it holds, then fsync it ---
+void sinks_sync() {
+    for (int i = 0; i < sink_count; i++) {
+        sink_t *sink = &sinks[i];
+        if (!sink->started) continue;
+        pthread_mutex_lock(&sink->lock);
+        if (sink->active_len > 0) pthread_cond_signal(&sink->wake);
+        while (sink->active_len > 0 || sink->busy) pthread_cond_wait(&sink->space, &sink->lock);
+        pthread_mutex_unlock(&sink->lock);
+        if (sink->fd != -1 && fsync(sink->fd) == -1) perror("\nProcess 5: fsync of sink failed\n");
+    }
+}
+
+// --- Stop the writers after they wrote everything, report and close ---
+void sinks_finish(FILE *out) {
+    for (int i = 0; i < sink_count; i++) {
+        sink_t *sink = &sinks[i];
+        if (sink->started) {
+            pthread_mutex_lock(&sink->lock);
+            sink->stop = 1;
+            pthread_cond_signal(&sink->wake);
+            pthread_mutex_unlock(&sink->lock);
+            pthread_join(sink->thread, NULL);
+            sink->started = 0;
+            fprintf(out, "\nProcess 5: Sink %s: %llu records, %llu bytes in %llu writes, %llu rotations, "
+                         "%llu stalls (%.3f ms waiting for the writer)%s\n",
+                    sink->path, sink->records, sink->bytes_written, sink->writes, sink->rotations,
+                    sink->stalls, (double)sink->stall_ns / 1e6, sink->write_errors ? ", WRITE ERRORS" : "");
+        }
+        if (sink->fd != -1) close(sink->fd);
+        sink->fd = -1;
+        free(sink->active);
+        free(sink->writing);
+        sink->active = sink->writing = NULL;
+    }
+    sink_count = 0;
+    sink_route_count = 0;
+}
+
+#endif //PROCESSES_SINK_H
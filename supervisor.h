@@ -0,0 +1,134 @@
+//
+// Child supervision for P1. A SIGCHLD handler writes one byte to a self-pipe,
+// which P1's menu loop waits on next to stdin, so a child that exits is
+// reaped as soon as it dies, not when the user next picks a menu option. A
+// child that failed is restarted after a bounded exponential backoff: the
+// first restart is immediate, further ones wait 10 ms, 20 ms, ... up to 2 s,
+// and a child that ran for SUPERVISOR_STABLE_MS counts as recovered.
+//
+
+#ifndef PROCESSES_SUPERVISOR_H
+#define PROCESSES_SUPERVISOR_H
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "common.h"
+
+#define SUPERVISOR_BACKOFF_MIN_MS 10
+#define SUPERVISOR_BACKOFF_MAX_MS 2000
+#define SUPERVISOR_STABLE_MS 5000 // Uptime after which a crash starts a fresh backoff
+
+typedef struct {
+    unsigned long long started_ns;    // Start of the current incarnation
+    unsigned long long failed_ns;     // When the failure was reaped, 0 = no restart pending
+    unsigned long long restart_at_ns; // Backoff: earliest restart
+    int consecutive_failures;
+
+    // --- Statistics ---
+    unsigned long long restarts;
+    unsigned long long last_recovery_ns; // Failure reaped -> replacement running
+    unsigned long long total_recovery_ns;
+    unsigned long long max_recovery_ns;
+} supervised_child_t;
+
+int supervisor_pipe[2] = {-1, -1};
+
+void supervisor_sigchld_handler(int signum) {
+    (void)signum;
+    int saved_errno = errno;
+    ssize_t ignored = write(supervisor_pipe[1], "c", 1); // Full pipe: a wakeup is already pending
+    (void)ignored;
+    errno = saved_errno;
+}
+
+// --- Create the self-pipe and install the SIGCHLD handler ---
+// Returns the fd to wait on, -1 on failure.
+int supervisor_init() {
+    if (pipe(supervisor_pipe) == -1) return -1;
+    for (int i = 0; i < 2; i++) {
+        if (fcntl(supervisor_pipe[i], F_SETFD, FD_CLOEXEC) == -1 ||
+            fcntl(supervisor_pipe[i], F_SETFL, fcntl(supervisor_pipe[i], F_GETFL) | O_NONBLOCK) == -1) {
+            return -1;
+        }
+    }
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = supervisor_sigchld_handler;
+    action.sa_flags = SA_RESTART | SA_NOCLDSTOP; // Blocking menu reads continue after a wakeup
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGCHLD, &action, NULL) == -1) return -1;
+    return supervisor_pipe[0];
+}
+
+// --- Consume the pending wakeups, the caller then reaps with WNOHANG ---
+void supervisor_clear_wakeups() {
+    char buf[64];
+    while (read(supervisor_pipe[0], buf, sizeof(buf)) > 0);
+}
+
+// --- A (re)started child is running, closes a pending recovery ---
+void supervisor_started(supervised_child_t *child, unsigned long long now_ns) {
+    if (child->failed_ns != 0) {
+        unsigned long long recovery = now_ns - child->failed_ns;
+        child->restarts++;
+        child->last_recovery_ns = recovery;
+        child->total_recovery_ns += recovery;
+        if (recovery > child->max_recovery_ns) child->max_recovery_ns = recovery;
+        child->failed_ns = 0;
+    }
+    child->started_ns = now_ns;
+}
+
+// --- A child failed (or a restart attempt did): schedule the next attempt ---
+// Returns the backoff in milliseconds.
+long supervisor_failed(supervised_child_t *child, unsigned long long now_ns) {
+    if (child->failed_ns == 0) {
+        // A crash after a long run is not part of a crash loop
+        if (now_ns - child->started_ns >= SUPERVISOR_STABLE_MS * 1000000ULL) child->consecutive_failures = 0;
+        child->failed_ns = now_ns;
+    }
+    child->consecutive_failures++;
+    long delay_ms = 0;
+    if (child->consecutive_failures > 1) {
+        int shift = child->consecutive_failures - 2;
+        delay_ms = shift >= 8 ? SUPERVISOR_BACKOFF_MAX_MS : SUPERVISOR_BACKOFF_MIN_MS << shift;
+        if (delay_ms > SUPERVISOR_BACKOFF_MAX_MS) delay_ms = SUPERVISOR_BACKOFF_MAX_MS;
+    }
+    child->restart_at_ns = now_ns + (unsigned long long)delay_ms * 1000000ULL;
+    return delay_ms;
+}
+
+// --- Drop a pending restart (the child is no longer wanted) ---
+void supervisor_cancel(supervised_child_t *child) {
+    child->failed_ns = 0;
+}
+
+int supervisor_due(const supervised_child_t *child, unsigned long long now_ns) {
+    return child->failed_ns != 0 && now_ns >= child->restart_at_ns;
+}
+
+// --- Nanoseconds until the child's restart is due, -1 if none is pending ---
+long long supervisor_time_to_restart(const supervised_child_t *child, unsigned long long now_ns) {
+    if (child->failed_ns == 0) return -1;
+    return child->restart_at_ns <= now_ns ? 0 : (long long)(child->restart_at_ns - now_ns);
+}
+
+// --- "exit code 1" / "signal 11 (Segmentation fault)" ---
+void supervisor_describe_status(int status, char *out, size_t size) {
+    if (WIFSIGNALED(status)) snprintf(out, size, "signal %d (%s)", WTERMSIG(status), strsignal(WTERMSIG(status)));
+    else snprintf(out, size, "exit code %d", WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+}
+
+void supervisor_report(const supervised_child_t *child, FILE *out, const char *label) {
+    fprintf(out, "[P1 Info]: %s: %llu restarts, recovery last %.3f ms, avg %.3f ms, max %.3f ms\n",
+            label, child->restarts, (double)child->last_recovery_ns / 1e6,
+            child->restarts ? (double)child->total_recovery_ns / child->restarts / 1e6 : 0.0,
+            (double)child->max_recovery_ns / 1e6);
+}
+
+#endif //PROCESSES_SUPERVISOR_H
@@ -0,0 +1,162 @@
+//
+// Sampled end-to-end tracing. Workers started with -T N mark every Nth
+// record and stamp when its line was read, parsed and sent; P5 adds when
+// the read that returned it finished, when it was decoded and when it was
+// handed to the log (or its sink's buffer) after the reorder window. The
+// trace id is the (source, sequence number) pair the record already carries.
+// Completed spans are kept in a fixed ring, the oldest overwritten first, and
+// exported as Chrome trace JSON (chrome://tracing, Perfetto): one "message"
+// slice per record with one child slice per stage, on a track per source.
+// All stamps are CLOCK_MONOTONIC, which every process on the host shares.
+//
+
+#ifndef PROCESSES_TRACE_H
+#define PROCESSES_TRACE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "common.h"
+#include "record.h"
+
+#define TRACE_RING_SPANS 65536
+
+typedef struct {
+    int source;
+    unsigned long long seq;
+    record_trace_t stages;
+    unsigned long long commit_ns;
+} trace_span_t;
+
+typedef struct {
+    trace_span_t *spans;        // NULL = tracing off
+    size_t capacity;
+    unsigned long long recorded; // Spans completed since the start, the ring keeps the last 'capacity'
+    char path[MAX_PATH_LEN];
+} trace_ring_t;
+
+trace_ring_t trace_ring;
+
+// Stage names, in order: each runs from the previous stamp to its own
+static const char *trace_stage_names[] = {"parse", "pace+send", "ipc", "decode", "reorder+commit"};
+#define TRACE_STAGES 5
+
+// --- Enable tracing, exported to 'path'; returns -1 on failure ---
+int trace_init(const char *path) {
+    memset(&trace_ring, 0, sizeof(trace_ring));
+    trace_ring.spans = calloc(TRACE_RING_SPANS, sizeof(trace_span_t));
+    if (trace_ring.spans == NULL) return -1;
+    trace_ring.capacity = TRACE_RING_SPANS;
+    snprintf(trace_ring.path, sizeof(trace_ring.path), "%s", path);
+    return 0;
+}
+
+// --- A traced record reached the log at 'commit_ns' ---
+void trace_record(const log_record_t *rec, unsigned long long commit_ns) {
+    if (trace_ring.spans == NULL || !rec->traced) return;
+    trace_span_t *span = &trace_ring.spans[trace_ring.recorded % trace_ring.capacity];
+    span->source = rec->source;
+    span->seq = rec->stamp.seq;
+    span->stages = rec->trace;
+    span->commit_ns = commit_ns;
+    trace_ring.recorded++;
+}
+
+// --- Stage boundaries of a span: read, encode, send, receive, decode, commit ---
+// A stamp earlier than the one before it (clock read on another core just
+// before) is clamped so the slices nest.
+void trace_span_stamps(const trace_span_t *span, unsigned long long stamps[TRACE_STAGES + 1]) {
+    stamps[0] = span->stages.read_ns;
+    stamps[1] = span->stages.encode_ns;
+    stamps[2] = span->stages.send_ns;
+    stamps[3] = span->stages.receive_ns;
+    stamps[4] = span->stages.decode_ns;
+    stamps[5] = span->commit_ns;
+    for (int i = 1; i <= TRACE_STAGES; i++) {
+        if (stamps[i] < stamps[i - 1]) stamps[i] = stamps[i - 1];
+    }
+}
+
+size_t trace_kept() {
+    return trace_ring.recorded < trace_ring.capacity ? (size_t)trace_ring.recorded : trace_ring.capacity;
+}
+
+// --- Write the ring as Chrome trace JSON; returns the spans written, -1 on failure ---
+// Written to a temporary name and renamed, so a viewer never sees half a file.
+long trace_export() {
+    if (trace_ring.spans == NULL) return 0;
+    char tmp_path[MAX_PATH_LEN + 8];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", trace_ring.path);
+    FILE *out = fopen(tmp_path, "w");
+    if (!out) return -1;
+
+    size_t kept = trace_kept();
+    unsigned long long first = trace_ring.recorded - kept;
+    unsigned int named = 0; // Sources that already have their track name
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    int comma = 0;
+    for (unsigned long long i = first; i < trace_ring.recorded; i++) {
+        const trace_span_t *span = &trace_ring.spans[i % trace_ring.capacity];
+        if (span->source >= 0 && span->source < 32 && !(named & (1u << span->source))) {
+            named |= 1u << span->source;
+            fprintf(out, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"P%d -> P5\"}}",
+                    comma ? ",\n" : "", span->source, span->source);
+            comma = 1;
+        }
+        unsigned long long stamps[TRACE_STAGES + 1];
+        trace_span_stamps(span, stamps);
+        // ts/dur are microseconds; the seq is the thread so concurrent messages get their own rows
+        fprintf(out, "%s{\"name\":\"message\",\"cat\":\"record\",\"ph\":\"X\",\"pid\":%d,\"tid\":%llu,"
+                     "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"seq\":%llu}}",
+                comma ? ",\n" : "", span->source, span->seq, (double)stamps[0] / 1e3,
+                (double)(stamps[TRACE_STAGES] - stamps[0]) / 1e3, span->seq);
+        comma = 1;
+        for (int stage = 0; stage < TRACE_STAGES; stage++) {
+            fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"stage\",\"ph\":\"X\",\"pid\":%d,\"tid\":%llu,"
+                         "\"ts\":%.3f,\"dur\":%.3f}",
+                    trace_stage_names[stage], span->source, span->seq, (double)stamps[stage] / 1e3,
+                    (double)(stamps[stage + 1] - stamps[stage]) / 1e3);
+        }
+    }
+    fprintf(out, "\n]}\n");
+    if (fclose(out) != 0 || rename(tmp_path, trace_ring.path) == -1) {
+        unlink(tmp_path);
+        return -1;
+    }
+    return (long)kept;
+}
+
+// --- Where the time of the kept spans went, stage by stage ---
+void trace_report(FILE *out) {
+    if (trace_ring.spans == NULL) return;
+    size_t kept = trace_kept();
+    fprintf(out, "\nProcess 5: Traced %llu records (last %zu kept in %s)", trace_ring.recorded, kept, trace_ring.path);
+    if (kept == 0) {
+        fprintf(out, "\n");
+        return;
+    }
+    double total[TRACE_STAGES] = {0};
+    unsigned long long max[TRACE_STAGES] = {0};
+    for (size_t i = 0; i < kept; i++) {
+        unsigned long long stamps[TRACE_STAGES + 1];
+        trace_span_stamps(&trace_ring.spans[i], stamps);
+        for (int stage = 0; stage < TRACE_STAGES; stage++) {
+            unsigned long long took = stamps[stage + 1] - stamps[stage];
+            total[stage] += (double)took;
+            if (took > max[stage]) max[stage] = took;
+        }
+    }
+    fprintf(out, ", avg/max us:");
+    for (int stage = 0; stage < TRACE_STAGES; stage++) {
+        fprintf(out, " %s %.1f/%.1f", trace_stage_names[stage], total[stage] / (double)kept / 1e3, (double)max[stage] / 1e3);
+    }
+    fprintf(out, "\n");
+}
+
+void trace_free() {
+    free(trace_ring.spans);
+    trace_ring.spans = NULL;
+}
+
+#endif //PROCESSES_TRACE_H
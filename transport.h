@@ -0,0 +1,880 @@
+//
+// Channel abstraction between the workers (P2, P3, P4) and the logger (P5).
+// Every channel kind offers the same operations: P5 opens the endpoint, a
+// worker connects to it, the worker sends batches of wire records and P5
+// receives whatever is available in one call. Which kind a worker uses is
+// picked at runtime: P1 passes "-t 2=mq,4=seqpacket" to every logger shard
+// and hands each worker an endpoint string "<kind>:<name>".
+//
+// Kinds:
+//   fifo      - named pipe, byte stream
+//   mq        - POSIX message queue, one or more records per message
+//   stream    - Unix domain socket, SOCK_STREAM
+//   seqpacket - Unix domain socket, SOCK_SEQPACKET, one batch per packet
+//   shm       - single-producer/single-consumer byte ring in shared memory
+//   inproc    - the same ring in private memory, for threads of one process
+//               (the in-process pipeline); not selectable with -t
+//
+
+#ifndef PROCESSES_TRANSPORT_H
+#define PROCESSES_TRANSPORT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <mqueue.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "common.h"
+#include "record.h"
+
+#define TRANSPORT_BATCH_BYTES 4096   // Largest write/packet sent by one batch
+#define TRANSPORT_SHM_BYTES (1 << 16) // Ring size of the shm transport
+#define TRANSPORT_POLL_NS 1000000LL   // Poll interval for kinds select() cannot wait on
+#define TRANSPORT_MAX_SOURCE 4
+
+typedef enum {
+    TRANSPORT_FIFO = 0,
+    TRANSPORT_MQ,
+    TRANSPORT_STREAM,
+    TRANSPORT_SEQPACKET,
+    TRANSPORT_SHM,
+    TRANSPORT_INPROC,
+    TRANSPORT_KIND_COUNT
+} transport_kind_t;
+
+const char *transport_kind_names[TRANSPORT_KIND_COUNT] = {"fifo", "mq", "stream", "seqpacket", "shm", "inproc"};
+
+// Shared-memory ring: the worker advances 'head', P5 advances 'tail'. Both
+// count bytes since creation, the offset in 'data' is the count modulo the size.
+typedef struct {
+    atomic_ullong head;
+    char head_pad[56];        // Keep producer and consumer counters on separate cache lines
+    atomic_ullong tail;
+    char tail_pad[56];
+    atomic_int reader_closed; // Set by P5 when it stops reading, writers get EPIPE
+    atomic_int inproc_refs;   // inproc: ends still attached, the last one frees the ring
+    char data[TRANSPORT_SHM_BYTES];
+} transport_shm_ring_t;
+
+typedef struct {
+    transport_kind_t kind;
+    int source;               // Producing process number (2, 3 or 4)
+    int server;               // 1 = P5 end, 0 = worker end
+    int accepting;            // P5: name still linked, new producers may connect
+    char name[MAX_PATH_LEN];  // FIFO/socket path, MQ/shm name
+
+    int fd;                   // FIFO, connected socket
+    int listen_fd;            // Socket kinds, P5 end
+    mqd_t mq;
+    size_t mq_msgsize;        // Worker: largest message the queue takes, one batch message
+    transport_shm_ring_t *ring;
+    volatile sig_atomic_t *stop_flag; // Worker: abandons a wait for ring space
+
+    // P5: partial record carried over between reads of a byte stream
+    char carry[2 * MAX_MSG_SIZE];
+    size_t carry_len;
+    int resyncing;            // P5: skipping a corrupt binary record up to the next WIRE_MAGIC
+    log_record_t scratch;
+    unsigned long long receive_ns; // P5: when the data being decoded was read (traced records)
+
+    // --- Statistics ---
+    unsigned long long batches;
+    unsigned long long records;
+    unsigned long long bytes;
+    unsigned long long reconnects; // Worker: times the channel was re-established after P5 went away
+    unsigned long long decode_errors; // P5: corrupt binary records dropped
+} transport_t;
+
+// Delivery callback implemented by P5
+typedef void (*transport_deliver_fn)(const log_record_t *record);
+
+// --- Name/kind helpers ---
+
+int transport_kind_from_name(const char *name) {
+    for (int kind = 0; kind < TRANSPORT_KIND_COUNT; kind++) {
+        if (strcmp(name, transport_kind_names[kind]) == 0) return kind;
+    }
+    return -1;
+}
+
+// Historical pairing: P2 over a FIFO, P3 over a queue, P4 over a stream socket
+transport_kind_t transport_default_kind(int source) {
+    if (source == 2) return TRANSPORT_FIFO;
+    if (source == 3) return TRANSPORT_MQ;
+    return TRANSPORT_STREAM;
+}
+
+int transport_is_socket(transport_kind_t kind) {
+    return kind == TRANSPORT_STREAM || kind == TRANSPORT_SEQPACKET;
+}
+
+int transport_is_ring(transport_kind_t kind) {
+    return kind == TRANSPORT_SHM || kind == TRANSPORT_INPROC;
+}
+
+// --- IPC name of a source's endpoint on a shard ---
+// The defaults reproduce the historical names (/tmp/proc2_fifo, /proc3_queue,
+// /tmp/proc4_socket); other pairings follow the same pattern.
+void transport_endpoint_name(transport_kind_t kind, int source, int shard, char *out, size_t size) {
+    char base[MAX_PATH_LEN];
+    switch (kind) {
+        case TRANSPORT_FIFO: snprintf(base, sizeof(base), "/tmp/proc%d_fifo", source); break;
+        case TRANSPORT_MQ:   snprintf(base, sizeof(base), "/proc%d_queue", source); break;
+        case TRANSPORT_SHM:  snprintf(base, sizeof(base), "/proc%d_shm", source); break;
+        case TRANSPORT_INPROC: snprintf(base, sizeof(base), "proc%d_inproc", source); break;
+        default:             snprintf(base, sizeof(base), "/tmp/proc%d_socket", source); break;
+    }
+    shard_ipc_name(base, shard, out, size);
+}
+
+// --- Remove a leftover endpoint name of any kind ---
+void transport_unlink_name(transport_kind_t kind, const char *name) {
+    if (kind == TRANSPORT_MQ) mq_unlink(name);
+    else if (kind == TRANSPORT_SHM) shm_unlink(name);
+    else if (kind != TRANSPORT_INPROC) unlink(name);
+}
+
+// --- "<kind>:<name>" endpoint string handed to a worker ---
+void transport_format_endpoint(transport_kind_t kind, const char *name, char *out, size_t size) {
+    snprintf(out, size, "%s:%s", transport_kind_names[kind], name);
+}
+
+// A bare name (no "<kind>:" prefix) keeps the worker's default kind.
+// Returns -1 for an unknown kind.
+int transport_parse_endpoint(const char *spec, transport_kind_t default_kind,
+                             transport_kind_t *kind, char *name, size_t size) {
+    const char *colon = strchr(spec, ':');
+    *kind = default_kind;
+    if (colon) {
+        char kind_name[16];
+        size_t len = (size_t)(colon - spec);
+        if (len >= sizeof(kind_name)) return -1;
+        memcpy(kind_name, spec, len);
+        kind_name[len] = '\0';
+        int parsed = transport_kind_from_name(kind_name);
+        if (parsed < 0) return -1;
+        *kind = (transport_kind_t)parsed;
+        spec = colon + 1;
+    }
+    snprintf(name, size, "%s", spec);
+    return 0;
+}
+
+// --- Parse a per-source selection like "2=mq,3=shm,4=seqpacket" ---
+// 'kinds' is indexed by source and starts out with the defaults.
+// Returns -1 on a malformed spec.
+int transport_parse_map(const char *spec, transport_kind_t kinds[TRANSPORT_MAX_SOURCE + 1]) {
+    for (int source = 0; source <= TRANSPORT_MAX_SOURCE; source++) kinds[source] = transport_default_kind(source);
+    if (spec == NULL || spec[0] == '\0') return 0;
+
+    char copy[128];
+    snprintf(copy, sizeof(copy), "%s", spec);
+    char *saveptr = NULL;
+    for (char *item = strtok_r(copy, ",", &saveptr); item; item = strtok_r(NULL, ",", &saveptr)) {
+        char *eq = strchr(item, '=');
+        if (!eq) return -1;
+        *eq = '\0';
+        char *end = NULL;
+        long source = strtol(item, &end, 10);
+        int kind = transport_kind_from_name(eq + 1);
+        if (end == item || *end != '\0' || source < 2 || source > TRANSPORT_MAX_SOURCE ||
+            kind < 0 || kind == TRANSPORT_INPROC) return -1;
+        kinds[source] = (transport_kind_t)kind;
+    }
+    return 0;
+}
+
+int transport_set_non_blocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) return -1;
+    return 0;
+}
+
+void transport_reset(transport_t *t, transport_kind_t kind, int source, const char *name, int server) {
+    memset(t, 0, sizeof(*t));
+    t->kind = kind;
+    t->source = source;
+    t->server = server;
+    t->fd = -1;
+    t->listen_fd = -1;
+    t->mq = (mqd_t)-1;
+    snprintf(t->name, sizeof(t->name), "%s", name);
+}
+
+transport_shm_ring_t *transport_map_ring(const char *name, int create) {
+    int fd = shm_open(name, create ? (O_CREAT | O_RDWR) : O_RDWR, 0666);
+    if (fd == -1) return NULL;
+    if (create && ftruncate(fd, sizeof(transport_shm_ring_t)) == -1) {
+        close(fd);
+        return NULL;
+    }
+    void *addr = mmap(NULL, sizeof(transport_shm_ring_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return addr == MAP_FAILED ? NULL : (transport_shm_ring_t *)addr;
+}
+
+// --- inproc rings, looked up by name ---
+// Endpoints are opened before the threads that connect to them are started,
+// so the registry needs no lock; the rings themselves are lock-free.
+#define TRANSPORT_INPROC_SLOTS 16
+
+struct {
+    char name[MAX_PATH_LEN];
+    transport_shm_ring_t *ring;
+} transport_inproc_rings[TRANSPORT_INPROC_SLOTS];
+
+transport_shm_ring_t *transport_inproc_create(const char *name) {
+    for (int i = 0; i < TRANSPORT_INPROC_SLOTS; i++) {
+        if (transport_inproc_rings[i].ring != NULL) continue;
+        void *addr = NULL;
+        if (posix_memalign(&addr, 64, sizeof(transport_shm_ring_t)) != 0) return NULL; // Cache-line aligned
+        memset(addr, 0, sizeof(transport_shm_ring_t));
+        snprintf(transport_inproc_rings[i].name, sizeof(transport_inproc_rings[i].name), "%s", name);
+        transport_inproc_rings[i].ring = (transport_shm_ring_t *)addr;
+        atomic_store(&transport_inproc_rings[i].ring->inproc_refs, 1);
+        return transport_inproc_rings[i].ring;
+    }
+    errno = ENOSPC;
+    return NULL;
+}
+
+transport_shm_ring_t *transport_inproc_attach(const char *name) {
+    for (int i = 0; i < TRANSPORT_INPROC_SLOTS; i++) {
+        transport_shm_ring_t *ring = transport_inproc_rings[i].ring;
+        if (ring != NULL && strcmp(transport_inproc_rings[i].name, name) == 0) {
+            atomic_fetch_add(&ring->inproc_refs, 1);
+            return ring;
+        }
+    }
+    errno = ENOENT;
+    return NULL;
+}
+
+// Removes the name; the ring stays allocated until its last end detaches
+void transport_inproc_unregister(const transport_shm_ring_t *ring) {
+    for (int i = 0; i < TRANSPORT_INPROC_SLOTS; i++) {
+        if (transport_inproc_rings[i].ring == ring) transport_inproc_rings[i].ring = NULL;
+    }
+}
+
+// --- P5: create the endpoint and start accepting a producer ---
+// Returns -1 with errno set on failure.
+int transport_open(transport_t *t, transport_kind_t kind, int source, const char *name) {
+    transport_reset(t, kind, source, name, 1);
+    switch (kind) {
+        case TRANSPORT_FIFO:
+            if (mkfifo(name, 0666) == -1 && errno != EEXIST) return -1;
+            t->fd = open(name, O_RDONLY | O_NONBLOCK);
+            if (t->fd == -1) return -1;
+            break;
+        case TRANSPORT_MQ: {
+            struct mq_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.mq_maxmsg = MQ_MAX_MSGS;
+            attr.mq_msgsize = TRANSPORT_BATCH_BYTES; // A whole batch per message
+            t->mq = mq_open(name, O_CREAT | O_RDONLY | O_NONBLOCK, 0666, &attr);
+            if (t->mq == (mqd_t)-1 && errno == EINVAL) {
+                // The host's msgsize_max is below a batch: one message per few records
+                attr.mq_msgsize = MAX_MSG_SIZE;
+                t->mq = mq_open(name, O_CREAT | O_RDONLY | O_NONBLOCK, 0666, &attr);
+            }
+            if (t->mq == (mqd_t)-1) return -1;
+            // An existing queue keeps its attributes; its messages must fit the receive buffer
+            if (mq_getattr(t->mq, &attr) == 0 && attr.mq_msgsize > TRANSPORT_BATCH_BYTES) {
+                errno = EMSGSIZE;
+                return -1;
+            }
+            break;
+        }
+        case TRANSPORT_STREAM:
+        case TRANSPORT_SEQPACKET: {
+            t->listen_fd = socket(AF_UNIX, kind == TRANSPORT_STREAM ? SOCK_STREAM : SOCK_SEQPACKET, 0);
+            if (t->listen_fd == -1 || transport_set_non_blocking(t->listen_fd) == -1) return -1;
+            struct sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", name);
+            unlink(name); // Remove old socket file if it exists
+            if (bind(t->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) return -1;
+            if (listen(t->listen_fd, 1) == -1) return -1; // One producer per endpoint
+            break;
+        }
+        case TRANSPORT_SHM:
+            // A ring that is still linked belongs to a P5 that crashed (a clean
+            // shutdown unlinks it): adopt it with its counters, so the producer
+            // keeps writing and nothing queued in it is lost. A new ring is zeroed.
+            t->ring = transport_map_ring(name, 1);
+            if (t->ring == NULL) return -1;
+            atomic_store(&t->ring->reader_closed, 0);
+            break;
+        case TRANSPORT_INPROC:
+            t->ring = transport_inproc_create(name);
+            if (t->ring == NULL) return -1;
+            break;
+        default:
+            errno = EINVAL;
+            return -1;
+    }
+    t->accepting = 1;
+    return 0;
+}
+
+// --- Worker: connect to the endpoint P5 opened ---
+// 'stop_flag' lets a worker blocked on a full shm ring give up on SIGTERM.
+int transport_connect(transport_t *t, transport_kind_t kind, int source, const char *name,
+                      volatile sig_atomic_t *stop_flag) {
+    transport_reset(t, kind, source, name, 0);
+    t->stop_flag = stop_flag;
+    switch (kind) {
+        case TRANSPORT_FIFO:
+            t->fd = open(name, O_WRONLY);
+            return t->fd == -1 ? -1 : 0;
+        case TRANSPORT_MQ: {
+            t->mq = mq_open(name, O_WRONLY);
+            if (t->mq == (mqd_t)-1) return -1;
+            // Queues created by an older P5, or on a host with a low msgsize_max, take less
+            struct mq_attr attr;
+            t->mq_msgsize = mq_getattr(t->mq, &attr) == 0 && (size_t)attr.mq_msgsize < TRANSPORT_BATCH_BYTES
+                                ? (size_t)attr.mq_msgsize : TRANSPORT_BATCH_BYTES;
+            return 0;
+        }
+        case TRANSPORT_STREAM:
+        case TRANSPORT_SEQPACKET: {
+            t->fd = socket(AF_UNIX, kind == TRANSPORT_STREAM ? SOCK_STREAM : SOCK_SEQPACKET, 0);
+            if (t->fd == -1) return -1;
+            struct sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", name);
+            return connect(t->fd, (struct sockaddr *)&addr, sizeof(addr));
+        }
+        case TRANSPORT_SHM:
+            t->ring = transport_map_ring(name, 0);
+            return t->ring == NULL ? -1 : 0;
+        case TRANSPORT_INPROC:
+            t->ring = transport_inproc_attach(name);
+            return t->ring == NULL ? -1 : 0;
+        default:
+            errno = EINVAL;
+            return -1;
+    }
+}
+
+// --- Worker: the send error means P5 went away (crashed or restarting) ---
+int transport_peer_lost(int err) {
+    return err == EPIPE || err == ECONNRESET || err == ENOTCONN || err == ECONNREFUSED || err == ENOENT;
+}
+
+// --- P1: returns 1 once P5 has created the endpoint, without connecting ---
+int transport_endpoint_ready(transport_kind_t kind, const char *name) {
+    switch (kind) {
+        case TRANSPORT_MQ: {
+            mqd_t mq = mq_open(name, O_WRONLY | O_NONBLOCK);
+            if (mq == (mqd_t)-1) return 0;
+            mq_close(mq);
+            return 1;
+        }
+        case TRANSPORT_SHM: {
+            // The ring is sized after it is created, mapping it earlier would fault
+            struct stat st;
+            int fd = shm_open(name, O_RDONLY, 0);
+            if (fd == -1) return 0;
+            int ready = fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(transport_shm_ring_t);
+            close(fd);
+            return ready;
+        }
+        case TRANSPORT_INPROC:
+            return 0; // Only visible inside the process that opened it
+        default:
+            return access(name, F_OK) == 0;
+    }
+}
+
+// --- Write all of 'len' bytes, retrying short writes ---
+// '*written' (may be NULL) gets the bytes handed over, also when it fails.
+int transport_write_all(transport_t *t, const char *data, size_t len, size_t *written) {
+    if (written) *written = 0;
+    while (len > 0) {
+        ssize_t n = transport_is_socket(t->kind) ? send(t->fd, data, len, MSG_NOSIGNAL)
+                                                 : write(t->fd, data, len);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+        if (written) *written += (size_t)n;
+    }
+    return 0;
+}
+
+// --- Copy one batch into the shm ring, waiting while it is full ---
+int transport_ring_write(transport_t *t, const char *data, size_t len) {
+    transport_shm_ring_t *ring = t->ring;
+    unsigned long long head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    while (1) {
+        if (atomic_load_explicit(&ring->reader_closed, memory_order_acquire)) {
+            errno = EPIPE;
+            return -1;
+        }
+        unsigned long long tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (TRANSPORT_SHM_BYTES - (head - tail) >= len) break;
+        if (t->stop_flag && *t->stop_flag) {
+            errno = EINTR;
+            return -1;
+        }
+        struct timespec ts = {0, 50000}; // Ring full: P5 is behind, back off 50 us
+        nanosleep(&ts, NULL);
+    }
+    size_t offset = (size_t)(head % TRANSPORT_SHM_BYTES);
+    size_t first = len < TRANSPORT_SHM_BYTES - offset ? len : TRANSPORT_SHM_BYTES - offset;
+    memcpy(ring->data + offset, data, first);
+    memcpy(ring->data, data + first, len - first);
+    atomic_store_explicit(&ring->head, head + len, memory_order_release);
+    return 0;
+}
+
+// --- Hand one encoded batch to the channel ---
+// '*written' gets the bytes handed over: all or nothing, except a stream
+// (fifo, stream socket) can fail part way through.
+int transport_send_bytes(transport_t *t, const char *data, size_t len, size_t *written) {
+    int rc;
+    *written = 0;
+    if (len == 0) return 0;
+    switch (t->kind) {
+        case TRANSPORT_MQ:  rc = mq_send(t->mq, data, len, 0); break;
+        case TRANSPORT_SHM:
+        case TRANSPORT_INPROC: rc = transport_ring_write(t, data, len); break;
+        default:            rc = transport_write_all(t, data, len, written); break;
+    }
+    if (rc == 0) {
+        *written = len;
+        t->batches++;
+        t->bytes += len;
+    }
+    return rc;
+}
+
+// --- Worker: send 'count' records with as few writes/messages as possible ---
+// Records are packed into one buffer; message kinds never split a record, so
+// a batch becomes several messages when it exceeds the message size.
+// Returns -1 with errno set (EPIPE: P5 went away). '*sent' (may be NULL) gets
+// the records handed over completely, also on failure, so a retry after a
+// reconnect can skip them instead of delivering them twice.
+int transport_send_batch(transport_t *t, const log_record_t *records, int count, int *sent) {
+    char batch[TRANSPORT_BATCH_BYTES];
+    size_t limit = t->kind == TRANSPORT_MQ ? t->mq_msgsize : sizeof(batch);
+    size_t used = 0, written = 0;
+    int done = 0;    // Records before 'batch'
+    int pending = 0; // Records in 'batch', counted once they are sent
+    if (sent) *sent = 0;
+    for (int i = 0; i <= count; i++) {
+        char encoded[sizeof(wire_header_t) + MAX_MSG_SIZE];
+        size_t length = i < count ? wire_encode(encoded, sizeof(encoded), &records[i]) : 0;
+        if (i == count || used + length > limit) {
+            if (transport_send_bytes(t, batch, used, &written) == -1) break;
+            t->records += (unsigned long long)pending;
+            done += pending;
+            used = 0;
+            pending = 0;
+            if (sent) *sent = done;
+            if (i == count) return 0;
+        }
+        memcpy(batch + used, encoded, length);
+        used += length;
+        pending++;
+    }
+    // A stream took part of the failed chunk: the records it holds completely are sent
+    int err = errno;
+    for (size_t offset = 0; written > 0 && done < count; done++) {
+        char encoded[sizeof(wire_header_t) + MAX_MSG_SIZE];
+        offset += wire_encode(encoded, sizeof(encoded), &records[done]);
+        if (offset > written) break;
+        t->records++;
+    }
+    if (sent) *sent = done;
+    errno = err;
+    return -1;
+}
+
+// --- Hand a decoded wire record over, completing the stages of a traced one ---
+void transport_deliver_wire(transport_t *t, transport_deliver_fn deliver) {
+    if (t->scratch.traced) {
+        t->scratch.trace.receive_ns = t->receive_ns;
+        t->scratch.trace.decode_ns = monotonic_ns();
+    }
+    deliver(&t->scratch);
+}
+
+// --- Decode every record in one MQ message or seqpacket ---
+// A message that does not start with WIRE_MAGIC is a text line (older producers).
+int transport_decode_message(transport_t *t, const char *data, size_t len, transport_deliver_fn deliver) {
+    int delivered = 0;
+    if (len > 0 && (unsigned char)data[0] != WIRE_MAGIC) {
+        char line[MAX_MSG_SIZE];
+        size_t line_len = strnlen(data, len < sizeof(line) - 1 ? len : sizeof(line) - 1);
+        memcpy(line, data, line_len);
+        line[line_len] = '\0';
+        line[strcspn(line, "\n")] = '\0';
+        if (line[0] == '\0') return 0;
+        record_from_text_line(line, t->source, monotonic_ns(), &t->scratch);
+        deliver(&t->scratch);
+        return 1;
+    }
+    size_t pos = 0;
+    while (pos < len) {
+        int used = wire_decode(data + pos, len - pos, &t->scratch);
+        if (used <= 0) { // Truncated or corrupt: the rest of the message is dropped
+            t->decode_errors++;
+            break;
+        }
+        transport_deliver_wire(t, deliver);
+        delivered++;
+        pos += (size_t)used;
+    }
+    return delivered;
+}
+
+// --- Split a chunk of a byte stream into records, keeping the partial tail ---
+// Binary records start with WIRE_MAGIC, anything else is read up to the newline.
+// A corrupt binary record is skipped up to the next WIRE_MAGIC byte, never
+// read as text. 'data' == NULL flushes a torn text tail when the writer went away.
+// Returns the number of records delivered.
+int transport_decode_stream(transport_t *t, const char *data, size_t len, transport_deliver_fn deliver) {
+    int delivered = 0;
+    while (len > 0 || (data == NULL && t->carry_len > 0)) {
+        size_t room = sizeof(t->carry) - 1 - t->carry_len;
+        size_t take = len < room ? len : room;
+        if (take > 0) {
+            memcpy(t->carry + t->carry_len, data, take);
+            t->carry_len += take;
+            data += take;
+            len -= take;
+        }
+
+        size_t pos = 0;
+        while (pos < t->carry_len) {
+            char *start = t->carry + pos;
+            size_t avail = t->carry_len - pos;
+            if (t->resyncing) {
+                char *next = memchr(start, WIRE_MAGIC, avail);
+                pos = next ? (size_t)(next - t->carry) : t->carry_len;
+                t->resyncing = next == NULL;
+                continue;
+            }
+            if ((unsigned char)start[0] == WIRE_MAGIC) {
+                int used = wire_decode(start, avail, &t->scratch);
+                if (used == 0) break;       // Header or payload still in flight
+                if (used < 0) {
+                    // Resynchronise on the next record, also in later reads: the
+                    // rest of this one is not a text line
+                    t->decode_errors++;
+                    t->resyncing = 1;
+                    pos++;
+                    continue;
+                }
+                transport_deliver_wire(t, deliver);
+                delivered++;
+                pos += (size_t)used;
+                continue;
+            }
+            char *newline = memchr(start, '\n', avail);
+            size_t line_len = newline ? (size_t)(newline - start) : avail;
+            if (!newline && data != NULL && avail < MAX_MSG_SIZE) break;
+            // Over-long lines, and a line torn by a closing writer, are logged as they are
+            if (line_len > MAX_MSG_SIZE - 1) line_len = MAX_MSG_SIZE - 1;
+            char saved = start[line_len];
+            start[line_len] = '\0';
+            if (start[0] != '\0') {
+                record_from_text_line(start, t->source, monotonic_ns(), &t->scratch);
+                deliver(&t->scratch);
+                delivered++;
+            }
+            start[line_len] = saved;
+            pos += line_len + (newline && start + line_len == newline ? 1 : 0);
+        }
+        memmove(t->carry, t->carry + pos, t->carry_len - pos);
+        t->carry_len -= pos;
+        if (data == NULL) {
+            t->carry_len = 0; // Whatever is left is an incomplete binary record
+            break;
+        }
+    }
+    t->records += (unsigned long long)delivered;
+    return delivered;
+}
+
+// --- P5: accept the producer's connection on a socket endpoint ---
+void transport_accept(transport_t *t) {
+    if (t->listen_fd == -1) return;
+    if (t->fd != -1) {
+        // Only one producer per endpoint, refuse the extra connection
+        printf("\nProcess 5: Ignoring new connection attempt, already connected to P%d.\n", t->source);
+        int temp_sock = accept(t->listen_fd, NULL, NULL);
+        if (temp_sock != -1) close(temp_sock);
+        return;
+    }
+    t->fd = accept(t->listen_fd, NULL, NULL);
+    if (t->fd == -1) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            perror("\nProcess 5: Failed to accept socket connection\n");
+        }
+        return;
+    }
+    printf("\nProcess 5: Accepted connection from P%d (%s fd %d).\n", t->source, transport_kind_names[t->kind], t->fd);
+    fflush(stdout);
+    if (transport_set_non_blocking(t->fd) == -1) {
+        perror("\nProcess 5: Failed to make socket non-blocking\n");
+        close(t->fd);
+        t->fd = -1;
+    }
+}
+
+// --- P5: the producer closed its end ---
+// Returns -1 when the channel is finished (not accepting anymore), 0 otherwise.
+int transport_peer_closed(transport_t *t) {
+    if (t->kind == TRANSPORT_FIFO) {
+        if (!t->accepting) return -1; // No new writers while draining, EOF means dry
+        // Reopen the FIFO so a restarted producer can connect again
+        printf("\nProcess 5: P%d closed FIFO write end. Reopening read end.\n", t->source);
+        fflush(stdout);
+        close(t->fd);
+        t->fd = open(t->name, O_RDONLY | O_NONBLOCK);
+        if (t->fd == -1) {
+            perror("\nProcess 5: Failed to reopen FIFO\n");
+            return -1;
+        }
+        return 0;
+    }
+    printf("\nProcess 5: P%d closed socket connection (fd %d).\n", t->source, t->fd);
+    fflush(stdout);
+    close(t->fd);
+    t->fd = -1;
+    return t->accepting ? 0 : -1;
+}
+
+// --- P5: read whatever one receive call offers and deliver the records ---
+// Returns the number of bytes/messages read, 0 if the channel had nothing to
+// offer, -1 if the channel is finished (closed while draining, or failed).
+ssize_t transport_receive_batch(transport_t *t, transport_deliver_fn deliver) {
+    char buffer[TRANSPORT_BATCH_BYTES];
+    switch (t->kind) {
+        case TRANSPORT_MQ: {
+            if (t->mq == (mqd_t)-1) return -1;
+            ssize_t received = 0;
+            while (1) {
+                ssize_t n = mq_receive(t->mq, buffer, sizeof(buffer), NULL);
+                if (n == -1) {
+                    if (errno != EAGAIN) perror("\nProcess 5: mq_receive error\n");
+                    break; // EAGAIN: queue is empty
+                }
+                t->receive_ns = monotonic_ns();
+                t->batches++;
+                t->bytes += (unsigned long long)n;
+                t->records += (unsigned long long)transport_decode_message(t, buffer, (size_t)n, deliver);
+                received++;
+            }
+            return received;
+        }
+        case TRANSPORT_SHM:
+        case TRANSPORT_INPROC: {
+            if (t->ring == NULL) return -1;
+            unsigned long long tail = atomic_load_explicit(&t->ring->tail, memory_order_relaxed);
+            unsigned long long head = atomic_load_explicit(&t->ring->head, memory_order_acquire);
+            size_t len = head - tail < sizeof(buffer) ? (size_t)(head - tail) : sizeof(buffer);
+            if (len == 0) return 0;
+            size_t offset = (size_t)(tail % TRANSPORT_SHM_BYTES);
+            size_t first = len < TRANSPORT_SHM_BYTES - offset ? len : TRANSPORT_SHM_BYTES - offset;
+            memcpy(buffer, t->ring->data + offset, first);
+            memcpy(buffer + first, t->ring->data, len - first);
+            atomic_store_explicit(&t->ring->tail, tail + len, memory_order_release);
+            t->receive_ns = monotonic_ns();
+            t->batches++;
+            t->bytes += len;
+            transport_decode_stream(t, buffer, len, deliver);
+            return (ssize_t)len;
+        }
+        default: {
+            if (t->fd == -1) return t->accepting ? 0 : -1; // Socket without a producer yet
+            ssize_t n = t->kind == TRANSPORT_SEQPACKET ? recv(t->fd, buffer, sizeof(buffer), 0)
+                                                       : read(t->fd, buffer, sizeof(buffer));
+            if (n > 0) {
+                t->receive_ns = monotonic_ns();
+                t->batches++;
+                t->bytes += (unsigned long long)n;
+                if (t->kind == TRANSPORT_SEQPACKET) {
+                    t->records += (unsigned long long)transport_decode_message(t, buffer, (size_t)n, deliver);
+                } else {
+                    transport_decode_stream(t, buffer, (size_t)n, deliver);
+                }
+                return n;
+            }
+            if (n == 0) {
+                // A torn last line is still logged
+                if (t->carry_len > 0) transport_decode_stream(t, NULL, 0, deliver);
+                return transport_peer_closed(t);
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return 0;
+            perror("\nProcess 5: Error reading from channel\n");
+            close(t->fd);
+            t->fd = -1;
+            return -1;
+        }
+    }
+}
+
+// --- P5: add the descriptors select() can wait on, returns the new max fd ---
+int transport_add_fds(const transport_t *t, fd_set *set, int max_fd) {
+    int fds[2] = {t->listen_fd, t->fd};
+#ifdef __linux__
+    // On Linux a message queue descriptor is a file descriptor and can be selected
+    if (t->kind == TRANSPORT_MQ) fds[1] = (int)t->mq;
+#endif
+    for (int i = 0; i < 2; i++) {
+        if (fds[i] < 0) continue;
+        FD_SET(fds[i], set);
+        if (fds[i] > max_fd) max_fd = fds[i];
+    }
+    return max_fd;
+}
+
+// --- 1 if the channel has to be polled on a timer instead of select() ---
+int transport_needs_polling(const transport_t *t) {
+    if (transport_is_ring(t->kind)) return 1;
+#ifdef __linux__
+    return 0;
+#else
+    return t->kind == TRANSPORT_MQ;
+#endif
+}
+
+// --- P5: handle select() readiness (new connection and/or data) ---
+ssize_t transport_service(transport_t *t, const fd_set *ready, transport_deliver_fn deliver) {
+    if (t->listen_fd != -1 && FD_ISSET(t->listen_fd, ready)) transport_accept(t);
+    int data_fd = t->kind == TRANSPORT_MQ ? (int)t->mq : t->fd;
+    if (transport_needs_polling(t) || (data_fd >= 0 && FD_ISSET(data_fd, ready))) {
+        return transport_receive_batch(t, deliver);
+    }
+    return 0;
+}
+
+// --- P5: remove the name so no new producer can connect (drain phase) ---
+// A connection already waiting in the backlog is taken over first.
+void transport_stop_accepting(transport_t *t) {
+    if (!t->server || !t->accepting) return;
+    if (t->listen_fd != -1) {
+        if (t->fd == -1) transport_accept(t);
+        close(t->listen_fd);
+        t->listen_fd = -1;
+    }
+    transport_unlink_name(t->kind, t->name);
+    t->accepting = 0;
+}
+
+// --- P5: data still queued in the channel (what a drain would lose) ---
+long transport_pending(const transport_t *t) {
+    int pending = 0;
+    if (t->kind == TRANSPORT_MQ) {
+        struct mq_attr attr;
+        if (t->mq != (mqd_t)-1 && mq_getattr(t->mq, &attr) == 0) return attr.mq_curmsgs;
+        return 0;
+    }
+    if (transport_is_ring(t->kind)) {
+        if (!t->ring) return 0;
+        return (long)(atomic_load(&t->ring->head) - atomic_load(&t->ring->tail));
+    }
+    if (t->fd == -1 || ioctl(t->fd, FIONREAD, &pending) == -1) return 0;
+    return pending;
+}
+
+const char *transport_pending_unit(const transport_t *t) {
+    return t->kind == TRANSPORT_MQ ? "messages" : "bytes";
+}
+
+// --- Close the channel; P5 also removes the endpoint name ---
+void transport_close(transport_t *t) {
+    if (t->fd != -1) close(t->fd);
+    if (t->listen_fd != -1) close(t->listen_fd);
+    if (t->mq != (mqd_t)-1) mq_close(t->mq);
+    if (t->ring) {
+        if (t->server) atomic_store_explicit(&t->ring->reader_closed, 1, memory_order_release);
+        if (t->kind != TRANSPORT_INPROC) {
+            munmap(t->ring, sizeof(transport_shm_ring_t));
+        } else {
+            if (t->server) transport_inproc_unregister(t->ring);
+            if (atomic_fetch_sub(&t->ring->inproc_refs, 1) == 1) free(t->ring);
+        }
+    }
+    if (t->server && t->accepting) transport_unlink_name(t->kind, t->name);
+    t->fd = t->listen_fd = -1;
+    t->mq = (mqd_t)-1;
+    t->ring = NULL;
+    t->accepting = 0;
+}
+
+// --- P5: let go of a channel another process has taken over (handoff.h) ---
+// Only this process's descriptors are closed: nothing is unlinked and a shm
+// producer is not told that the reader went away.
+void transport_detach(transport_t *t) {
+    if (t->fd != -1) close(t->fd);
+    if (t->listen_fd != -1) close(t->listen_fd);
+    if (t->mq != (mqd_t)-1) mq_close(t->mq);
+    if (t->ring && t->kind != TRANSPORT_INPROC) munmap(t->ring, sizeof(transport_shm_ring_t));
+    t->fd = t->listen_fd = -1;
+    t->mq = (mqd_t)-1;
+    t->ring = NULL;
+    t->accepting = 0;
+    t->carry_len = 0;
+}
+
+// --- Worker: connect again after P5 went away, P1 restarts it ---
+// Retries with exponential backoff (1 ms doubling to TRANSPORT_RECONNECT_MAX_MS)
+// for at most TRANSPORT_RECONNECT_TIMEOUT_MS (a FIFO open waits for the new
+// reader instead). Statistics are kept. Returns -1 with errno EPIPE if P5
+// did not come back in time or 'stop_flag' was set.
+#define TRANSPORT_RECONNECT_MAX_MS 200
+#define TRANSPORT_RECONNECT_TIMEOUT_MS 10000
+
+int transport_reconnect(transport_t *t) {
+    transport_t saved = *t;
+    unsigned long long deadline = monotonic_ns() + TRANSPORT_RECONNECT_TIMEOUT_MS * 1000000ULL;
+    long delay_ms = 1;
+    transport_close(t);
+    while (!*saved.stop_flag) {
+        if (transport_connect(t, saved.kind, saved.source, saved.name, saved.stop_flag) == 0) {
+            t->batches = saved.batches;
+            t->records = saved.records;
+            t->bytes = saved.bytes;
+            t->reconnects = saved.reconnects + 1;
+            return 0;
+        }
+        transport_close(t);
+        if (monotonic_ns() >= deadline) break;
+        struct timespec ts = {delay_ms / 1000, (delay_ms % 1000) * 1000000L};
+        nanosleep(&ts, NULL);
+        delay_ms = delay_ms * 2 > TRANSPORT_RECONNECT_MAX_MS ? TRANSPORT_RECONNECT_MAX_MS : delay_ms * 2;
+    }
+    t->reconnects = saved.reconnects;
+    errno = EPIPE;
+    return -1;
+}
+
+void transport_report(const transport_t *t, FILE *out, int process_num) {
+    fprintf(out, "\nProcess %d: %s transport %s, %llu records in %llu batches, %llu bytes",
+            process_num, transport_kind_names[t->kind], t->name, t->records, t->batches, t->bytes);
+    if (t->reconnects > 0) fprintf(out, ", %llu reconnects", t->reconnects);
+    if (t->decode_errors > 0) fprintf(out, ", %llu corrupt records dropped", t->decode_errors);
+    fprintf(out, "\n");
+}
+
+#endif //PROCESSES_TRANSPORT_H
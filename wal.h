@@ -0,0 +1,209 @@
+//
+// Write-ahead log format for P5 ("-f wal"). The file starts with an 8-byte
+// magic, followed by length-prefixed records:
+//
+//   [length u32][crc32c u32][ts_ns u64][seq u64][source u16][type u16][reserved u32][payload]
+//
+// Typed values are stored in binary (8 bytes for VALUE_INT/VALUE_DOUBLE) and
+// rendered by the reader, strings and rendered lines are stored as text.
+// The CRC covers everything after the crc field, including the payload. On
+// startup wal_recover() maps the file, validates every record, truncates a
+// torn or corrupt tail and reports per-source sequence gaps.
+//
+
+#ifndef PROCESSES_WAL_H
+#define PROCESSES_WAL_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "record.h"
+#include "crc32c.h"
+
+#define WAL_MAGIC "P5WAL001"
+#define WAL_MAGIC_LEN 8
+#define WAL_MAX_PAYLOAD 65536
+#define WAL_MAX_SOURCES 256
+
+typedef struct {
+    uint32_t length;   // Payload length in bytes
+    uint32_t crc;      // CRC32C of the header after this field plus the payload
+    uint64_t ts_ns;
+    uint64_t seq;
+    uint16_t source;
+    uint16_t type;     // value_type_t of the payload (0 = rendered line)
+    uint32_t reserved;
+} wal_header_t;
+
+typedef struct {
+    unsigned long long last_seq;
+    unsigned long long records;
+    unsigned long long gaps;     // Places where at least one record is missing
+    unsigned long long missing;  // Total number of missing sequence numbers
+    unsigned long long restarts; // Sequence restarted at 1 (producer restarted)
+} wal_source_stats_t;
+
+typedef struct {
+    unsigned long long records;
+    unsigned long long valid_bytes;
+    unsigned long long truncated_bytes;
+    double seconds;
+    wal_source_stats_t sources[WAL_MAX_SOURCES];
+} wal_recovery_t;
+
+uint32_t wal_record_crc(const wal_header_t *hdr, const void *payload) {
+    uint32_t crc = crc32c_update(0, (const unsigned char *)hdr + offsetof(wal_header_t, ts_ns),
+                                 sizeof(*hdr) - offsetof(wal_header_t, ts_ns));
+    return crc32c_update(crc, payload, hdr->length);
+}
+
+// --- Fill in the header (with checksum) of a record, returns the payload length used ---
+size_t wal_make_header(wal_header_t *hdr, int source, record_stamp_t stamp, int type, const void *payload, size_t len) {
+    if (len > WAL_MAX_PAYLOAD) len = WAL_MAX_PAYLOAD;
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->length = (uint32_t)len;
+    hdr->ts_ns = stamp.ts_ns;
+    hdr->seq = stamp.seq;
+    hdr->source = (uint16_t)source;
+    hdr->type = (uint16_t)type;
+    hdr->crc = wal_record_crc(hdr, payload);
+    return len;
+}
+
+// --- Append one record, returns -1 on write error ---
+int wal_append(FILE *fp, int source, record_stamp_t stamp, int type, const void *payload, size_t len) {
+    wal_header_t hdr;
+    len = wal_make_header(&hdr, source, stamp, type, payload, len);
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1) return -1;
+    if (len > 0 && fwrite(payload, 1, len, fp) != len) return -1;
+    return 0;
+}
+
+// --- Validate the record at *offset; on success fill hdr/payload and advance ---
+// Returns 0 at a clean end of file, -1 for a torn or corrupt record.
+int wal_next(const unsigned char *base, size_t size, size_t *offset,
+             wal_header_t *hdr, const char **payload) {
+    if (*offset == size) return 0;
+    if (size - *offset < sizeof(*hdr)) return -1;
+    memcpy(hdr, base + *offset, sizeof(*hdr));
+    if (hdr->length > WAL_MAX_PAYLOAD || size - *offset - sizeof(*hdr) < hdr->length) return -1;
+    const char *data = (const char *)base + *offset + sizeof(*hdr);
+    if (wal_record_crc(hdr, data) != hdr->crc) return -1;
+    *payload = data;
+    *offset += sizeof(*hdr) + hdr->length;
+    return 1;
+}
+
+void wal_track_sequence(wal_source_stats_t *stats, unsigned long long seq) {
+    if (seq == 0) {
+        // Unstamped record, nothing to check
+    } else if (stats->records > 0 && seq == 1) {
+        stats->restarts++;
+    } else if (stats->records > 0 && stats->last_seq != 0 && seq > stats->last_seq + 1) {
+        stats->gaps++;
+        stats->missing += seq - stats->last_seq - 1;
+    }
+    stats->last_seq = seq;
+    stats->records++;
+}
+
+// --- Open-or-create the WAL, validate it and cut off a torn tail ---
+// Returns 0 on success, -1 on error (errno set, or EINVAL if not a WAL file).
+int wal_recover(const char *path, wal_recovery_t *report) {
+    memset(report, 0, sizeof(*report));
+    unsigned long long start = monotonic_ns();
+    int fd = open(path, O_RDWR | O_CREAT, 0666);
+    if (fd == -1) return -1;
+    struct stat st;
+    if (fstat(fd, &st) == -1) { close(fd); return -1; }
+
+    size_t size = (size_t)st.st_size;
+    if (size < WAL_MAGIC_LEN) {
+        // New (or torn before the magic was complete) log: start a fresh file
+        if (ftruncate(fd, 0) == -1 || write(fd, WAL_MAGIC, WAL_MAGIC_LEN) != WAL_MAGIC_LEN) {
+            close(fd);
+            return -1;
+        }
+        report->truncated_bytes = size;
+        report->valid_bytes = WAL_MAGIC_LEN;
+        close(fd);
+        report->seconds = (double)(monotonic_ns() - start) / 1e9;
+        return 0;
+    }
+
+    unsigned char *base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) { close(fd); return -1; }
+    posix_madvise(base, size, POSIX_MADV_SEQUENTIAL);
+    if (memcmp(base, WAL_MAGIC, WAL_MAGIC_LEN) != 0) {
+        munmap(base, size);
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t offset = WAL_MAGIC_LEN;
+    wal_header_t hdr;
+    const char *payload;
+    while (wal_next(base, size, &offset, &hdr, &payload) == 1) {
+        wal_track_sequence(&report->sources[hdr.source % WAL_MAX_SOURCES], hdr.seq);
+        report->records++;
+    }
+    munmap(base, size);
+
+    report->valid_bytes = offset;
+    report->truncated_bytes = size - offset;
+    if (offset < size && ftruncate(fd, (off_t)offset) == -1) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    report->seconds = (double)(monotonic_ns() - start) / 1e9;
+    return 0;
+}
+
+void wal_report_recovery(const wal_recovery_t *report, FILE *out) {
+    double mb = (double)report->valid_bytes / (1024.0 * 1024.0);
+    fprintf(out, "WAL recovery: %llu records, %.2f MiB in %.3f s (%.0f MiB/s), truncated %llu torn bytes\n",
+            report->records, mb, report->seconds,
+            report->seconds > 0 ? mb / report->seconds : 0.0, report->truncated_bytes);
+    for (int source = 0; source < WAL_MAX_SOURCES; source++) {
+        const wal_source_stats_t *stats = &report->sources[source];
+        if (stats->records == 0) continue;
+        fprintf(out, "  source %d: %llu records, last seq %llu, %llu gaps (%llu missing), %llu restarts\n",
+                source, stats->records, stats->last_seq, stats->gaps, stats->missing, stats->restarts);
+    }
+}
+
+// --- Append a typed record: numbers in binary, text as is ---
+int wal_append_record(FILE *fp, const log_record_t *rec) {
+    if (rec->type == VALUE_INT || rec->type == VALUE_DOUBLE) {
+        return wal_append(fp, rec->source, rec->stamp, rec->type, &rec->value, sizeof(rec->value));
+    }
+    return wal_append(fp, rec->source, rec->stamp, rec->type, rec->text, strlen(rec->text));
+}
+
+// --- Turn a validated WAL record back into a log record ---
+void wal_to_record(const wal_header_t *hdr, const char *payload, log_record_t *rec) {
+    memset(rec, 0, sizeof(*rec));
+    rec->stamp.ts_ns = hdr->ts_ns;
+    rec->stamp.seq = hdr->seq;
+    rec->source = hdr->source;
+    rec->type = hdr->type;
+    rec->stamped = 1;
+    if ((hdr->type == VALUE_INT || hdr->type == VALUE_DOUBLE) && hdr->length == sizeof(rec->value)) {
+        memcpy(&rec->value, payload, sizeof(rec->value));
+    } else {
+        if (hdr->type != VALUE_STRING) rec->type = VALUE_LINE;
+        size_t len = hdr->length < sizeof(rec->text) - 1 ? hdr->length : sizeof(rec->text) - 1;
+        memcpy(rec->text, payload, len);
+        rec->text[len] = '\0';
+    }
+}
+
+#endif //PROCESSES_WAL_H
@@ -0,0 +1,178 @@
+//
+// Input handling shared by the workers (P2 integers, P3 floats, P4 strings)
+// and the worker threads of the in-process pipeline: one input line becomes
+// one typed record, parsed the same way whichever deployment runs it.
+//
+
+#ifndef PROCESSES_WORKER_H
+#define PROCESSES_WORKER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include "common.h"
+#include "record.h"
+#include "sendbatch.h"
+#include "transport.h"
+
+#define WORKER_INPUT_MAX (MAX_MSG_SIZE - 56) // Longest string value, leaves room for the wire header
+#define WORKER_INPUT_BUFFER 16384              // Bytes of input taken per read()
+
+// Input of a process worker, read straight from its fd so it can wait with a
+// timeout (a pending send batch is due) without stdio hiding buffered lines
+typedef struct {
+    int fd;
+    char buf[WORKER_INPUT_BUFFER];
+    size_t start, end; // Unconsumed bytes
+    int eof;
+} worker_input_t;
+
+// --- Record type a worker produces ---
+int worker_value_type(int source) {
+    if (source == 2) return VALUE_INT;
+    if (source == 3) return VALUE_DOUBLE;
+    return VALUE_STRING;
+}
+
+// --- Read one input line without its newline ---
+// The rest of an over-long line is discarded. Returns 0 on EOF or error.
+int worker_read_line(FILE *in, char *buf, size_t size) {
+    if (fgets(buf, (int)size, in) == NULL) return 0;
+    size_t len = strcspn(buf, "\n");
+    if (buf[len] != '\n' && !feof(in)) {
+        int c;
+        while ((c = fgetc(in)) != '\n' && c != EOF);
+    }
+    buf[len] = '\0';
+    return 1;
+}
+
+void worker_input_init(worker_input_t *in, int fd) {
+    in->fd = fd;
+    in->start = in->end = 0;
+    in->eof = 0;
+}
+
+// --- Next input line without its newline, waiting at most 'timeout_ns' (-1 = no limit) ---
+// Lines are cut out of one buffer, so a burst of input costs a read() per
+// buffer instead of per line. An over-long line is cut like worker_read_line
+// does. Returns 1 for a line, 0 on EOF or error (EINTR included), -1 on timeout.
+int worker_input_line(worker_input_t *in, char *out, size_t size, long long timeout_ns) {
+    unsigned long long deadline = timeout_ns >= 0 ? monotonic_ns() + (unsigned long long)timeout_ns : 0;
+    while (1) {
+        size_t avail = in->end - in->start;
+        char *newline = memchr(in->buf + in->start, '\n', avail);
+        if (newline || (in->eof && avail > 0) || avail == sizeof(in->buf)) {
+            size_t len = newline ? (size_t)(newline - (in->buf + in->start)) : avail;
+            size_t copy = len < size - 1 ? len : size - 1;
+            memcpy(out, in->buf + in->start, copy);
+            out[copy] = '\0';
+            in->start += len + (newline ? 1 : 0);
+            return 1;
+        }
+        if (in->eof) return 0;
+        if (in->start > 0) {
+            memmove(in->buf, in->buf + in->start, avail);
+            in->start = 0;
+            in->end = avail;
+        }
+        if (timeout_ns >= 0) {
+            unsigned long long now = monotonic_ns();
+            if (now >= deadline) return -1;
+            unsigned long long left_us = (deadline - now + 999) / 1000;
+            struct timeval tv = {(time_t)(left_us / 1000000ULL), (suseconds_t)(left_us % 1000000ULL)};
+            fd_set read_set;
+            FD_ZERO(&read_set);
+            FD_SET(in->fd, &read_set);
+            int ready = select(in->fd + 1, &read_set, NULL, NULL, &tv);
+            if (ready == 0) return -1;
+            if (ready == -1) return 0;
+        }
+        ssize_t n = read(in->fd, in->buf + in->end, sizeof(in->buf) - in->end);
+        if (n == 0) in->eof = 1;
+        else if (n < 0) return 0;
+        else in->end += (size_t)n;
+    }
+}
+
+// --- Parse one input line into the value of 'rec' for worker 'source' ---
+// Returns 1 for a valid value, 0 for invalid input, -1 for a blank line that
+// the numeric workers skip (strings may be empty).
+int worker_parse_value(int source, const char *line, log_record_t *rec) {
+    char *end = NULL;
+    rec->source = source;
+    rec->type = worker_value_type(source);
+    rec->stamped = 1;
+    rec->traced = 0;
+    if (rec->type == VALUE_STRING) {
+        snprintf(rec->text, sizeof(rec->text), "%s", line);
+        return 1;
+    }
+
+    const char *p = line;
+    while (isspace((unsigned char)*p)) p++;
+    if (*p == '\0') return -1;
+    errno = 0;
+    if (rec->type == VALUE_INT) {
+        long long value = strtoll(p, &end, 10);
+        if (end == p || errno == ERANGE) return 0;
+        rec->value.i = value;
+    } else {
+        double value = strtod(p, &end);
+        if (end == p) return 0;
+        rec->value.d = value;
+    }
+    return 1;
+}
+
+// --- Stamp a record when its value is accepted from input ---
+// Called after parsing and filtering, before pacing and batching: the stamp is
+// the accept time that P5's reorder buffer orders by and the trace stages start
+// from, not the time the record leaves in a send.
+void worker_stamp(log_record_t *rec, unsigned long long *send_seq) {
+    rec->stamp.ts_ns = monotonic_ns();
+    rec->stamp.seq = ++*send_seq;
+}
+
+// --- Sample every 'trace_every'-th record for tracing (0 = off), after worker_stamp ---
+// 'read_ns' is when its input line was read; the send stage is stamped on encoding.
+void worker_trace(log_record_t *rec, unsigned long long read_ns, int trace_every) {
+    if (trace_every <= 0 || rec->stamp.seq % (unsigned long long)trace_every != 0) return;
+    rec->traced = 1;
+    rec->trace.read_ns = read_ns;
+    rec->trace.encode_ns = rec->stamp.ts_ns;
+}
+
+// --- Send the pending batch of process 'process_num', reconnecting once if P5 was restarted ---
+// After a reconnect only the records the old channel did not take completely
+// are sent again, so none reaches the log twice. Any other send error, or a
+// reconnect that fails, drops the batch and stops the worker.
+void worker_flush_batch(transport_t *channel, send_batch_t *batch, send_flush_reason_t reason, int process_num,
+                        volatile sig_atomic_t *terminate_flag) {
+    if (batch->count == 0) return;
+    int done = 0;
+    int sent = transport_send_batch(channel, batch->records, batch->count, &done);
+    if (sent == -1 && transport_peer_lost(errno)) {
+        fprintf(stderr, "\nProcess %d: Channel to P5 lost, reconnecting...\n", process_num);
+        if (transport_reconnect(channel) == 0) {
+            sent = transport_send_batch(channel, batch->records + done, batch->count - done, NULL);
+        }
+    }
+    if (sent == -1) {
+        if (errno == EPIPE) {
+            fprintf(stderr, "\nProcess %d: Channel closed by P5. Terminating.\n", process_num);
+        } else {
+            fprintf(stderr, "\nProcess %d: Failed to send record: %s. Terminating.\n", process_num, strerror(errno));
+        }
+        *terminate_flag = 1;
+        batch->count = 0; // Dropped, like a failed single send
+    }
+    send_batch_sent(batch, reason);
+}
+
+#endif //PROCESSES_WORKER_H